@@ -20,10 +20,10 @@ RETURNS INTEGER AS
 $$
 DECLARE
 	v_child_relname		TEXT;
-	v_type				TEXT;
 	v_plain_schema		TEXT;
 	v_plain_relname		TEXT;
-	v_hashfunc			TEXT;
+	v_hash_expr			TEXT;
+	v_key_columns		TEXT[];
 
 BEGIN
 	IF partition_data = true THEN
@@ -35,15 +35,15 @@ BEGIN
 	END IF;
 
 	PERFORM @extschema@.validate_relname(parent_relid);
-	attribute := lower(attribute);
+	/* Key might consist of several columns ('a, b') */
+	v_key_columns := @extschema@.get_key_columns(lower(attribute));
+	attribute := array_to_string(v_key_columns, ',');
 	PERFORM @extschema@.common_relation_checks(parent_relid, attribute);
 
-	v_type := @extschema@.get_attribute_type_name(parent_relid, attribute);
-
 	SELECT * INTO v_plain_schema, v_plain_relname
 	FROM @extschema@.get_plain_schema_and_relname(parent_relid);
 
-	v_hashfunc := @extschema@.get_type_hash_func(v_type::regtype)::regproc;
+	v_hash_expr := @extschema@.build_hash_expr(parent_relid, attribute);
 
 	/* Insert new entry to pathman config */
 	INSERT INTO @extschema@.pathman_config (partrel, attname, parttype)
@@ -61,12 +61,11 @@ BEGIN
 					   parent_relid::TEXT);
 
 		EXECUTE format('ALTER TABLE %s ADD CONSTRAINT %s
-						CHECK (@extschema@.get_hash_part_idx(%s(%s), %s) = %s)',
+						CHECK (@extschema@.get_hash_part_idx(%s, %s) = %s)',
 					   v_child_relname,
 					   @extschema@.build_check_constraint_name(v_child_relname::REGCLASS,
-															   attribute),
-					   v_hashfunc,
-					   attribute,
+															   v_key_columns[1]),
+					   v_hash_expr,
 					   partitions_count,
 					   partnum);
 
@@ -105,8 +104,8 @@ DECLARE
 					new_idx		INTEGER;
 
 				  BEGIN
-					old_idx := @extschema@.get_hash_part_idx(%9$s(OLD.%2$s), %3$s);
-					new_idx := @extschema@.get_hash_part_idx(%9$s(NEW.%2$s), %3$s);
+					old_idx := @extschema@.get_hash_part_idx(%2$s, %3$s);
+					new_idx := @extschema@.get_hash_part_idx(%9$s, %3$s);
 
 					IF old_idx = new_idx THEN
 						RETURN NEW;
@@ -137,8 +136,6 @@ DECLARE
 	child_relname_format	TEXT;
 	funcname				TEXT;
 	triggername				TEXT;
-	atttype					TEXT;
-	hashfunc				TEXT;
 	partitions_count		INTEGER;
 
 BEGIN
@@ -179,13 +176,12 @@ BEGIN
 	child_relname_format := quote_ident(plain_schema) || '.' ||
 							quote_ident(plain_relname || '_%s');
 
-	/* Fetch base hash function for atttype */
-	atttype := @extschema@.get_attribute_type_name(parent_relid, attr);
-	hashfunc := @extschema@.get_type_hash_func(atttype::regtype)::regproc;
-
 	/* Format function definition and execute it */
-	func := format(func, funcname, attr, partitions_count, att_val_fmt,
-				   old_fields, att_fmt, new_fields, child_relname_format, hashfunc);
+	func := format(func, funcname,
+				   @extschema@.build_hash_expr(parent_relid, attr, 'OLD.'),
+				   partitions_count, att_val_fmt, old_fields, att_fmt,
+				   new_fields, child_relname_format,
+				   @extschema@.build_hash_expr(parent_relid, attr, 'NEW.'));
 	EXECUTE func;
 
 	/* Create trigger on every partition */
@@ -201,6 +197,41 @@ BEGIN
 END
 $$ LANGUAGE plpgsql;
 
+/*
+ * Build hash expression for (possibly multi-column) partitioning key,
+ * e.g. 'combine_hashes(hashint4(a), hashtext(b))'. Each column is
+ * prefixed with 'prefix' (e.g. 'NEW.').
+ */
+CREATE OR REPLACE FUNCTION @extschema@.build_hash_expr(
+	parent_relid	REGCLASS,
+	attribute		TEXT,
+	prefix			TEXT DEFAULT '')
+RETURNS TEXT AS
+$$
+DECLARE
+	v_column		TEXT;
+	v_hashfunc		TEXT;
+	v_hash_expr		TEXT;
+
+BEGIN
+	FOREACH v_column IN ARRAY @extschema@.get_key_columns(attribute)
+	LOOP
+		v_hashfunc := @extschema@.get_type_hash_func(
+						@extschema@.get_attribute_type_name(parent_relid,
+															v_column)::regtype)::regproc;
+
+		IF v_hash_expr IS NULL THEN
+			v_hash_expr := format('%s(%s%s)', v_hashfunc, prefix, v_column);
+		ELSE
+			v_hash_expr := format('@extschema@.combine_hashes(%s, %s(%s%s))',
+								  v_hash_expr, v_hashfunc, prefix, v_column);
+		END IF;
+	END LOOP;
+
+	RETURN v_hash_expr;
+END
+$$ LANGUAGE plpgsql;
+
 /*
  * Returns hash function OID for specified type
  */
@@ -214,3 +245,10 @@ LANGUAGE C STRICT;
 CREATE OR REPLACE FUNCTION @extschema@.get_hash_part_idx(INTEGER, INTEGER)
 RETURNS INTEGER AS 'pg_pathman', 'get_hash_part_idx'
 LANGUAGE C STRICT;
+
+/*
+ * Mixes hash values of two columns (multi-column key)
+ */
+CREATE OR REPLACE FUNCTION @extschema@.combine_hashes(INTEGER, INTEGER)
+RETURNS INTEGER AS 'pg_pathman', 'combine_hashes'
+LANGUAGE C STRICT;
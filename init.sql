@@ -11,10 +11,11 @@
 /*
  * Pathman config
  *		partrel - regclass (relation type, stored as Oid)
- *		attname - partitioning key
+ *		attname - partitioning key (column, columns or RANGE expression)
  *		parttype - partitioning type:
  *			1 - HASH
  *			2 - RANGE
+ *			3 - LIST
  *		range_interval - base interval for RANGE partitioning as string
  */
 CREATE TABLE IF NOT EXISTS @extschema@.pathman_config (
@@ -23,7 +24,7 @@ CREATE TABLE IF NOT EXISTS @extschema@.pathman_config (
 	parttype		INTEGER NOT NULL,
 	range_interval	TEXT,
 
-	CHECK (parttype IN (1, 2)) /* check for allowed part types */
+	CHECK (parttype IN (1, 2, 3)) /* check for allowed part types */
 );
 
 /*
@@ -31,11 +32,15 @@ CREATE TABLE IF NOT EXISTS @extschema@.pathman_config (
  *		partrel - regclass (relation type, stored as Oid)
  *		enable_parent - add parent table to plan
  *		auto - enable automatic partition creation
+ *		default_partition - partition for rows not covered by other partitions
+ *		monotonic_key - partitioning expression is non-decreasing in its column
  */
 CREATE TABLE IF NOT EXISTS @extschema@.pathman_config_params (
-	partrel			REGCLASS NOT NULL PRIMARY KEY,
-	enable_parent	BOOLEAN NOT NULL DEFAULT TRUE,
-	auto			BOOLEAN NOT NULL DEFAULT TRUE
+	partrel				REGCLASS NOT NULL PRIMARY KEY,
+	enable_parent		BOOLEAN NOT NULL DEFAULT TRUE,
+	auto				BOOLEAN NOT NULL DEFAULT TRUE,
+	default_partition	REGCLASS DEFAULT NULL,
+	monotonic_key		BOOLEAN NOT NULL DEFAULT FALSE
 );
 CREATE UNIQUE INDEX i_pathman_config_params
 ON @extschema@.pathman_config_params(partrel);
@@ -93,7 +98,7 @@ LANGUAGE plpgsql;
 CREATE OR REPLACE FUNCTION @extschema@.pathman_set_param(
 	relation	REGCLASS,
 	param		TEXT,
-	value		BOOLEAN)
+	value		ANYELEMENT)
 RETURNS VOID AS
 $$
 BEGIN
@@ -153,6 +158,22 @@ END
 $$
 LANGUAGE plpgsql;
 
+/*
+ * Declare that partitioning expression never decreases when its column grows
+ * (e.g. date_trunc('day', ts)). This lets range conditions on the column
+ * prune partitions.
+ */
+CREATE OR REPLACE FUNCTION @extschema@.set_monotonic_key(
+	relation	REGCLASS,
+	value		BOOLEAN DEFAULT TRUE)
+RETURNS VOID AS
+$$
+BEGIN
+	PERFORM @extschema@.pathman_set_param(relation, 'monotonic_key', value);
+END
+$$
+LANGUAGE plpgsql;
+
 /*
  * Show all existing concurrent partitioning tasks.
  */
@@ -309,6 +330,7 @@ RETURNS BOOLEAN AS
 $$
 DECLARE
 	v_rec			RECORD;
+	v_column		TEXT;
 	is_referenced	BOOLEAN;
 	rel_persistence	CHAR;
 
@@ -327,9 +349,17 @@ BEGIN
 		RAISE EXCEPTION 'Relation "%" has already been partitioned', p_relation;
 	END IF;
 
-	IF @extschema@.is_attribute_nullable(p_relation, p_attribute) THEN
-		RAISE EXCEPTION 'Partitioning key ''%'' must be NOT NULL', p_attribute;
-	END IF;
+	/* Partitioning expression is checked as a whole */
+	FOREACH v_column IN ARRAY
+		CASE WHEN @extschema@.is_partitioning_expression(p_relation, p_attribute)
+			 THEN ARRAY[p_attribute]
+			 ELSE @extschema@.get_key_columns(p_attribute)
+		END
+	LOOP
+		IF @extschema@.is_attribute_nullable(p_relation, v_column) THEN
+			RAISE EXCEPTION 'Partitioning key ''%'' must be NOT NULL', v_column;
+		END IF;
+	END LOOP;
 
 	/* Check if there are foreign keys that reference the relation */
 	FOR v_rec IN (SELECT *
@@ -469,6 +499,15 @@ BEGIN
 	)
 	DELETE FROM @extschema@.pathman_config_params
 	WHERE partrel IN (SELECT rel FROM to_be_deleted);
+
+	/* Forget dropped default partitions */
+	WITH to_be_reset AS (
+		SELECT cfg.partrel AS rel FROM pg_event_trigger_dropped_objects() AS events
+		JOIN @extschema@.pathman_config_params AS cfg ON cfg.default_partition::oid = events.objid
+		WHERE events.classid = pg_class_oid
+	)
+	UPDATE @extschema@.pathman_config_params SET default_partition = NULL
+	WHERE partrel IN (SELECT rel FROM to_be_reset);
 END
 $$
 LANGUAGE plpgsql;
@@ -522,6 +561,12 @@ BEGIN
 				  FROM pg_catalog.pg_inherits
 				  WHERE inhparent::regclass = parent_relid)
 	LOOP
+		/* Partition might be partitioned as well */
+		IF EXISTS (SELECT * FROM @extschema@.pathman_config
+				   WHERE partrel = v_rec.tbl::REGCLASS) THEN
+			PERFORM @extschema@.drop_partitions(v_rec.tbl::REGCLASS, delete_data);
+		END IF;
+
 		IF NOT delete_data THEN
 			EXECUTE format('WITH part_data AS (DELETE FROM %s RETURNING *)
 							INSERT INTO %s SELECT * FROM part_data',
@@ -614,6 +659,17 @@ CREATE OR REPLACE FUNCTION @extschema@.get_parent_of_partition(REGCLASS)
 RETURNS REGCLASS AS 'pg_pathman', 'get_parent_of_partition_pl'
 LANGUAGE C STRICT;
 
+/*
+ * Split partitioning key into columns ('a, b' -> {a,b})
+ */
+CREATE OR REPLACE FUNCTION @extschema@.get_key_columns(
+	p_attribute		TEXT)
+RETURNS TEXT[] AS
+$$
+	SELECT array_agg(trim(col) ORDER BY num)
+	FROM unnest(string_to_array(p_attribute, ',')) WITH ORDINALITY AS t(col, num);
+$$ LANGUAGE sql IMMUTABLE STRICT;
+
 /*
  * Checks if attribute is nullable
  */
@@ -622,6 +678,14 @@ CREATE OR REPLACE FUNCTION @extschema@.is_attribute_nullable(
 RETURNS BOOLEAN AS 'pg_pathman', 'is_attribute_nullable'
 LANGUAGE C STRICT;
 
+/*
+ * Checks if partitioning key is an expression (e.g. "date_trunc('day', ts)")
+ */
+CREATE OR REPLACE FUNCTION @extschema@.is_partitioning_expression(
+	REGCLASS, TEXT)
+RETURNS BOOLEAN AS 'pg_pathman', 'is_partitioning_expression_pl'
+LANGUAGE C STRICT;
+
 /*
  * Check if regclass is date or timestamp
  */
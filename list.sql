@@ -0,0 +1,229 @@
+/* ------------------------------------------------------------------------
+ *
+ * list.sql
+ *      LIST partitioning functions
+ *
+ * Copyright (c) 2015-2016, Postgres Professional
+ *
+ * ------------------------------------------------------------------------
+ */
+
+/*
+ * Check that the set of values is suitable for a LIST partition
+ */
+CREATE OR REPLACE FUNCTION @extschema@.check_list_values(
+	p_values		ANYARRAY)
+RETURNS VOID AS
+$$
+BEGIN
+	IF array_length(p_values, 1) IS NULL THEN
+		RAISE EXCEPTION 'LIST partition must contain at least one value';
+	END IF;
+
+	IF array_position(p_values, NULL) IS NOT NULL THEN
+		RAISE EXCEPTION 'LIST partition cannot contain NULL values';
+	END IF;
+
+	IF array_length(p_values, 1) != (SELECT count(DISTINCT v)
+									 FROM unnest(p_values) v) THEN
+		RAISE EXCEPTION 'LIST partition values must be unique';
+	END IF;
+END
+$$ LANGUAGE plpgsql;
+
+/*
+ * Creates LIST partitions for specified relation (one partition per value)
+ */
+CREATE OR REPLACE FUNCTION @extschema@.create_list_partitions(
+	parent_relid	REGCLASS,
+	p_attribute		TEXT,
+	p_values		ANYARRAY,
+	partition_data	BOOLEAN DEFAULT true)
+RETURNS INTEGER AS
+$$
+DECLARE
+	v_rows_count	INTEGER;
+	i				INTEGER;
+
+BEGIN
+	IF partition_data = true THEN
+		/* Acquire data modification lock */
+		PERFORM @extschema@.prevent_relation_modification(parent_relid);
+	ELSE
+		/* Acquire lock on parent */
+		PERFORM @extschema@.lock_partitioned_relation(parent_relid);
+	END IF;
+
+	PERFORM @extschema@.validate_relname(parent_relid);
+	p_attribute := lower(p_attribute);
+	PERFORM @extschema@.common_relation_checks(parent_relid, p_attribute);
+	PERFORM @extschema@.check_list_values(p_values);
+
+	/* Check that each row fits into one of the partitions */
+	EXECUTE format('SELECT count(*) FROM %s WHERE NOT (%s)',
+				   parent_relid::TEXT,
+				   @extschema@.build_list_condition(p_attribute, p_values))
+	INTO v_rows_count;
+
+	IF v_rows_count > 0 THEN
+		RAISE EXCEPTION 'Not enough partitions to fit all values of ''%''',
+				p_attribute;
+	END IF;
+
+	/* Create sequence for child partitions names */
+	PERFORM @extschema@.create_or_replace_sequence(schema, relname)
+	FROM @extschema@.get_plain_schema_and_relname(parent_relid);
+
+	/* Insert new entry to pathman config */
+	INSERT INTO @extschema@.pathman_config (partrel, attname, parttype)
+	VALUES (parent_relid, p_attribute, 3);
+
+	/* Create new partitions */
+	FOR i IN array_lower(p_values, 1)..array_upper(p_values, 1)
+	LOOP
+		PERFORM @extschema@.create_single_list_partition(parent_relid,
+														 p_values[i:i]);
+	END LOOP;
+
+	/* Notify backend about changes */
+	PERFORM @extschema@.on_create_partitions(parent_relid);
+
+	/* Relocate data if asked to */
+	IF partition_data = true THEN
+		PERFORM @extschema@.disable_parent(parent_relid);
+		PERFORM @extschema@.partition_data(parent_relid);
+	ELSE
+		PERFORM @extschema@.enable_parent(parent_relid);
+	END IF;
+
+	RETURN array_length(p_values, 1);
+END
+$$ LANGUAGE plpgsql;
+
+/*
+ * Creates new LIST partition. Returns partition name.
+ */
+CREATE OR REPLACE FUNCTION @extschema@.create_single_list_partition(
+	parent_relid	REGCLASS,
+	p_values		ANYARRAY,
+	partition_name	TEXT DEFAULT NULL)
+RETURNS TEXT AS
+$$
+DECLARE
+	v_part_num				INT;
+	v_child_relname			TEXT;
+	v_plain_child_relname	TEXT;
+	v_attname				TEXT;
+	v_plain_schema			TEXT;
+	v_plain_relname			TEXT;
+	v_child_relname_exists	BOOL;
+	v_seq_name				TEXT;
+
+BEGIN
+	v_attname := attname FROM @extschema@.pathman_config
+				 WHERE partrel = parent_relid;
+
+	IF v_attname IS NULL THEN
+		RAISE EXCEPTION 'Table "%" is not partitioned', parent_relid::TEXT;
+	END IF;
+
+	SELECT * INTO v_plain_schema, v_plain_relname
+	FROM @extschema@.get_plain_schema_and_relname(parent_relid);
+
+	v_seq_name := @extschema@.get_sequence_name(v_plain_schema, v_plain_relname);
+
+	IF partition_name IS NULL THEN
+		/* Get next value from sequence */
+		LOOP
+			v_part_num := nextval(v_seq_name);
+			v_plain_child_relname := format('%s_%s', v_plain_relname, v_part_num);
+			v_child_relname := format('%s.%s',
+									  quote_ident(v_plain_schema),
+									  quote_ident(v_plain_child_relname));
+
+			v_child_relname_exists := count(*) > 0
+									  FROM pg_class
+									  WHERE relname = v_plain_child_relname AND
+											relnamespace = v_plain_schema::regnamespace
+									  LIMIT 1;
+
+			EXIT WHEN v_child_relname_exists = false;
+		END LOOP;
+	ELSE
+		v_child_relname := partition_name;
+	END IF;
+
+	EXECUTE format('CREATE TABLE %1$s (LIKE %2$s INCLUDING ALL) INHERITS (%2$s)',
+				   v_child_relname,
+				   parent_relid::TEXT);
+
+	EXECUTE format('ALTER TABLE %s ADD CONSTRAINT %s CHECK (%s)',
+				   v_child_relname,
+				   @extschema@.build_check_constraint_name(v_child_relname::REGCLASS,
+														   v_attname),
+				   @extschema@.build_list_condition(v_attname, p_values));
+
+	PERFORM @extschema@.copy_foreign_keys(parent_relid, v_child_relname::REGCLASS);
+
+	RETURN v_child_relname;
+END
+$$ LANGUAGE plpgsql
+SET client_min_messages = WARNING;
+
+/*
+ * Add new LIST partition
+ */
+CREATE OR REPLACE FUNCTION @extschema@.add_list_partition(
+	parent_relid	REGCLASS,
+	p_values		ANYARRAY,
+	partition_name	TEXT DEFAULT NULL)
+RETURNS TEXT AS
+$$
+DECLARE
+	v_part_name		TEXT;
+
+BEGIN
+	/* Acquire lock on parent */
+	PERFORM @extschema@.lock_partitioned_relation(parent_relid);
+
+	PERFORM @extschema@.check_list_values(p_values);
+
+	/* check values overlap */
+	IF @extschema@.partitions_count(parent_relid) > 0
+	   AND @extschema@.check_list_overlap(parent_relid, p_values) THEN
+		RAISE EXCEPTION 'Specified values overlap with existing partitions';
+	END IF;
+
+	/* Create new partition */
+	v_part_name := @extschema@.create_single_list_partition(parent_relid,
+															p_values,
+															partition_name);
+	PERFORM @extschema@.on_update_partitions(parent_relid);
+
+	RETURN v_part_name;
+END
+$$
+LANGUAGE plpgsql;
+
+/*
+ * Construct CHECK constraint condition for a LIST partition.
+ */
+CREATE OR REPLACE FUNCTION @extschema@.build_list_condition(
+	p_attname		TEXT,
+	p_values		ANYARRAY)
+RETURNS TEXT AS
+$$
+BEGIN
+	RETURN format('%s = ANY(%L::%s)', p_attname, p_values, pg_typeof(p_values));
+END
+$$ LANGUAGE plpgsql;
+
+/*
+ * Checks if any of values is already listed in existing partitions.
+ * Returns TRUE if overlaps and FALSE otherwise.
+ */
+CREATE OR REPLACE FUNCTION @extschema@.check_list_overlap(
+	parent_relid	REGCLASS,
+	p_values		ANYARRAY)
+RETURNS BOOLEAN AS 'pg_pathman', 'check_list_overlap'
+LANGUAGE C STRICT;
@@ -103,7 +103,10 @@ BEGIN
 	END IF;
 
 	PERFORM @extschema@.validate_relname(parent_relid);
-	p_attribute := lower(p_attribute);
+	/* Partitioning key might be an expression, e.g. "date_trunc('day', ts)" */
+	IF NOT @extschema@.is_partitioning_expression(parent_relid, p_attribute) THEN
+		p_attribute := lower(p_attribute);
+	END IF;
 	PERFORM @extschema@.common_relation_checks(parent_relid, p_attribute);
 
 	IF p_count < 0 THEN
@@ -133,7 +136,7 @@ BEGIN
 	 */
 	IF p_count != 0 THEN
 		/* Check boundaries */
-		EXECUTE format('SELECT @extschema@.check_boundaries(''%s'', ''%s'', ''%s'', ''%s''::%s)',
+		EXECUTE format('SELECT @extschema@.check_boundaries(''%s'', %L, ''%s'', ''%s''::%s)',
 					   parent_relid,
 					   p_attribute,
 					   p_start_value,
@@ -202,7 +205,10 @@ BEGIN
 	END IF;
 
 	PERFORM @extschema@.validate_relname(parent_relid);
-	p_attribute := lower(p_attribute);
+	/* Partitioning key might be an expression, e.g. "date_trunc('day', ts)" */
+	IF NOT @extschema@.is_partitioning_expression(parent_relid, p_attribute) THEN
+		p_attribute := lower(p_attribute);
+	END IF;
 	PERFORM @extschema@.common_relation_checks(parent_relid, p_attribute);
 
 	IF p_count < 0 THEN
@@ -299,7 +305,10 @@ BEGIN
 	END IF;
 
 	PERFORM @extschema@.validate_relname(parent_relid);
-	p_attribute := lower(p_attribute);
+	/* Partitioning key might be an expression, e.g. "date_trunc('day', ts)" */
+	IF NOT @extschema@.is_partitioning_expression(parent_relid, p_attribute) THEN
+		p_attribute := lower(p_attribute);
+	END IF;
 	PERFORM @extschema@.common_relation_checks(parent_relid, p_attribute);
 
 	IF p_interval <= 0 THEN
@@ -369,7 +378,10 @@ BEGIN
 	END IF;
 
 	PERFORM @extschema@.validate_relname(parent_relid);
-	p_attribute := lower(p_attribute);
+	/* Partitioning key might be an expression, e.g. "date_trunc('day', ts)" */
+	IF NOT @extschema@.is_partitioning_expression(parent_relid, p_attribute) THEN
+		p_attribute := lower(p_attribute);
+	END IF;
 	PERFORM @extschema@.common_relation_checks(parent_relid, p_attribute);
 
 	/* Check boundaries */
@@ -485,6 +497,93 @@ END
 $$ LANGUAGE plpgsql
 SET client_min_messages = WARNING;
 
+/*
+ * Use existing partition as a default one (for rows not covered by other
+ * partitions, e.g. outliers or values that fall into gaps).
+ */
+CREATE OR REPLACE FUNCTION @extschema@.set_default_partition(
+	parent_relid	REGCLASS,
+	partition_relid	REGCLASS)
+RETURNS VOID AS
+$$
+DECLARE
+	v_part_type		INTEGER;
+
+BEGIN
+	PERFORM @extschema@.validate_relname(parent_relid);
+	PERFORM @extschema@.validate_relname(partition_relid);
+
+	/* Acquire lock on parent */
+	PERFORM @extschema@.lock_partitioned_relation(parent_relid);
+
+	v_part_type := parttype FROM @extschema@.pathman_config
+				   WHERE partrel = parent_relid;
+
+	IF v_part_type IS NULL THEN
+		RAISE EXCEPTION 'Table "%" is not partitioned', parent_relid::TEXT;
+	END IF;
+
+	/* HASH partitioning routes every value, so this is RANGE & LIST only */
+	IF v_part_type NOT IN (2, 3) THEN
+		RAISE EXCEPTION 'Default partition is supported only for RANGE and LIST partitioning';
+	END IF;
+
+	IF NOT EXISTS (SELECT 1 FROM pg_catalog.pg_inherits
+				   WHERE inhrelid = partition_relid AND inhparent = parent_relid)
+	THEN
+		RAISE EXCEPTION 'Relation "%" is not a partition of "%"',
+			partition_relid::TEXT, parent_relid::TEXT;
+	END IF;
+
+	PERFORM @extschema@.pathman_set_param(parent_relid,
+										  'default_partition',
+										  partition_relid);
+END
+$$
+LANGUAGE plpgsql;
+
+/*
+ * Create default partition. Returns partition name.
+ */
+CREATE OR REPLACE FUNCTION @extschema@.create_default_partition(
+	parent_relid	REGCLASS,
+	partition_name	TEXT DEFAULT NULL)
+RETURNS TEXT AS
+$$
+DECLARE
+	v_child_relname			TEXT;
+	v_plain_schema			TEXT;
+	v_plain_relname			TEXT;
+
+BEGIN
+	PERFORM @extschema@.validate_relname(parent_relid);
+
+	/* Acquire lock on parent */
+	PERFORM @extschema@.lock_partitioned_relation(parent_relid);
+
+	SELECT * INTO v_plain_schema, v_plain_relname
+	FROM @extschema@.get_plain_schema_and_relname(parent_relid);
+
+	IF partition_name IS NULL THEN
+		v_child_relname := format('%s.%s',
+								  quote_ident(v_plain_schema),
+								  quote_ident(v_plain_relname || '_default'));
+	ELSE
+		v_child_relname := partition_name;
+	END IF;
+
+	EXECUTE format('CREATE TABLE %1$s (LIKE %2$s INCLUDING ALL) INHERITS (%2$s)',
+				   v_child_relname,
+				   parent_relid::TEXT);
+
+	PERFORM @extschema@.copy_foreign_keys(parent_relid, v_child_relname::REGCLASS);
+	PERFORM @extschema@.set_default_partition(parent_relid, v_child_relname::REGCLASS);
+
+	RETURN v_child_relname;
+END
+$$ LANGUAGE plpgsql
+SET client_min_messages = WARNING;
+
 /*
  * Split RANGE partition
  */
@@ -1128,6 +1227,10 @@ BEGIN
 		RAISE EXCEPTION 'Table "%" is not partitioned', parent_relid::TEXT;
 	END IF;
 
+	IF @extschema@.is_partitioning_expression(parent_relid, attr) THEN
+		RAISE EXCEPTION 'Update trigger is not supported for partitioning expressions';
+	END IF;
+
 	SELECT string_agg(attname, ', '),
 		   string_agg('OLD.' || attname, ', '),
 		   string_agg('NEW.' || attname, ', '),
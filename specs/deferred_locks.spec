@@ -0,0 +1,31 @@
+setup
+{
+	create extension pg_pathman;
+	create table test_tbl(id int not null, val real);
+	insert into test_tbl select i, i from generate_series(1, 1000) as i;
+	select create_range_partitions('test_tbl', 'id', 1, 100, 10);
+	create function test_val() returns int as $$ select 150 $$ language sql stable;
+}
+
+teardown
+{
+	drop function test_val();
+	drop table test_tbl cascade;
+	drop extension pg_pathman;
+}
+
+session "s1"
+setup
+{
+	set pg_pathman.enable_deferred_locks = on;
+	prepare q as select * from test_tbl where id = test_val();
+}
+step "s1_exec" { execute q; }
+
+session "s2"
+step "s2_b" { begin; }
+step "s2_c" { commit; }
+step "s2_drop" { drop table test_tbl_2; }
+
+
+permutation "s1_exec" "s2_b" "s2_drop" "s1_exec" "s2_c"
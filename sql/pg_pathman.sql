@@ -81,6 +81,7 @@ SET enable_seqscan = ON;
 EXPLAIN (COSTS OFF) SELECT * FROM test.hash_rel;
 EXPLAIN (COSTS OFF) SELECT * FROM test.hash_rel WHERE value = 2;
 EXPLAIN (COSTS OFF) SELECT * FROM test.hash_rel WHERE value = 2 OR value = 1;
+EXPLAIN (COSTS OFF) SELECT * FROM test.hash_rel WHERE value IN (2, 1, NULL);
 -- Temporarily commented out
 -- EXPLAIN (COSTS OFF) SELECT * FROM test.hash_rel WHERE value BETWEEN 1 AND 2;
 --                    QUERY PLAN
@@ -95,6 +96,13 @@ EXPLAIN (COSTS OFF) SELECT * FROM test.num_range_rel WHERE id > 2500;
 EXPLAIN (COSTS OFF) SELECT * FROM test.num_range_rel WHERE id >= 1000 AND id < 3000;
 EXPLAIN (COSTS OFF) SELECT * FROM test.num_range_rel WHERE id >= 1500 AND id < 2500;
 EXPLAIN (COSTS OFF) SELECT * FROM test.num_range_rel WHERE (id >= 500 AND id < 1500) OR (id > 2500);
+EXPLAIN (COSTS OFF) SELECT * FROM test.num_range_rel WHERE id IN (2500, 1500, 3500);
+EXPLAIN (COSTS OFF) SELECT * FROM test.num_range_rel WHERE id < ANY (ARRAY[500, 1500]);
+EXPLAIN (COSTS OFF) SELECT * FROM test.num_range_rel WHERE id > ALL (ARRAY[500, 2500]);
+EXPLAIN (COSTS OFF) SELECT * FROM test.num_range_rel WHERE id < 2500 AND txt <> 'x' AND id > 500;
+EXPLAIN (COSTS OFF) SELECT * FROM test.num_range_rel WHERE id IS NULL OR id > 2500;
+EXPLAIN (COSTS OFF) SELECT * FROM test.num_range_rel WHERE id IS NOT NULL AND id < 500;
+EXPLAIN (COSTS OFF) SELECT * FROM test.num_range_rel WHERE id::bigint >= 2500;
 EXPLAIN (COSTS OFF) SELECT * FROM test.range_rel WHERE dt > '2015-02-15';
 EXPLAIN (COSTS OFF) SELECT * FROM test.range_rel WHERE dt >= '2015-02-01' AND dt < '2015-03-01';
 EXPLAIN (COSTS OFF) SELECT * FROM test.range_rel WHERE dt >= '2015-02-15' AND dt < '2015-03-15';
@@ -378,6 +386,93 @@ set pg_pathman.enable = true
 set enable_hashjoin = off
 set enable_mergejoin = off;
 
+create or replace function test.stable_value(val int) returns int as $$
+begin
+	return val;
+end;
+$$ language plpgsql stable;
+
+create or replace function test.pathman_test_6() returns text as $$
+declare
+	plan jsonb;
+	num int;
+begin
+	plan = test.pathman_test('select * from test.runtime_test_1 where id = test.stable_value(1)');
+
+	perform test.pathman_equal((plan->0->'Plan'->'Node Type')::text,
+							   '"Custom Scan"',
+							   'wrong plan type');
+
+	perform test.pathman_equal((plan->0->'Plan'->'Custom Plan Provider')::text,
+							   '"RuntimeAppend"',
+							   'wrong plan provider');
+
+	perform test.pathman_equal((plan->0->'Plan'->'Plans'->0->'Relation Name')::text,
+							   format('"runtime_test_1_%s"', pathman.get_hash_part_idx(hashint4(1), 6)),
+							   'wrong partition');
+
+	select count(*) from jsonb_array_elements_text(plan->0->'Plan'->'Plans') into num;
+	perform test.pathman_equal(num::text, '1', 'expected 1 child plan for custom scan');
+
+	return 'ok';
+end;
+$$ language plpgsql;
+
+create or replace function test.pathman_test_7() returns text as $$
+declare
+	plan jsonb;
+	num int;
+begin
+	plan = test.pathman_test('select * from test.runtime_test_2 t join test.category c on t.category_id = c.id where c.name = ''cat1''');
+
+	perform test.pathman_equal((plan->0->'Plan'->'Node Type')::text,
+							   '"Hash Join"',
+							   'wrong plan type');
+
+	perform test.pathman_equal((plan->0->'Plan'->'Plans'->0->'Custom Plan Provider')::text,
+							   '"RuntimeAppend"',
+							   'wrong plan provider');
+
+	perform test.pathman_equal((plan->0->'Plan'->'Plans'->0->'Join Key Filter')::text,
+							   '"category_id"',
+							   'wrong join key filter');
+
+	perform test.pathman_equal((plan->0->'Plan'->'Plans'->0->'Plans'->0->'Relation Name')::text,
+							   format('"runtime_test_2_%s"', pathman.get_hash_part_idx(hashint4(1), 6)),
+							   'wrong partition');
+
+	select count(*) from jsonb_array_elements_text(plan->0->'Plan'->'Plans'->0->'Plans') into num;
+	perform test.pathman_equal(num::text, '1', 'expected 1 child plan for custom scan');
+
+	return 'ok';
+end;
+$$ language plpgsql
+set enable_hashjoin = on
+set enable_nestloop = off;
+
+create or replace function test.pathman_test_8() returns text as $$
+declare
+	plan jsonb;
+begin
+	/* Inner side might return different keys when run again */
+	plan = test.pathman_test('select * from test.runtime_test_2 t join generate_series(1, 2) g on t.category_id = g');
+	perform test.pathman_assert(plan::text not like '%Join Key Filter%',
+								'function scan should not filter join keys');
+
+	plan = test.pathman_test('select * from test.runtime_test_2 t join test.category tablesample bernoulli (50) c on t.category_id = c.id');
+	perform test.pathman_assert(plan::text not like '%Join Key Filter%',
+								'tablesample scan should not filter join keys');
+
+	plan = test.pathman_test('select * from test.runtime_test_2 t join (select id from test.category limit 2) c on t.category_id = c.id');
+	perform test.pathman_assert(plan::text not like '%Join Key Filter%',
+								'subquery scan should not filter join keys');
+
+	return 'ok';
+end;
+$$ language plpgsql
+set enable_hashjoin = on
+set enable_nestloop = off;
+
 
 
 create table test.run_values as select generate_series(1, 10000) val;
@@ -415,6 +510,71 @@ select test.pathman_test_2(); /* RuntimeAppend (select ... where id = any(subque
 select test.pathman_test_3(); /* RuntimeAppend (a join b on a.id = b.val) */
 select test.pathman_test_4(); /* RuntimeMergeAppend (lateral) */
 select test.pathman_test_5(); /* projection tests for RuntimeXXX nodes */
+select test.pathman_test_6(); /* RuntimeAppend (select ... where id = stable_func()) */
+select test.pathman_test_7(); /* RuntimeAppend (hash join filtered by inner keys) */
+select test.pathman_test_8(); /* no join key filter for unstable inner side */
+
+/* Join keys are collected again once correlated subquery is rescanned */
+set enable_hashjoin = on;
+select c.name, (select count(*) from test.runtime_test_2 t
+				join (select id from test.category where name = c.name offset 0) c2
+				on t.category_id = c2.id)
+from test.category c order by 1;
+set enable_hashjoin = off;
+
+/* Stable functions are evaluated by planner for custom plans */
+prepare q_stable(int) as select * from test.runtime_test_1 where id = test.stable_value($1);
+explain (costs off) execute q_stable(1);
+deallocate q_stable;
+
+/* Generic plans should lock only the partitions selected at runtime */
+set pg_pathman.enable_deferred_locks = on;
+prepare q_locks as select id from test.runtime_test_1 where id = test.stable_value(1) and val is not null;
+explain (costs off) execute q_locks;
+begin;
+execute q_locks;
+select relation::regclass::text as rel from pg_locks
+where pid = pg_backend_pid() and relation::regclass::text like 'test.runtime_test_1%'
+order by 1;
+commit;
+deallocate q_locks;
+set pg_pathman.enable_deferred_locks = off;
+
+/* Generic plan selects partitions at executor startup */
+prepare q_generic(int) as select id from test.runtime_test_1 where id = $1 and val is not null;
+execute q_generic(1);
+execute q_generic(1);
+execute q_generic(1);
+execute q_generic(1);
+execute q_generic(1);
+execute q_generic(1);
+explain (costs off) execute q_generic(1);
+deallocate q_generic;
+
+/* Rescans reuse partitions selected at startup */
+prepare q_rescan(int) as select sum((select count(*) + v.val from test.runtime_test_1 where id = $1)) from test.run_values v where val <= 3;
+execute q_rescan(1);
+execute q_rescan(1);
+execute q_rescan(1);
+execute q_rescan(1);
+execute q_rescan(1);
+execute q_rescan(1);
+select test.pathman_assert(test.pathman_test('execute q_rescan(1)')::text like '%"Custom Plan Provider": "RuntimeAppend"%',
+						   'generic plan should contain RuntimeAppend');
+deallocate q_rescan;
+
+/* Ordered RuntimeAppend scans partitions in descending order */
+select id from test.num_range_rel where id > (select 1000) order by id desc limit 3;
+select id from test.num_range_rel where id > (select 995) order by id limit 3 offset 3;
+
+/* min() and max() of the key scan partitions one by one */
+select min(id), max(id) from test.num_range_rel;
+
+/* GROUP BY partitioning key is performed partition by partition */
+select count(*) from (select id from test.num_range_rel group by id having count(*) = 1) s;
+
+/* Other aggregates are computed partially for each partition */
+select id % 3 as r, count(*), sum(id) from test.num_range_rel group by 1 order by 1;
 
 set pg_pathman.enable_runtimeappend = off;
 set pg_pathman.enable_runtimemergeappend = off;
@@ -487,6 +647,19 @@ SELECT pathman.prepend_range_partition('test.zero', 'test.zero_prepended');
 SELECT pathman.split_range_partition('test.zero_50', 60, 'test.zero_60');
 DROP TABLE test.zero CASCADE;
 
+/*
+ * Prefix pattern on a text key in C collation
+ */
+CREATE TABLE test.text_range_rel(
+	id		SERIAL PRIMARY KEY,
+	key		TEXT COLLATE "C" NOT NULL);
+SELECT pathman.create_range_partitions('test.text_range_rel', 'key', 'a'::TEXT, 'b'::TEXT, 0);
+SELECT pathman.add_range_partition('test.text_range_rel', 'a'::TEXT, 'm'::TEXT, 'test.text_range_rel_a');
+SELECT pathman.add_range_partition('test.text_range_rel', 'm'::TEXT, 't'::TEXT, 'test.text_range_rel_m');
+SELECT pathman.add_range_partition('test.text_range_rel', 't'::TEXT, 'z'::TEXT, 'test.text_range_rel_t');
+EXPLAIN (COSTS OFF) SELECT * FROM test.text_range_rel WHERE key LIKE 'obj%';
+DROP TABLE test.text_range_rel CASCADE;
+
 /*
  * Check that altering table columns doesn't break trigger
  */
@@ -665,3 +838,104 @@ SELECT create_hash_partitions('test_fkey', 'id', 10);
 INSERT INTO test_fkey VALUES(1, 'wrong');
 INSERT INTO test_fkey VALUES(1, 'test');
 SELECT drop_partitions('test_fkey');
+
+/* Test default partition */
+CREATE TABLE test.def_rel (
+	id	INT NOT NULL,
+	val	INT);
+SELECT pathman.create_range_partitions('test.def_rel', 'id', 1, 10, 3);
+SELECT pathman.create_default_partition('test.def_rel');
+INSERT INTO test.def_rel SELECT g, g FROM generate_series(1, 30) AS g;
+INSERT INTO test.def_rel VALUES (0, 0), (100, 100);
+SELECT COUNT(*) FROM ONLY test.def_rel_default;
+EXPLAIN (COSTS OFF) SELECT * FROM test.def_rel WHERE id = 15;
+EXPLAIN (COSTS OFF) SELECT * FROM test.def_rel WHERE id = 100;
+EXPLAIN (COSTS OFF) SELECT * FROM test.def_rel WHERE id >= 5 AND id < 15;
+EXPLAIN (COSTS OFF) SELECT * FROM test.def_rel WHERE id > 25;
+DROP TABLE test.def_rel_default;
+SELECT partrel, default_partition FROM pathman.pathman_config_params
+WHERE partrel = 'test.def_rel'::REGCLASS;
+DROP TABLE test.def_rel CASCADE;
+
+/* Test LIST partitioning */
+CREATE TABLE test.list_rel (
+	id	INT NOT NULL,
+	val	INT);
+INSERT INTO test.list_rel SELECT g % 3, g FROM generate_series(1, 30) AS g;
+SELECT pathman.create_list_partitions('test.list_rel', 'id', ARRAY[0, 1, 2]);
+SELECT COUNT(*) FROM ONLY test.list_rel;
+SELECT COUNT(*) FROM ONLY test.list_rel_2;
+EXPLAIN (COSTS OFF) SELECT * FROM test.list_rel WHERE id = 1;
+EXPLAIN (COSTS OFF) SELECT * FROM test.list_rel WHERE id IN (0, 2);
+SELECT pathman.add_list_partition('test.list_rel', ARRAY[3, 4]);
+SELECT pathman.add_list_partition('test.list_rel', ARRAY[4, 5]);
+EXPLAIN (COSTS OFF) SELECT * FROM test.list_rel WHERE id > 2;
+INSERT INTO test.list_rel VALUES (7, 7);
+SELECT pathman.create_default_partition('test.list_rel');
+INSERT INTO test.list_rel VALUES (7, 7);
+EXPLAIN (COSTS OFF) SELECT * FROM test.list_rel WHERE id = 7;
+DROP TABLE test.list_rel CASCADE;
+
+/* Test sub-partitioning (RANGE partition split by HASH) */
+CREATE TABLE test.sub_rel (
+	id		INT NOT NULL,
+	tenant	INT NOT NULL);
+SELECT pathman.create_range_partitions('test.sub_rel', 'id', 1, 10, 2);
+SELECT pathman.create_hash_partitions('test.sub_rel_1', 'tenant', 2);
+INSERT INTO test.sub_rel SELECT g, g % 4 FROM generate_series(1, 19) AS g;
+SELECT COUNT(*) FROM ONLY test.sub_rel_1;
+SELECT COUNT(*) FROM test.sub_rel_1_0;
+EXPLAIN (COSTS OFF) SELECT * FROM test.sub_rel WHERE id < 5 AND tenant = 1;
+EXPLAIN (COSTS OFF) SELECT * FROM test.sub_rel WHERE tenant = 1;
+EXPLAIN (COSTS OFF) DELETE FROM test.sub_rel WHERE id = 3 AND tenant = 1;
+DROP TABLE test.sub_rel CASCADE;
+
+/* Test multi-column HASH key */
+CREATE TABLE test.multi_rel (
+	tenant	INT NOT NULL,
+	region	INT NOT NULL,
+	val		INT);
+SELECT pathman.create_hash_partitions('test.multi_rel', 'tenant, region', 3);
+INSERT INTO test.multi_rel SELECT g % 5, g % 7, g FROM generate_series(1, 70) AS g;
+EXPLAIN (COSTS OFF) SELECT * FROM test.multi_rel WHERE tenant = 1 AND region = 2;
+EXPLAIN (COSTS OFF) SELECT * FROM test.multi_rel WHERE tenant = 1;
+SELECT COUNT(*) FROM test.multi_rel WHERE tenant = 1 AND region = 2;
+DROP TABLE test.multi_rel CASCADE;
+
+/* Test partitioning by expression */
+CREATE TABLE test.expr_rel (
+	id		INT NOT NULL,
+	ts		TIMESTAMP NOT NULL);
+INSERT INTO test.expr_rel SELECT g, '2015-01-01'::TIMESTAMP + g * '5 hours'::INTERVAL FROM generate_series(1, 10) AS g;
+SELECT pathman.create_range_partitions('test.expr_rel', 'date_trunc(''day'', ts)', '2015-01-01'::TIMESTAMP, '1 day'::INTERVAL, 3);
+SELECT COUNT(*) FROM test.expr_rel_2;
+EXPLAIN (COSTS OFF) SELECT * FROM test.expr_rel WHERE date_trunc('day', ts) = '2015-01-02';
+EXPLAIN (COSTS OFF) SELECT * FROM test.expr_rel WHERE ts = '2015-01-02 10:00';
+EXPLAIN (COSTS OFF) SELECT * FROM test.expr_rel WHERE ts >= '2015-01-02 10:00';
+SELECT pathman.set_monotonic_key('test.expr_rel');
+EXPLAIN (COSTS OFF) SELECT * FROM test.expr_rel WHERE ts >= '2015-01-02 10:00';
+INSERT INTO test.expr_rel VALUES (11, '2015-01-03 12:00');
+SELECT COUNT(*) FROM test.expr_rel_3;
+DROP TABLE test.expr_rel CASCADE;
+
+/* Test partition-wise join of equally partitioned tables */
+CREATE TABLE test.orders (
+	id			INT NOT NULL,
+	customer	INT NOT NULL);
+CREATE TABLE test.order_items (
+	order_id	INT NOT NULL,
+	customer	INT NOT NULL);
+SELECT pathman.create_hash_partitions('test.orders', 'customer', 3);
+SELECT pathman.create_hash_partitions('test.order_items', 'customer', 3);
+INSERT INTO test.orders SELECT g, g % 10 FROM generate_series(1, 100) AS g;
+INSERT INTO test.order_items SELECT id, customer FROM test.orders, generate_series(1, 2);
+SELECT COUNT(*) FROM test.orders o JOIN test.order_items i ON o.customer = i.customer;
+SELECT COUNT(*) FROM test.orders o JOIN test.order_items i ON o.customer = i.customer AND o.id = i.order_id;
+SELECT COUNT(*) FROM test.orders o JOIN test.order_items i ON o.customer = i.customer WHERE o.customer = 3;
+DROP TABLE test.orders CASCADE;
+DROP TABLE test.order_items CASCADE;
+
+SET client_min_messages = WARNING;
+DROP SCHEMA test CASCADE;
+DROP EXTENSION pg_pathman CASCADE;
+DROP SCHEMA pathman CASCADE;
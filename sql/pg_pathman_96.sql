@@ -0,0 +1,61 @@
+\set VERBOSITY terse
+
+CREATE SCHEMA pathman;
+CREATE EXTENSION pg_pathman SCHEMA pathman;
+CREATE SCHEMA test;
+
+/*
+ * Plans which require PostgreSQL 9.6+
+ */
+CREATE TABLE test.num_range_rel (
+	id	SERIAL PRIMARY KEY,
+	txt	TEXT);
+SELECT pathman.create_range_partitions('test.num_range_rel', 'id', 0, 1000, 4);
+INSERT INTO test.num_range_rel
+	SELECT g, md5(g::TEXT) FROM generate_series(1, 3000) as g;
+
+VACUUM ANALYZE;
+
+SET enable_indexscan = OFF;
+SET enable_bitmapscan = OFF;
+
+/* GROUP BY partitioning key is performed partition by partition */
+explain (costs off) select id, count(*) from test.num_range_rel where id < 1500 group by id;
+
+/* Other aggregates are computed partially for each partition */
+explain (costs off) select count(*) from test.num_range_rel where id < 1500;
+
+/* Partitions are scanned by parallel workers */
+set max_parallel_workers_per_gather = 2;
+set parallel_setup_cost = 0;
+set parallel_tuple_cost = 0;
+set min_parallel_relation_size = 0;
+explain (costs off) select * from test.num_range_rel where id < 1500;
+select count(*) from test.num_range_rel where id < 1500;
+reset max_parallel_workers_per_gather;
+reset parallel_setup_cost;
+reset parallel_tuple_cost;
+reset min_parallel_relation_size;
+
+/* Workers share partitions selected by RuntimeAppend at startup */
+create or replace function test.parallel_value(val int) returns int as $$
+begin
+	return val;
+end;
+$$ language plpgsql stable parallel safe;
+set max_parallel_workers_per_gather = 2;
+set parallel_setup_cost = 0;
+set parallel_tuple_cost = 0;
+prepare q_parallel as select id from test.num_range_rel where id > 1490 and id < test.parallel_value(1500);
+explain (costs off) execute q_parallel;
+execute q_parallel;
+deallocate q_parallel;
+reset max_parallel_workers_per_gather;
+reset parallel_setup_cost;
+reset parallel_tuple_cost;
+drop function test.parallel_value(int);
+
+SET client_min_messages = WARNING;
+DROP SCHEMA test CASCADE;
+DROP EXTENSION pg_pathman CASCADE;
+DROP SCHEMA pathman CASCADE;
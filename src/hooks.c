@@ -16,17 +16,41 @@
 #include "utils.h"
 #include "xact_handling.h"
 
+#include "executor/executor.h"
 #include "miscadmin.h"
+#include "optimizer/clauses.h"
 #include "optimizer/cost.h"
 #include "optimizer/restrictinfo.h"
+#include "utils/lsyscache.h"
+#include "utils/selfuncs.h"
 #include "utils/typcache.h"
 
+#include <math.h>
+
 
 set_join_pathlist_hook_type		set_join_pathlist_next = NULL;
 set_rel_pathlist_hook_type		set_rel_pathlist_hook_next = NULL;
 planner_hook_type				planner_hook_next = NULL;
 post_parse_analyze_hook_type	post_parse_analyze_hook_next = NULL;
 shmem_startup_hook_type			shmem_startup_hook_next = NULL;
+#if PG_VERSION_NUM >= 90600
+create_upper_paths_hook_type	create_upper_paths_hook_next = NULL;
+#endif
+
+
+static void add_join_key_filter_paths(PlannerInfo *root,
+									  RelOptInfo *joinrel,
+									  RelOptInfo *outerrel,
+									  RelOptInfo *innerrel,
+									  JoinType jointype,
+									  JoinPathExtraData *extra);
+static void add_runtime_append_paths(PlannerInfo *root,
+									 RelOptInfo *rel,
+									 Index rti,
+									 const PartRelationInfo *prel,
+									 double paramsel,
+									 PathKey *pathkeyAsc,
+									 PathKey *pathkeyDesc);
 
 
 /* Take care of joins */
@@ -48,19 +72,37 @@ pathman_join_pathlist_hook(PlannerInfo *root,
 	WalkerContext			context;
 	double					paramsel;
 	bool					innerrel_rinfo_contains_part_attr;
+#if PG_VERSION_NUM >= 90600
+	bool					partial_outer_allowed;
+#endif
 
 	/* Call hooks set by other extensions */
 	if (set_join_pathlist_next)
 		set_join_pathlist_next(root, joinrel, outerrel,
 							   innerrel, jointype, extra);
 
-	/* Check that both pg_pathman & RuntimeAppend nodes are enabled */
-	if (!IsPathmanReady() || !pg_pathman_enable_runtimeappend)
+	if (!IsPathmanReady())
+		return;
+
+#if PG_VERSION_NUM >= 90600
+	/* Join equally partitioned relations partition by partition */
+	if (pg_pathman_enable_partitionwise_join)
+		add_partitionwise_join_paths(root, joinrel, outerrel, innerrel,
+									 jointype, extra);
+#endif
+
+	/* Check that RuntimeAppend node is enabled */
+	if (!pg_pathman_enable_runtimeappend)
 		return;
 
 	if (jointype == JOIN_FULL)
 		return; /* handling full joins is meaningless */
 
+	/* Let partitioned outer relation skip partitions lacking join keys */
+	if (pg_pathman_enable_join_key_filter)
+		add_join_key_filter_paths(root, joinrel, outerrel, innerrel,
+								  jointype, extra);
+
 	/* Check that innerrel is a BASEREL with inheritors & PartRelationInfo */
 	if (innerrel->reloptkind != RELOPT_BASEREL || !inner_rte->inh ||
 		!(inner_prel = get_pathman_relation_info(inner_rte->relid)))
@@ -68,6 +110,12 @@ pathman_join_pathlist_hook(PlannerInfo *root,
 		return; /* Obviously not our case */
 	}
 
+#if PG_VERSION_NUM >= 90600
+	/* Outer rows of these can't be split between workers */
+	partial_outer_allowed = (jointype != JOIN_UNIQUE_OUTER &&
+							 jointype != JOIN_RIGHT);
+#endif
+
 	/*
 	 * These codes are used internally in the planner, but are not supported
 	 * by the executor (nor, indeed, by most of the planner).
@@ -176,6 +224,205 @@ pathman_join_pathlist_hook(PlannerInfo *root,
 
 		/* Finally we can add the new NestLoop path */
 		add_path(joinrel, (Path *) nest_path);
+
+#if PG_VERSION_NUM >= 90600
+		/*
+		 * Each worker may join its share of outer rows to RuntimeAppend,
+		 * which selects partitions using params computed by this worker.
+		 */
+		if (partial_outer_allowed && joinrel->consider_parallel &&
+			outerrel->partial_pathlist != NIL && inner->parallel_safe &&
+			bms_is_subset(PATH_REQ_OUTER(inner), outerrel->relids))
+		{
+			Path	   *partial_outer = linitial(outerrel->partial_pathlist);
+			NestPath   *partial_nest_path;
+
+			initial_cost_nestloop(root, &workspace, jointype,
+								  partial_outer, inner,
+								  extra->sjinfo, &extra->semifactors);
+
+			pathkeys = build_join_pathkeys(root, joinrel, jointype,
+										   partial_outer->pathkeys);
+
+			partial_nest_path = create_nestloop_path(root, joinrel, jointype,
+													 &workspace,
+													 extra->sjinfo,
+													 &extra->semifactors,
+													 partial_outer, inner,
+													 extra->restrictlist,
+													 pathkeys, NULL);
+
+			/* 'rows' of partial outer path are per-worker already */
+			partial_nest_path->path.rows =
+					get_parameterized_joinrel_size(root,
+												   joinrel,
+												   partial_outer->rows,
+												   inner->rows,
+												   extra->sjinfo,
+												   filtered_joinclauses);
+
+			add_partial_path(joinrel, (Path *) partial_nest_path);
+		}
+#endif
+	}
+}
+
+/*
+ * Build HashJoins whose outer side is RuntimeAppend filtered by the keys
+ * of inner side. Partitions which can't contain any of these keys are
+ * skipped entirely, e.g. when fact table is joined to a filtered dimension.
+ *
+ * Inner side is executed twice (keys are collected by a separate plan,
+ * since HashJoin doesn't expose its hash table), so it should be small
+ * and should return the same rows both times. The extra run is costed
+ * by create_runtimeappend_key_filter_path().
+ */
+static void
+add_join_key_filter_paths(PlannerInfo *root,
+						  RelOptInfo *joinrel,
+						  RelOptInfo *outerrel,
+						  RelOptInfo *innerrel,
+						  JoinType jointype,
+						  JoinPathExtraData *extra)
+{
+	RangeTblEntry		   *outer_rte,
+						   *inner_rte;
+	const PartRelationInfo *outer_prel;
+	TypeCacheEntry		   *tce;
+	Path				   *inner_path = innerrel->cheapest_total_path;
+	Var					   *key_var = NULL;
+	List				   *hashclauses = NIL,
+						   *inner_clauses;
+	double					nkeys,
+							sel;
+	ListCell			   *lc;
+
+	/* Outer rows lacking a match must not be skipped for other joins */
+	if (jointype != JOIN_INNER && jointype != JOIN_SEMI)
+		return;
+
+	/* Inner relation will be planned twice, keep it simple */
+	if (outerrel->reloptkind != RELOPT_BASEREL ||
+		innerrel->reloptkind != RELOPT_BASEREL ||
+		!inner_path || inner_path->param_info ||
+		IsA(inner_path, CustomPath))
+		return;
+
+	/*
+	 * Both runs of inner relation must return the same rows, so it should
+	 * be a plain table scan (not a function, subquery or TABLESAMPLE scan)
+	 * without volatile expressions.
+	 */
+	inner_rte = root->simple_rte_array[innerrel->relid];
+	if (inner_rte->rtekind != RTE_RELATION || inner_rte->tablesample)
+		return;
+
+	inner_clauses = get_actual_clauses(innerrel->baserestrictinfo);
+	if (clause_contains_exec_params((Node *) inner_clauses) ||
+		contain_volatile_functions((Node *) inner_clauses))
+		return;
+
+#if PG_VERSION_NUM >= 90600
+	if (contain_volatile_functions((Node *) innerrel->reltarget->exprs))
+		return;
+#else
+	if (contain_volatile_functions((Node *) innerrel->reltargetlist))
+		return;
+#endif
+
+	outer_rte = root->simple_rte_array[outerrel->relid];
+
+	/* Check that outerrel is a BASEREL with inheritors & PartRelationInfo */
+	if (!outer_rte->inh ||
+		!(outer_prel = get_pathman_relation_info(outer_rte->relid)))
+		return;
+
+	/* Keys are matched against a single column */
+	if (PrelHasKeyExpression(outer_prel) || PrelHasCompositeKey(outer_prel) ||
+		PrelChildrenCount(outer_prel) == 0)
+		return;
+
+	tce = lookup_type_cache(outer_prel->atttype, TYPECACHE_EQ_OPR);
+
+	/* Look for "OUTER_KEY = INNER_VAR" and hashable clauses */
+	foreach (lc, extra->restrictlist)
+	{
+		RestrictInfo   *rinfo = (RestrictInfo *) lfirst(lc);
+		OpExpr		   *expr = (OpExpr *) rinfo->clause;
+		Node		   *outer_arg,
+					   *inner_arg;
+		bool			outer_is_left;
+
+		if (!rinfo->can_join || !OidIsValid(rinfo->hashjoinoperator))
+			continue;
+
+		/* RestrictInfo is shared by other paths, don't modify it */
+		if (bms_is_subset(rinfo->left_relids, outerrel->relids) &&
+			bms_is_subset(rinfo->right_relids, innerrel->relids))
+			outer_is_left = true;
+		else if (bms_is_subset(rinfo->left_relids, innerrel->relids) &&
+				 bms_is_subset(rinfo->right_relids, outerrel->relids))
+			outer_is_left = false;
+		else
+			continue;
+
+		hashclauses = lappend(hashclauses, rinfo);
+
+		if (key_var || !IsA(expr, OpExpr) || expr->opno != tce->eq_opr)
+			continue;
+
+		outer_arg = get_leftop(rinfo->clause);
+		inner_arg = get_rightop(rinfo->clause);
+		if (!outer_is_left)
+		{
+			Node *tmp = outer_arg;
+
+			outer_arg = inner_arg;
+			inner_arg = tmp;
+		}
+
+		/* Both sides should be plain columns of the key's type */
+		if (IsA(outer_arg, Var) && IsA(inner_arg, Var) &&
+			((Var *) outer_arg)->varattno == outer_prel->attnum &&
+			((Var *) inner_arg)->vartype == outer_prel->atttype)
+			key_var = (Var *) inner_arg;
+	}
+
+	if (!key_var)
+		return;
+
+	/* Keys have to fit into work_mem just like a hash table */
+	if (innerrel->rows * get_typavgwidth(key_var->vartype, key_var->vartypmod) >
+			work_mem * 1024.0)
+		return;
+
+	/* Expected fraction of partitions containing at least one key */
+	nkeys = estimate_num_groups(root, list_make1(key_var), innerrel->rows, NULL);
+	sel = 1.0 - pow(1.0 - 1.0 / PrelChildrenCount(outer_prel), nkeys);
+
+	foreach (lc, outerrel->pathlist)
+	{
+		AppendPath		   *cur_outer_path = (AppendPath *) lfirst(lc);
+		Path			   *outer;
+		JoinCostWorkspace	workspace;
+
+		if (!IsA(cur_outer_path, AppendPath) || cur_outer_path->path.param_info)
+			continue;
+
+		outer = create_runtimeappend_key_filter_path(root, cur_outer_path,
+													 inner_path, key_var, sel);
+
+		initial_cost_hashjoin(root, &workspace, jointype, hashclauses,
+							  outer, inner_path,
+							  extra->sjinfo, &extra->semifactors);
+
+		add_path(joinrel,
+				 (Path *) create_hashjoin_path(root, joinrel, jointype,
+											   &workspace,
+											   extra->sjinfo, &extra->semifactors,
+											   outer, inner_path,
+											   extra->restrictlist, NULL,
+											   hashclauses));
 	}
 }
 
@@ -184,9 +431,6 @@ void
 pathman_rel_pathlist_hook(PlannerInfo *root, RelOptInfo *rel, Index rti, RangeTblEntry *rte)
 {
 	const PartRelationInfo *prel;
-	RangeTblEntry		  **new_rte_array;
-	RelOptInfo			  **new_rel_array;
-	int						len;
 
 	/* Invoke original hook if needed */
 	if (set_rel_pathlist_hook_next != NULL)
@@ -202,176 +446,379 @@ pathman_rel_pathlist_hook(PlannerInfo *root, RelOptInfo *rel, Index rti, RangeTb
 
 	/* Proceed iff relation 'rel' is partitioned */
 	if ((prel = get_pathman_relation_info(rte->relid)) != NULL)
+		set_partitioned_rel_pathlist(root, rel, rti, rte, prel);
+}
+
+#if PG_VERSION_NUM >= 90600
+/*
+ * Add partition-wise aggregation paths (see add_partitionwise_agg_paths()).
+ */
+void
+pathman_upper_paths_hook(PlannerInfo *root, UpperRelationKind stage,
+						 RelOptInfo *input_rel, RelOptInfo *output_rel)
+{
+	const PartRelationInfo *prel;
+	RangeTblEntry		   *rte;
+
+	/* Invoke original hook if needed */
+	if (create_upper_paths_hook_next != NULL)
+		create_upper_paths_hook_next(root, stage, input_rel, output_rel);
+
+	if (!IsPathmanReady() || !pg_pathman_enable_partitionwise_agg)
+		return;
+
+	/* Only plain aggregation of a single partitioned relation is supported */
+	if (stage != UPPERREL_GROUP_AGG ||
+		input_rel->reloptkind != RELOPT_BASEREL ||
+		(root->parse->groupClause == NIL && !root->parse->hasAggs) ||
+		root->parse->groupingSets != NIL)
+		return;
+
+	rte = root->simple_rte_array[input_rel->relid];
+
+	/* Partitions have been expanded by set_partitioned_rel_pathlist() */
+	if (!rte->inh || !list_member_oid(inheritance_enabled_relids, rte->relid))
+		return;
+
+	if ((prel = get_pathman_relation_info(rte->relid)) != NULL)
+		add_partitionwise_agg_paths(root, input_rel, output_rel, prel);
+}
+#endif
+
+/*
+ * Add Runtime[Merge]Append paths to partitioned relation 'rel'.
+ * Partial paths are gathered by set_partitioned_rel_pathlist().
+ */
+static void
+add_runtime_append_paths(PlannerInfo *root, RelOptInfo *rel, Index rti,
+						 const PartRelationInfo *prel, double paramsel,
+						 PathKey *pathkeyAsc, PathKey *pathkeyDesc)
+{
+	ListCell	   *lc;
+	bool			rel_rinfo_contains_part_attr = false;
+
+	/* No need to go further (both nodes are disabled), return */
+	if (!(pg_pathman_enable_runtimeappend ||
+		  pg_pathman_enable_runtime_merge_append))
+		return;
+
+	/* Runtime[Merge]Append is built for the topmost parent only */
+	if (rel->reloptkind != RELOPT_BASEREL)
+		return;
+
+	/* Runtime[Merge]Append can't select sub-partitions, give up */
+	foreach (lc, root->append_rel_list)
+	{
+		AppendRelInfo *appinfo = (AppendRelInfo *) lfirst(lc);
+
+		/* Sub-partitioned children have 'inh' flag set */
+		if (appinfo->parent_relid == rti &&
+			root->simple_rte_array[appinfo->child_relid]->inh)
+			return;
+	}
+
+	/*
+	 * Queries like "SELECT max(key) FROM rel" (see planagg.c) need only the
+	 * first rows of an ordered scan. Unlike plain Append, RuntimeAppend
+	 * starts partitions one by one and stops at the LIMIT, which makes it
+	 * cheaper than ordered Appends initializing (and locking) every partition.
+	 */
+	if (pg_pathman_enable_runtimeappend &&
+		root->limit_tuples > 0 && root->query_pathkeys != NIL &&
+		(pathkeyAsc || pathkeyDesc))
 	{
-		ListCell	   *lc;
-		Oid			   *children;
-		List		   *ranges,
-					   *wrappers;
-		PathKey		   *pathkeyAsc = NULL,
-					   *pathkeyDesc = NULL;
-		double			paramsel = 1.0;
-		WalkerContext	context;
-		int				i;
-		bool			rel_rinfo_contains_part_attr = false;
-
-		if (prel->parttype == PT_RANGE)
+		List *bounded_paths = NIL;
+
+		foreach (lc, rel->pathlist)
 		{
-			/*
-			 * Get pathkeys for ascending and descending sort by partition
-			 * column
-			 */
-			List		   *pathkeys;
-			Var			   *var;
-			Oid				vartypeid,
-							varcollid;
-			int32			type_mod;
-			TypeCacheEntry *tce;
-
-			/* Make Var from patition column */
-			get_rte_attribute_type(rte, prel->attnum,
-								   &vartypeid, &type_mod, &varcollid);
-			var = makeVar(rti, prel->attnum, vartypeid, type_mod, varcollid, 0);
-			var->location = -1;
-
-			/* Determine operator type */
-			tce = lookup_type_cache(var->vartype, TYPECACHE_LT_OPR | TYPECACHE_GT_OPR);
-
-			/* Make pathkeys */
-			pathkeys = build_expression_pathkey(root, (Expr *)var, NULL,
-												tce->lt_opr, NULL, false);
-			if (pathkeys)
-				pathkeyAsc = (PathKey *) linitial(pathkeys);
-			pathkeys = build_expression_pathkey(root, (Expr *)var, NULL,
-												tce->gt_opr, NULL, false);
-			if (pathkeys)
-				pathkeyDesc = (PathKey *) linitial(pathkeys);
+			Path   *cur_path = (Path *) lfirst(lc);
+			Path   *inner_path;
+
+			if (!IsA(cur_path, AppendPath) || cur_path->param_info ||
+				!pathkeys_contained_in(root->query_pathkeys, cur_path->pathkeys))
+				continue;
+
+			inner_path = create_runtimeappend_path(root, (AppendPath *) cur_path,
+												   NULL, paramsel);
+
+			/* Only if the LIMIT applies to RuntimeAppend */
+			if (((RuntimeAppendPath *) inner_path)->tuple_bound > 0)
+				bounded_paths = lappend(bounded_paths, inner_path);
 		}
 
-		rte->inh = true; /* we must restore 'inh' flag! */
+		/* add_path() might modify rel->pathlist, so do it here */
+		foreach (lc, bounded_paths)
+			add_path(rel, (Path *) lfirst(lc));
+	}
+
+	/*
+	 * Runtime[Merge]Append is pointless if there are neither params nor
+	 * stable expressions (unless they've been evaluated above) in clauses
+	 */
+	if (!clause_contains_params((Node *) get_actual_clauses(rel->baserestrictinfo)) &&
+		(root->glob->boundParams != NULL ||
+		 !contain_mutable_functions((Node *) get_actual_clauses(rel->baserestrictinfo))))
+		return;
 
-		children = PrelGetChildrenArray(prel);
-		ranges = list_make1_irange(make_irange(0, PrelLastChild(prel), false));
+	/* Check that rel's RestrictInfo contains partitioned column */
+	rel_rinfo_contains_part_attr =
+		get_partitioned_attr_clauses(rel->baserestrictinfo,
+									 prel, rel->relid) != NULL;
 
-		/* Make wrappers over restrictions and collect final rangeset */
-		InitWalkerContext(&context, prel, NULL, false);
-		wrappers = NIL;
-		foreach(lc, rel->baserestrictinfo)
+	foreach (lc, rel->pathlist)
+	{
+		AppendPath	   *cur_path = (AppendPath *) lfirst(lc);
+		Relids			inner_required = PATH_REQ_OUTER((Path *) cur_path);
+		ParamPathInfo  *ppi = get_appendrel_parampathinfo(rel, inner_required);
+		Path		   *inner_path = NULL;
+
+		/* Skip if rel contains some join-related stuff or path type mismatched */
+		if (!(IsA(cur_path, AppendPath) || IsA(cur_path, MergeAppendPath)) ||
+			rel->has_eclass_joins || rel->joininfo)
 		{
-			WrapperNode	   *wrap;
-			RestrictInfo   *rinfo = (RestrictInfo *) lfirst(lc);
+			continue;
+		}
+
+		/*
+		 * Skip if neither rel->baserestrictinfo nor
+		 * ppi->ppi_clauses reference partition attribute
+		 */
+		if (!(rel_rinfo_contains_part_attr ||
+			  (ppi && get_partitioned_attr_clauses(ppi->ppi_clauses,
+												   prel, rel->relid))))
+			continue;
+
+		if (IsA(cur_path, AppendPath) && pg_pathman_enable_runtimeappend)
+			inner_path = create_runtimeappend_path(root, cur_path,
+												   ppi, paramsel);
+		else if (IsA(cur_path, MergeAppendPath) &&
+				 pg_pathman_enable_runtime_merge_append)
+			inner_path = create_runtimemergeappend_path(root, cur_path,
+														ppi, paramsel);
+
+		if (inner_path)
+			add_path(rel, inner_path);
 
-			wrap = walk_expr_tree(rinfo->clause, &context);
+#if PG_VERSION_NUM >= 90600
+		/*
+		 * Let parallel workers share partitions selected at startup.
+		 * Clauses of such rel contain no params (workers can't get
+		 * them), thus partitions are selected before any scan.
+		 */
+		if (IsA(cur_path, AppendPath) && pg_pathman_enable_runtimeappend &&
+			rel->consider_parallel && !ppi)
+		{
+			Path *partial_path = create_parallel_runtimeappend_path(root,
+																	cur_path,
+																	paramsel);
 
-			paramsel *= wrap->paramsel;
-			wrappers = lappend(wrappers, wrap);
-			ranges = irange_list_intersect(ranges, wrap->rangeset);
+			if (partial_path)
+				add_partial_path(rel, partial_path);
 		}
+#endif
+	}
+}
 
+/*
+ * Expand partitioned relation 'rel' and build its paths. Partitions
+ * that are partitioned as well are expanded recursively (see
+ * set_append_rel_pathlist()), so 'rel' might be an "other member" rel.
+ */
+void
+set_partitioned_rel_pathlist(PlannerInfo *root, RelOptInfo *rel, Index rti,
+							 RangeTblEntry *rte, const PartRelationInfo *prel)
+{
+	RangeTblEntry **new_rte_array;
+	RelOptInfo	  **new_rel_array;
+	int				len;
+	ListCell	   *lc;
+	Oid			   *children;
+	RangeSet	   *ranges;
+	List		   *wrappers;
+	PathKey		   *pathkeyAsc = NULL,
+				   *pathkeyDesc = NULL;
+	double			paramsel = 1.0;
+	int				uncovered = UNCOVERED_ALL;
+	bool			include_default;
+	WalkerContext	context;
+	int				i;
+	uint32			j;
+
+	/* Partitions are sorted by column only if key expression is monotonic */
+	if (prel->parttype == PT_RANGE &&
+		(!PrelHasKeyExpression(prel) || prel->monotonic_key))
+	{
 		/*
-		 * Expand simple_rte_array and simple_rel_array
+		 * Get pathkeys for ascending and descending sort by partition
+		 * column
 		 */
-		len = irange_list_length(ranges);
-		if (prel->enable_parent)
-			len++;
+		List		   *pathkeys;
+		Var			   *var;
+		Oid				vartypeid,
+						varcollid;
+		int32			type_mod;
+		TypeCacheEntry *tce;
+
+		/* Make Var from patition column */
+		get_rte_attribute_type(rte, prel->attnum,
+							   &vartypeid, &type_mod, &varcollid);
+		var = makeVar(rti, prel->attnum, vartypeid, type_mod, varcollid, 0);
+		var->location = -1;
+
+		/* Determine operator type */
+		tce = lookup_type_cache(var->vartype, TYPECACHE_LT_OPR | TYPECACHE_GT_OPR);
+
+		/* Make pathkeys */
+		pathkeys = build_expression_pathkey(root, (Expr *)var, NULL,
+											tce->lt_opr, NULL, false);
+		if (pathkeys)
+			pathkeyAsc = (PathKey *) linitial(pathkeys);
+		pathkeys = build_expression_pathkey(root, (Expr *)var, NULL,
+											tce->gt_opr, NULL, false);
+		if (pathkeys)
+			pathkeyDesc = (PathKey *) linitial(pathkeys);
+	}
 
-		if (len > 0)
-		{
-			/* Expand simple_rel_array and simple_rte_array */
-			new_rel_array = (RelOptInfo **)
-				palloc0((root->simple_rel_array_size + len) * sizeof(RelOptInfo *));
+	rte->inh = true; /* we must restore 'inh' flag! */
 
-			/* simple_rte_array is an array equivalent of the rtable list */
-			new_rte_array = (RangeTblEntry **)
-				palloc0((root->simple_rel_array_size + len) * sizeof(RangeTblEntry *));
+	children = PrelGetChildrenArray(prel);
+	ranges = rangeset_make1(make_irange(0, PrelLastChild(prel), false));
 
-			/* Copy relations to the new arrays */
-			for (i = 0; i < root->simple_rel_array_size; i++)
-			{
-				new_rel_array[i] = root->simple_rel_array[i];
-				new_rte_array[i] = root->simple_rte_array[i];
-			}
+	/* Make wrappers over restrictions and collect final rangeset */
+	InitWalkerContext(&context, prel, NULL, false);
 
-			/* Free old arrays */
-			pfree(root->simple_rel_array);
-			pfree(root->simple_rte_array);
+	/*
+	 * Custom plans (built for the given param values) are never reused,
+	 * thus stable expressions (e.g. now()) may be evaluated right here.
+	 */
+	if (root->glob->boundParams != NULL)
+	{
+		context.econtext = CreateStandaloneExprContext();
+		context.planning = true;
+	}
 
-			root->simple_rel_array_size += len;
-			root->simple_rel_array = new_rel_array;
-			root->simple_rte_array = new_rte_array;
-		}
+	wrappers = NIL;
+	if (rel->baserestrictinfo != NIL)
+	{
+		WrapperNode	   *wrap;
+		List		   *clauses = NIL;
 
-		/* Add parent if needed */
-		if (prel->enable_parent)
-			append_child_relation(root, rel, rti, rte, 0, rte->relid, NULL);
+		foreach(lc, rel->baserestrictinfo)
+			clauses = lappend(clauses, ((RestrictInfo *) lfirst(lc))->clause);
 
 		/*
-		 * Iterate all indexes in rangeset and append corresponding child
-		 * relations.
+		 * Restrictions are walked as a single AND, so that bounds like
+		 * "key >= A" and "key < B" could be handled at once. Wrappers
+		 * of the individual restrictions are stored in 'wrap->args'.
 		 */
-		foreach(lc, ranges)
-		{
-			IndexRange	irange = lfirst_irange(lc);
+		wrap = walk_expr_tree(makeBoolExpr(AND_EXPR, clauses, -1), &context);
 
-			for (i = irange.ir_lower; i <= irange.ir_upper; i++)
-				append_child_relation(root, rel, rti, rte, i, children[i], wrappers);
-		}
+		paramsel = wrap->paramsel;
+		uncovered = wrap->uncovered;
+		wrappers = wrap->args;
+		ranges = rangeset_intersect(ranges, wrap->rangeset);
+	}
 
-		/* Clear old path list */
-		list_free(rel->pathlist);
+	if (context.econtext)
+		FreeExprContext(context.econtext, true);
 
-		rel->pathlist = NIL;
-		set_append_rel_pathlist(root, rel, rti, rte, pathkeyAsc, pathkeyDesc);
-		set_append_rel_size(root, rel, rti, rte);
+	/* Composite HASH key is handled by all clauses at once */
+	if (PrelHasCompositeKey(prel))
+		ranges = rangeset_intersect(ranges,
+									select_composite_hash_partitions(prel, rti,
+																	 rel->baserestrictinfo));
 
-		/* No need to go further (both nodes are disabled), return */
-		if (!(pg_pathman_enable_runtimeappend ||
-			  pg_pathman_enable_runtime_merge_append))
-			return;
+	/* Scan default partition iff some values might be stored there */
+	include_default = PrelHasDefaultPart(prel) && uncovered != UNCOVERED_NONE;
 
-		/* Runtime[Merge]Append is pointless if there are no params in clauses */
-		if (!clause_contains_params((Node *) get_actual_clauses(rel->baserestrictinfo)))
-			return;
+	/*
+	 * Expand simple_rte_array and simple_rel_array
+	 */
+	len = rangeset_length(ranges);
+	if (prel->enable_parent)
+		len++;
+	if (include_default)
+		len++;
+
+	if (len > 0)
+	{
+		/* Expand simple_rel_array and simple_rte_array */
+		new_rel_array = (RelOptInfo **)
+			palloc0((root->simple_rel_array_size + len) * sizeof(RelOptInfo *));
 
-		/* Check that rel's RestrictInfo contains partitioned column */
-		rel_rinfo_contains_part_attr =
-			get_partitioned_attr_clauses(rel->baserestrictinfo,
-										 prel, rel->relid) != NULL;
+		/* simple_rte_array is an array equivalent of the rtable list */
+		new_rte_array = (RangeTblEntry **)
+			palloc0((root->simple_rel_array_size + len) * sizeof(RangeTblEntry *));
 
-		foreach (lc, rel->pathlist)
+		/* Copy relations to the new arrays */
+		for (i = 0; i < root->simple_rel_array_size; i++)
 		{
-			AppendPath	   *cur_path = (AppendPath *) lfirst(lc);
-			Relids			inner_required = PATH_REQ_OUTER((Path *) cur_path);
-			ParamPathInfo  *ppi = get_appendrel_parampathinfo(rel, inner_required);
-			Path		   *inner_path = NULL;
-
-			/* Skip if rel contains some join-related stuff or path type mismatched */
-			if (!(IsA(cur_path, AppendPath) || IsA(cur_path, MergeAppendPath)) ||
-				rel->has_eclass_joins || rel->joininfo)
-			{
-				continue;
-			}
+			new_rel_array[i] = root->simple_rel_array[i];
+			new_rte_array[i] = root->simple_rte_array[i];
+		}
 
-			/*
-			 * Skip if neither rel->baserestrictinfo nor
-			 * ppi->ppi_clauses reference partition attribute
-			 */
-			if (!(rel_rinfo_contains_part_attr ||
-				  (ppi && get_partitioned_attr_clauses(ppi->ppi_clauses,
-													   prel, rel->relid))))
-				continue;
+		/* Free old arrays */
+		pfree(root->simple_rel_array);
+		pfree(root->simple_rte_array);
 
-			if (IsA(cur_path, AppendPath) && pg_pathman_enable_runtimeappend)
-				inner_path = create_runtimeappend_path(root, cur_path,
-													   ppi, paramsel);
-			else if (IsA(cur_path, MergeAppendPath) &&
-					 pg_pathman_enable_runtime_merge_append)
-				inner_path = create_runtimemergeappend_path(root, cur_path,
-															ppi, paramsel);
+		root->simple_rel_array_size += len;
+		root->simple_rel_array = new_rel_array;
+		root->simple_rte_array = new_rte_array;
+	}
 
-			if (inner_path)
-				add_path(rel, inner_path);
-		}
+	/* Add parent if needed */
+	if (prel->enable_parent)
+	{
+		append_child_relation(root, rel, rti, rte, 0, rte->relid, NULL);
+
+		/* Its rows are not ordered with respect to partitions */
+		pathkeyAsc = pathkeyDesc = NULL;
+	}
+
+	/*
+	 * Iterate all indexes in rangeset and append corresponding child
+	 * relations.
+	 */
+	for (j = 0; j < rangeset_nranges(ranges); j++)
+	{
+		IndexRange	irange = rangeset_get(ranges, j);
+
+		for (i = irange.ir_lower; i <= irange.ir_upper; i++)
+			append_child_relation(root, rel, rti, rte, i, children[i], wrappers);
+	}
+
+	/* Add default partition if needed */
+	if (include_default)
+	{
+		append_child_relation(root, rel, rti, rte, 0, prel->default_part, NIL);
+
+		/* Its rows are not ordered with respect to other partitions */
+		pathkeyAsc = pathkeyDesc = NULL;
 	}
+
+	/* Clear old path list */
+	list_free(rel->pathlist);
+
+	rel->pathlist = NIL;
+#if PG_VERSION_NUM >= 90600
+	/* Parallel scan of the parent alone is useless as well */
+	rel->partial_pathlist = NIL;
+#endif
+	set_append_rel_pathlist(root, rel, rti, rte, pathkeyAsc, pathkeyDesc);
+	set_append_rel_size(root, rel, rti, rte);
+
+	/* Consider Runtime[Merge]Append in addition to plain Append */
+	add_runtime_append_paths(root, rel, rti, prel, paramsel,
+							 pathkeyAsc, pathkeyDesc);
+
+#if PG_VERSION_NUM >= 90600
+	/*
+	 * set_rel_pathlist() has gathered partial paths before calling us,
+	 * so we have to gather partial paths of partitions ourselves.
+	 */
+	if (rel->reloptkind == RELOPT_BASEREL)
+		generate_gather_paths(root, rel);
+#endif
 }
 
 /*
@@ -452,6 +899,13 @@ pathman_planner_hook(Query *parse, int cursorOptions, ParamListInfo boundParams)
 
 		/* Add PartitionFilter node for INSERT queries */
 		ExecuteForPlanTree(result, add_partition_filters);
+
+		/* Let RuntimeAppend lock partitions (plain SELECT only) */
+		if (pg_pathman_enable_deferred_locks &&
+			result->commandType == CMD_SELECT &&
+			result->rowMarks == NIL &&
+			!result->hasModifyingCTE)
+			ExecuteForPlanTree(result, defer_partition_locks);
 	}
 
 	list_free(inheritance_disabled_relids);
@@ -11,6 +11,8 @@
 #ifndef JOIN_HOOK_H
 #define JOIN_HOOK_H
 
+#include "relation_info.h"
+
 #include "postgres.h"
 #include "optimizer/planner.h"
 #include "optimizer/paths.h"
@@ -23,6 +25,9 @@ extern set_rel_pathlist_hook_type		set_rel_pathlist_hook_next;
 extern planner_hook_type				planner_hook_next;
 extern post_parse_analyze_hook_type		post_parse_analyze_hook_next;
 extern shmem_startup_hook_type			shmem_startup_hook_next;
+#if PG_VERSION_NUM >= 90600
+extern create_upper_paths_hook_type		create_upper_paths_hook_next;
+#endif
 
 
 void pathman_join_pathlist_hook(PlannerInfo *root,
@@ -37,6 +42,19 @@ void pathman_rel_pathlist_hook(PlannerInfo *root,
 							   Index rti,
 							   RangeTblEntry *rte);
 
+#if PG_VERSION_NUM >= 90600
+void pathman_upper_paths_hook(PlannerInfo *root,
+							  UpperRelationKind stage,
+							  RelOptInfo *input_rel,
+							  RelOptInfo *output_rel);
+#endif
+
+void set_partitioned_rel_pathlist(PlannerInfo *root,
+								  RelOptInfo *rel,
+								  Index rti,
+								  RangeTblEntry *rte,
+								  const PartRelationInfo *prel);
+
 void pg_pathman_enable_assign_hook(char newval, void *extra);
 
 PlannedStmt * pathman_planner_hook(Query *parse,
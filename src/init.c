@@ -27,6 +27,8 @@
 #include "catalog/pg_type.h"
 #include "miscadmin.h"
 #include "optimizer/clauses.h"
+#include "parser/parse_coerce.h"
+#include "utils/array.h"
 #include "utils/datum.h"
 #include "utils/inval.h"
 #include "utils/builtins.h"
@@ -68,6 +70,7 @@ static void read_pathman_config(void);
 static Expr *get_partition_constraint_expr(Oid partition, AttrNumber part_attno);
 
 static int cmp_range_entries(const void *p1, const void *p2, void *arg);
+static int cmp_list_entries(const void *p1, const void *p2, void *arg);
 
 static bool validate_range_constraint(const Expr *expr,
 									  const PartRelationInfo *prel,
@@ -78,6 +81,19 @@ static bool validate_hash_constraint(const Expr *expr,
 									 const PartRelationInfo *prel,
 									 uint32 *part_hash);
 
+static bool validate_hash_key_expr(const Node *expr,
+								   const PartRelationInfo *prel,
+								   int natts);
+
+static bool validate_hash_column_expr(const Node *expr,
+									  const PartRelationInfo *prel,
+									  int col_idx);
+
+static bool validate_list_constraint(const Expr *expr,
+									 const PartRelationInfo *prel,
+									 Datum **values,
+									 uint32 *nvalues);
+
 static bool read_opexpr_const(const OpExpr *opexpr,
 							  const PartRelationInfo *prel,
 							  Datum *val);
@@ -129,6 +145,28 @@ init_main_pathman_toggle(void)
 							 NULL,
 							 NULL,
 							 NULL);
+
+	DefineCustomBoolVariable("pg_pathman.enable_partitionwise_aggregate",
+							 "Enables GROUP BY performed partition by partition",
+							 NULL,
+							 &pg_pathman_enable_partitionwise_agg,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("pg_pathman.enable_partitionwise_join",
+							 "Enables joins of equally partitioned tables performed partition by partition",
+							 NULL,
+							 &pg_pathman_enable_partitionwise_join,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
 }
 
 /*
@@ -278,6 +316,8 @@ fini_local_cache(void)
 		{
 			FreeChildrenArray(prel);
 			FreeRangesArray(prel);
+			FreeListArray(prel);
+			FreeKeyExpression(prel);
 		}
 	}
 
@@ -327,11 +367,17 @@ fill_prel_with_partitions(const Oid *partitions,
 	Expr		   *con_expr;
 	MemoryContext	mcxt = TopMemoryContext;
 
+	/* Temporary storage for LIST values (sorted later) */
+	ListEntry	   *list_entries = NULL;
+	uint32			list_count = 0,
+					list_allocated = 0;
+
 	/* Allocate memory for 'prel->children' & 'prel->ranges' (if needed) */
 	prel->children = MemoryContextAllocZero(mcxt, parts_count * sizeof(Oid));
 	if (prel->parttype == PT_RANGE)
 		prel->ranges = MemoryContextAllocZero(mcxt, parts_count * sizeof(RangeEntry));
 	prel->children_count = parts_count;
+	prel->has_gaps = false;
 
 	for (i = 0; i < PrelChildrenCount(prel); i++)
 	{
@@ -379,6 +425,49 @@ fill_prel_with_partitions(const Oid *partitions,
 				}
 				break;
 
+			case PT_LIST:
+				{
+					Datum  *values;
+					uint32	nvalues,
+							j;
+
+					if (validate_list_constraint(con_expr, prel,
+												 &values, &nvalues))
+					{
+						prel->children[i] = partitions[i];
+
+						/* Enlarge temporary storage if needed */
+						if (list_count + nvalues > list_allocated)
+						{
+							list_allocated = Max(list_allocated * 2,
+												 list_count + nvalues);
+
+							list_entries = list_entries ?
+									repalloc(list_entries,
+											 list_allocated * sizeof(ListEntry)) :
+									palloc(list_allocated * sizeof(ListEntry));
+						}
+
+						for (j = 0; j < nvalues; j++)
+						{
+							list_entries[list_count].value		= values[j];
+							list_entries[list_count].child_idx	= i;
+							list_count++;
+						}
+
+						pfree(values);
+					}
+					else
+					{
+						DisablePathman(); /* disable pg_pathman since config is broken */
+						ereport(ERROR,
+								(errmsg("Wrong constraint format for LIST partition \"%s\"",
+										get_rel_name_or_relid(partitions[i])),
+								 errhint(INIT_ERROR_HINT)));
+					}
+				}
+				break;
+
 			default:
 			{
 				DisablePathman(); /* disable pg_pathman since config is broken */
@@ -398,7 +487,7 @@ fill_prel_with_partitions(const Oid *partitions,
 		/* Sort partitions by RangeEntry->min asc */
 		qsort_arg((void *) prel->ranges, PrelChildrenCount(prel),
 				  sizeof(RangeEntry), cmp_range_entries,
-				  (void *) &prel->cmp_proc);
+				  (void *) prel);
 
 		/* Initialize 'prel->children' array */
 		for (i = 0; i < PrelChildrenCount(prel); i++)
@@ -418,6 +507,60 @@ fill_prel_with_partitions(const Oid *partitions,
 		}
 		MemoryContextSwitchTo(old_mcxt);
 
+		/* Check if there are any gaps between neighboring ranges */
+		for (i = 1; i < PrelChildrenCount(prel); i++)
+		{
+			if (DatumGetInt32(OidFunctionCall2Coll(prel->cmp_proc,
+												   prel->attcollid,
+												   prel->ranges[i - 1].max,
+												   prel->ranges[i].min)) != 0)
+			{
+				prel->has_gaps = true;
+				break;
+			}
+		}
+	}
+
+	/* Finalize 'prel' for a LIST-partitioned table */
+	if (prel->parttype == PT_LIST)
+	{
+		MemoryContext	old_mcxt;
+
+		/* Sort entries by ListEntry->value asc */
+		qsort_arg((void *) list_entries, list_count,
+				  sizeof(ListEntry), cmp_list_entries,
+				  (void *) &prel->cmp_proc);
+
+		/* Each value should belong to exactly one partition */
+		for (i = 1; i < list_count; i++)
+		{
+			if (cmp_list_entries(&list_entries[i - 1], &list_entries[i],
+								 (void *) &prel->cmp_proc) == 0)
+			{
+				DisablePathman(); /* disable pg_pathman since config is broken */
+				ereport(ERROR,
+						(errmsg("Value %s belongs to several LIST partitions of \"%s\"",
+								datum_to_cstring(list_entries[i].value,
+												 prel->atttype),
+								get_rel_name_or_relid(PrelParentRelid(prel))),
+						 errhint(INIT_ERROR_HINT)));
+			}
+		}
+
+		/* Copy all values to the persistent mcxt */
+		old_mcxt = MemoryContextSwitchTo(TopMemoryContext);
+		prel->list_entries = palloc(list_count * sizeof(ListEntry));
+		for (i = 0; i < list_count; i++)
+		{
+			prel->list_entries[i].value = datumCopy(list_entries[i].value,
+													prel->attbyval,
+													prel->attlen);
+			prel->list_entries[i].child_idx = list_entries[i].child_idx;
+		}
+		MemoryContextSwitchTo(old_mcxt);
+
+		prel->list_entries_count = list_count;
+		pfree(list_entries);
 	}
 
 #ifdef USE_ASSERT_CHECKING
@@ -797,9 +940,10 @@ cmp_range_entries(const void *p1, const void *p2, void *arg)
 	const RangeEntry   *v1 = (const RangeEntry *) p1;
 	const RangeEntry   *v2 = (const RangeEntry *) p2;
 
-	Oid					cmp_proc_oid = *(Oid *) arg;
+	const PartRelationInfo *prel = (const PartRelationInfo *) arg;
 
-	return OidFunctionCall2(cmp_proc_oid, v1->min, v2->min);
+	return OidFunctionCall2Coll(prel->cmp_proc, prel->attcollid,
+								v1->min, v2->min);
 }
 
 /*
@@ -853,8 +997,110 @@ validate_range_constraint(const Expr *expr,
 	return true;
 }
 
+/* qsort comparison function for ListEntries */
+static int
+cmp_list_entries(const void *p1, const void *p2, void *arg)
+{
+	const ListEntry	   *v1 = (const ListEntry *) p1;
+	const ListEntry	   *v2 = (const ListEntry *) p2;
+
+	Oid					cmp_proc_oid = *(Oid *) arg;
+
+	return OidFunctionCall2(cmp_proc_oid, v1->value, v2->value);
+}
+
+/*
+ * Validates list constraint. It MUST have this exact format:
+ *
+ *		VARIABLE = ANY(ARRAY_CONST)
+ *
+ * Writes palloc'ed array of 'values' on success.
+ */
+static bool
+validate_list_constraint(const Expr *expr,
+						 const PartRelationInfo *prel,
+						 Datum **values,
+						 uint32 *nvalues)
+{
+	const TypeCacheEntry	   *tce;
+	const ScalarArrayOpExpr	   *arrexpr = (const ScalarArrayOpExpr *) expr;
+	Node					   *varnode,
+							   *arraynode;
+	ArrayType				   *arrayval;
+	int16						elmlen;
+	bool						elmbyval;
+	char						elmalign;
+	Datum					   *elem_values;
+	bool					   *elem_nulls;
+	int							num_elems,
+								i;
+
+	if (!expr)
+		return false;
+
+	/* it should be "= ANY" operator */
+	if (!IsA(expr, ScalarArrayOpExpr) || !arrexpr->useOr ||
+		list_length(arrexpr->args) != 2)
+		return false;
+
+	tce = lookup_type_cache(prel->atttype, TYPECACHE_BTREE_OPFAMILY);
+	if (BTEqualStrategyNumber != get_op_opfamily_strategy(arrexpr->opno,
+														  tce->btree_opf))
+		return false;
+
+	/* check that left operand is the partitioned column */
+	varnode = (Node *) linitial(arrexpr->args);
+	if (IsA(varnode, RelabelType))
+		varnode = (Node *) ((RelabelType *) varnode)->arg;
+
+	if (!IsA(varnode, Var) || ((Var *) varnode)->varoattno != prel->attnum)
+		return false;
+
+	/* right operand might be either an array Const or ARRAY[...] of Consts */
+	arraynode = (Node *) lsecond(arrexpr->args);
+	if (!IsA(arraynode, Const))
+		arraynode = eval_const_expressions(NULL, arraynode);
+
+	if (!IsA(arraynode, Const) || ((Const *) arraynode)->constisnull)
+		return false;
+
+	arrayval = DatumGetArrayTypeP(((Const *) arraynode)->constvalue);
+
+	/* Check that types match */
+	if (ARR_ELEMTYPE(arrayval) != prel->atttype &&
+		!IsBinaryCoercible(ARR_ELEMTYPE(arrayval), prel->atttype))
+	{
+		elog(WARNING, "Constant type in some check constraint does "
+					  "not match the partitioned column's type");
+		return false;
+	}
+
+	get_typlenbyvalalign(ARR_ELEMTYPE(arrayval),
+						 &elmlen, &elmbyval, &elmalign);
+	deconstruct_array(arrayval,
+					  ARR_ELEMTYPE(arrayval),
+					  elmlen, elmbyval, elmalign,
+					  &elem_values, &elem_nulls, &num_elems);
+
+	/* NULLs are not allowed, and there should be at least one value */
+	for (i = 0; i < num_elems; i++)
+		if (elem_nulls[i])
+			return false;
+
+	if (num_elems == 0)
+		return false;
+
+	pfree(elem_nulls);
+
+	*values = elem_values;
+	*nvalues = (uint32) num_elems;
+
+	return true;
+}
+
 /*
  * Reads const value from expressions of kind: VAR >= CONST or VAR < CONST
+ * (VAR might be replaced with the partitioning expression).
  */
 static bool
 read_opexpr_const(const OpExpr *opexpr,
@@ -871,10 +1117,18 @@ read_opexpr_const(const OpExpr *opexpr,
 	left = linitial(opexpr->args);
 	right = lsecond(opexpr->args);
 
-	if (!IsA(left, Var) || !IsA(right, Const))
+	if (!IsA(right, Const))
 		return false;
-	if (((Var *) left)->varoattno != prel->attnum)
+
+	/* Left operand is either the partitioned column or the key expression */
+	if (PrelHasKeyExpression(prel))
+	{
+		if (!equal(left, prel->key_expr))
+			return false;
+	}
+	else if (!IsA(left, Var) || ((Var *) left)->varoattno != prel->attnum)
 		return false;
+
 	if (((Const *) right)->constisnull)
 		return false;
 
@@ -898,6 +1152,10 @@ read_opexpr_const(const OpExpr *opexpr,
  *
  *		get_hash_part_idx(TYPE_HASH_PROC(VALUE), PARTITIONS_COUNT) = CUR_PARTITION_HASH
  *
+ * For a composite key TYPE_HASH_PROC(VALUE) is replaced with
+ *
+ *		combine_hashes(...combine_hashes(HASH_1(VALUE_1), HASH_2(VALUE_2))..., HASH_N(VALUE_N))
+ *
  * Writes 'part_hash' hash value for this partition on success.
  */
 static bool
@@ -907,9 +1165,7 @@ validate_hash_constraint(const Expr *expr,
 {
 	const TypeCacheEntry   *tce;
 	const OpExpr		   *eq_expr;
-	const FuncExpr		   *get_hash_expr,
-						   *type_hash_proc_expr;
-	const Var			   *var; /* partitioned column */
+	const FuncExpr		   *get_hash_expr;
 
 	if (!expr)
 		return false;
@@ -936,27 +1192,11 @@ validate_hash_constraint(const Expr *expr,
 		Node   *second = lsecond(get_hash_expr->args);	/* arg #2: PARTITIONS_COUNT */
 		Const  *cur_partition_hash;						/* hash value for this partition */
 
-		if (!IsA(first, FuncExpr) || !IsA(second, Const))
-			return false;
-
-		type_hash_proc_expr = (FuncExpr *) first;
-
-		/* Check that function is indeed TYPE_HASH_PROC */
-		if (type_hash_proc_expr->funcid != prel->hash_proc ||
-				!(IsA(linitial(type_hash_proc_expr->args), Var) ||
-				  IsA(linitial(type_hash_proc_expr->args), RelabelType)))
-		{
+		if (!IsA(second, Const))
 			return false;
-		}
-
-		/* Extract argument into 'var' */
-		if (IsA(linitial(type_hash_proc_expr->args), RelabelType))
-			var = (Var *) ((RelabelType *) linitial(type_hash_proc_expr->args))->arg;
-		else
-			var = (Var *) linitial(type_hash_proc_expr->args);
 
-		/* Check that 'var' is the partitioning key attribute */
-		if (var->varoattno != prel->attnum)
+		/* Check that it's a hash of the partitioning key's column(s) */
+		if (!validate_hash_key_expr(first, prel, prel->key_natts))
 			return false;
 
 		/* Check that PARTITIONS_COUNT is equal to total amount of partitions */
@@ -983,6 +1223,66 @@ validate_hash_constraint(const Expr *expr,
 	return false;
 }
 
+/*
+ * Check that 'expr' is a hash of the first 'natts' columns of the
+ * partitioning key (see validate_hash_constraint()).
+ */
+static bool
+validate_hash_key_expr(const Node *expr, const PartRelationInfo *prel, int natts)
+{
+	const FuncExpr *func_expr;
+	char		   *funcname;
+
+	if (natts == 1)
+		return validate_hash_column_expr(expr, prel, 0);
+
+	/* combine_hashes(HASH(first 'natts - 1' columns), HASH_N(VALUE_N)) */
+	if (!IsA(expr, FuncExpr))
+		return false;
+
+	func_expr = (const FuncExpr *) expr;
+	funcname = get_func_name(func_expr->funcid);
+
+	if (list_length(func_expr->args) != 2 ||
+		get_func_namespace(func_expr->funcid) != get_pathman_schema() ||
+		!funcname || strcmp(funcname, "combine_hashes") != 0)
+		return false;
+
+	return validate_hash_key_expr(linitial(func_expr->args), prel, natts - 1) &&
+		   validate_hash_column_expr(lsecond(func_expr->args), prel, natts - 1);
+}
+
+/*
+ * Check that 'expr' is TYPE_HASH_PROC(VALUE) of the key's column 'col_idx'.
+ */
+static bool
+validate_hash_column_expr(const Node *expr, const PartRelationInfo *prel, int col_idx)
+{
+	const FuncExpr *func_expr;
+	const Node	   *arg;
+
+	if (!IsA(expr, FuncExpr))
+		return false;
+
+	func_expr = (const FuncExpr *) expr;
+
+	/* Check that function is indeed TYPE_HASH_PROC */
+	if (func_expr->funcid != prel->key_hash_procs[col_idx] ||
+		list_length(func_expr->args) != 1)
+		return false;
+
+	/* Extract argument into 'var' */
+	arg = (const Node *) linitial(func_expr->args);
+	if (IsA(arg, RelabelType))
+		arg = (const Node *) ((const RelabelType *) arg)->arg;
+
+	if (!IsA(arg, Var))
+		return false;
+
+	/* Check that 'var' is the partitioning key attribute */
+	return ((const Var *) arg)->varoattno == prel->key_attnums[col_idx];
+}
+
 /* needed for find_inheritance_children_array() function */
 static int
 oid_cmp(const void *p1, const void *p2)
@@ -10,12 +10,23 @@
 
 #include "nodes_common.h"
 #include "runtimeappend.h"
+#include "runtime_merge_append.h"
 #include "utils.h"
 
 #include "access/sysattr.h"
+#include "catalog/pg_class.h"
+#include "nodes/makefuncs.h"
 #include "optimizer/restrictinfo.h"
+#include "optimizer/tlist.h"
 #include "optimizer/var.h"
+#include "parser/parsetree.h"
+#include "storage/lmgr.h"
+#include "utils/array.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/syscache.h"
+#include "utils/typcache.h"
 
 
 /* Allocation settings */
@@ -23,6 +34,17 @@
 #define ALLOC_EXP			2
 
 
+/* Context for defer_partition_locks() */
+typedef struct
+{
+	List	   *rtable;		/* PlannedStmt->rtable */
+	Oid			parent;		/* relid of the partitioned table */
+	Oid			child;		/* relid of the current partition */
+	List	   *rtis;		/* RT indices of patched partitions */
+	List	   *oids;		/* their original relids */
+} defer_locks_cxt;
+
+
 /* Compare plans by 'original_order' */
 static int
 cmp_child_scan_common_by_orig_order(const void *ap,
@@ -39,6 +61,68 @@ cmp_child_scan_common_by_orig_order(const void *ap,
 		return 0;
 }
 
+/* Compare Oids (used for bsearch) */
+static int
+cmp_oids(const void *ap, const void *bp)
+{
+	Oid a = *(const Oid *) ap;
+	Oid b = *(const Oid *) bp;
+
+	if (a > b)
+		return 1;
+	else if (a < b)
+		return -1;
+	else
+		return 0;
+}
+
+/*
+ * Let child's Sort node perform a bounded (top-N) sort if only 'bound'
+ * tuples will be requested, just like pass_down_bound() does for Limit.
+ */
+static void
+pass_down_tuple_bound(PlanState *ps, int64 bound)
+{
+	if (bound > 0 && IsA(ps, SortState))
+	{
+		SortState *sort_state = (SortState *) ps;
+
+		sort_state->bounded = true;
+		sort_state->bound = bound;
+	}
+}
+
+/* Create plan state for a plan which hasn't been used yet */
+static PlanState *
+create_child_plan_state(RuntimeAppendState *scan_state,
+						ChildScanCommon child, EState *estate)
+{
+	PlanState *ps;
+
+	Assert(child->content_type == CHILD_PLAN); /* no paths allowed */
+
+	ps = ExecInitNode(child->content.plan, estate, 0);
+	child->content.plan_state = ps;
+	child->content_type = CHILD_PLAN_STATE; /* update content type */
+
+#if PG_VERSION_NUM >= 90600
+	/*
+	 * Worker reports instrumentation only for nodes known to the leader,
+	 * so partitions it has selected on its own are kept apart.
+	 */
+	if (IsParallelWorker() && !scan_state->pstate)
+	{
+		scan_state->worker_ps = lappend(scan_state->worker_ps, ps);
+		return ps;
+	}
+#endif
+
+	/* Explain and clear_plan_states rely on this list */
+	scan_state->css.custom_ps = lappend(scan_state->css.custom_ps, ps);
+
+	return ps;
+}
+
 static void
 transform_plans_into_states(RuntimeAppendState *scan_state,
 							ChildScanCommon *selected_plans, int n,
@@ -53,19 +137,12 @@ transform_plans_into_states(RuntimeAppendState *scan_state,
 
 		/* Create new node since this plan hasn't been used yet */
 		if (child->content_type != CHILD_PLAN_STATE)
-		{
-			Assert(child->content_type == CHILD_PLAN); /* no paths allowed */
-
-			ps = ExecInitNode(child->content.plan, estate, 0);
-			child->content.plan_state = ps;
-			child->content_type = CHILD_PLAN_STATE; /* update content type */
-
-			/* Explain and clear_plan_states rely on this list */
-			scan_state->css.custom_ps = lappend(scan_state->css.custom_ps, ps);
-		}
+			ps = create_child_plan_state(scan_state, child, estate);
 		else
 			ps = child->content.plan_state;
 
+		pass_down_tuple_bound(ps, scan_state->tuple_bound);
+
 		/* Node with params will be ReScanned */
 		if (scan_state->css.ss.ps.chgParam)
 			UpdateChangedParamSet(ps, scan_state->css.ss.ps.chgParam);
@@ -81,6 +158,35 @@ transform_plans_into_states(RuntimeAppendState *scan_state,
 	}
 }
 
+/*
+ * Prepare plan state of a selected partition right before it's scanned
+ * (see rescan_append_common()). Partitions that are never reached (e.g.
+ * due to LIMIT) are neither initialized nor rescanned.
+ */
+void
+prepare_child_plan_state(CustomScanState *node, ChildScanCommon child)
+{
+	RuntimeAppendState *scan_state = (RuntimeAppendState *) node;
+	int64				bound = -1;
+
+	/* Child has to produce only the rest of tuples */
+	if (scan_state->tuple_bound >= 0)
+		bound = scan_state->tuple_bound - scan_state->ntuples;
+
+	if (child->content_type != CHILD_PLAN_STATE)
+	{
+		create_child_plan_state(scan_state, child, scan_state->css.ss.ps.state);
+		pass_down_tuple_bound(child->content.plan_state, bound);
+	}
+
+	/* Plan state has been used by one of the previous scans */
+	else
+	{
+		pass_down_tuple_bound(child->content.plan_state, bound);
+		ExecReScan(child->content.plan_state);
+	}
+}
+
 static ChildScanCommon *
 select_required_plans(HTAB *children_table, Oid *parts, int nparts, int *nres)
 {
@@ -176,10 +282,11 @@ append_part_attr_to_tlist(List *tlist, Index relno, const PartRelationInfo *prel
 
 static void
 pack_runtimeappend_private(CustomScan *cscan, RuntimeAppendPath *path,
-						   bool enable_parent)
+						   bool enable_parent, AttrNumber key_resno)
 {
 	ChildScanCommon    *children = path->children;
-	int					nchildren = path->nchildren;
+	int					nchildren = path->nchildren,
+						tuple_bound = -1;
 	List			   *custom_private = NIL,
 					   *custom_oids = NIL;
 	int					i;
@@ -191,11 +298,22 @@ pack_runtimeappend_private(CustomScan *cscan, RuntimeAppendPath *path,
 		pfree(children[i]);
 	}
 
-	/* Save parent & partition Oids and a flag as first element of 'custom_private' */
+	/* LIMIT is stored as int, larger values are pointless anyway */
+	if (path->tuple_bound > 0)
+		tuple_bound = (int) Min(path->tuple_bound, (double) INT_MAX);
+
+	/*
+	 * Save parent & partition Oids, a flag, LIMIT and join key's column
+	 * as first element of 'custom_private'. The fourth element is filled
+	 * later by defer_partition_locks() (if needed).
+	 */
 	custom_private = lappend(custom_private,
-							 list_make3(list_make1_oid(path->relid),
-										custom_oids, /* list of Oids */
-										list_make1_int(enable_parent)));
+							 list_concat(list_make4(list_make1_oid(path->relid),
+													custom_oids, /* list of Oids */
+													list_make1_int(enable_parent),
+													NIL),
+										 list_make2(list_make1_int(tuple_bound),
+													list_make1_int(key_resno))));
 
 	/* Store freshly built 'custom_private' */
 	cscan->custom_private = custom_private;
@@ -203,12 +321,138 @@ pack_runtimeappend_private(CustomScan *cscan, RuntimeAppendPath *path,
 
 static void
 unpack_runtimeappend_private(RuntimeAppendState *scan_state, CustomScan *cscan)
+{
+	List	   *runtimeappend_private = linitial(cscan->custom_private),
+			   *deferred_locks;
+
+	/* Plans will be stored in 'children_table' by begin_append_common */
+	scan_state->children_table = NULL;
+	scan_state->relid = linitial_oid(linitial(runtimeappend_private));
+	scan_state->enable_parent = (bool) linitial_int(lthird(runtimeappend_private));
+	scan_state->tuple_bound = linitial_int((List *) list_nth(runtimeappend_private, 4));
+	scan_state->key_resno = linitial_int((List *) list_nth(runtimeappend_private, 5));
+
+	/* Plan producing join keys follows plans of partitions */
+	if (scan_state->key_resno > 0)
+		scan_state->key_plan = (Plan *) llast(cscan->custom_plans);
+
+	/* RT indices of partitions which should be restored by executor */
+	deferred_locks = (List *) lfourth(runtimeappend_private);
+	if (deferred_locks)
+	{
+		scan_state->deferred_rtis = (List *) linitial(deferred_locks);
+		scan_state->deferred_oids = (List *) lsecond(deferred_locks);
+	}
+}
+
+/*
+ * Put partitions' relids back into executor's range table
+ * (see defer_partition_locks()). Since PlannedStmt might
+ * belong to a cached plan, we modify a copy of the list.
+ */
+static void
+restore_partition_rtes(RuntimeAppendState *scan_state, EState *estate)
+{
+	List	   *rtable = list_copy(estate->es_range_table);
+	ListCell   *lc1,
+			   *lc2;
+
+	forboth (lc1, scan_state->deferred_rtis, lc2, scan_state->deferred_oids)
+	{
+		ListCell	   *rte_cell = list_nth_cell(rtable, lfirst_int(lc1) - 1);
+		RangeTblEntry  *rte = (RangeTblEntry *) palloc(sizeof(RangeTblEntry));
+
+		memcpy(rte, lfirst(rte_cell), sizeof(RangeTblEntry));
+		rte->relid = lfirst_oid(lc2);
+
+		lfirst(rte_cell) = rte;
+	}
+
+	estate->es_range_table = rtable;
+}
+
+/*
+ * Lock a partition whose lock has been deferred by defer_partition_locks().
+ * Cached plan has been validated without this lock, so the partition might
+ * have been dropped or detached since then. Returns false in that case.
+ */
+static bool
+lock_deferred_partition(RuntimeAppendState *scan_state, Oid relid)
+{
+	const PartRelationInfo *prel;
+	Oid					   *children;
+	uint32					i;
+
+	/* Parent and already initialized partitions are locked */
+	if (!list_member_oid(scan_state->deferred_oids, relid))
+		return true;
+
+	/* Accepts invalidation messages of concurrent DDL */
+	LockRelationOid(relid, AccessShareLock);
+
+	if (!SearchSysCacheExists1(RELOID, ObjectIdGetDatum(relid)))
+		return false;
+
+	/* Check that it's still a partition of this parent */
+	prel = get_pathman_relation_info(scan_state->relid);
+	if (!prel)
+		return false;
+
+	if (prel->default_part == relid)
+		return true;
+
+	children = PrelGetChildrenArray(prel);
+	for (i = 0; i < PrelChildrenCount(prel); i++)
+		if (children[i] == relid)
+			return true;
+
+	return false;
+}
+
+/*
+ * Lock deferred partitions among 'plans' and remove the ones
+ * which are gone from both 'plans' and scan_state->children_table.
+ */
+static void
+lock_deferred_partitions(RuntimeAppendState *scan_state,
+						 ChildScanCommon *plans, int *nplans)
+{
+	int		used = 0,
+			i;
+
+	for (i = 0; i < *nplans; i++)
+	{
+		ChildScanCommon child = plans[i];
+
+		if (child->content_type != CHILD_PLAN ||
+			lock_deferred_partition(scan_state, child->relid))
+		{
+			plans[used++] = child;
+			continue;
+		}
+
+		/* Partition is gone, forget its plan */
+		hash_search(scan_state->children_table,
+					(const void *) &child->relid,
+					HASH_REMOVE, NULL);
+	}
+
+	*nplans = used;
+}
+
+/*
+ * Store plans of partitions listed in 'parts' (or all
+ * plans if 'parts' is NULL) in scan_state->children_table.
+ */
+static void
+build_children_table(RuntimeAppendState *scan_state, CustomScan *cscan,
+					 Oid *parts, int nparts)
 {
 	ListCell   *oid_cell,
 			   *plan_cell;
 	List	   *runtimeappend_private = linitial(cscan->custom_private),
 			   *custom_oids;		/* Oids of partitions */
-	int			custom_oids_count;	/* number of partitions */
+	Oid		   *sorted_parts = NULL;
 
 	HTAB	   *children_table;
 	HASHCTL	   *children_table_config = &scan_state->children_table_config;
@@ -216,14 +460,21 @@ unpack_runtimeappend_private(RuntimeAppendState *scan_state, CustomScan *cscan)
 
 	/* Extract Oids list from packed data */
 	custom_oids = (List *) lsecond(runtimeappend_private);
-	custom_oids_count = list_length(custom_oids);
+
+	/* Sort selected Oids so that we could use bsearch() */
+	if (parts)
+	{
+		sorted_parts = (Oid *) palloc(nparts * sizeof(Oid));
+		memcpy(sorted_parts, parts, nparts * sizeof(Oid));
+		qsort(sorted_parts, nparts, sizeof(Oid), cmp_oids);
+	}
 
 	memset(children_table_config, 0, sizeof(HASHCTL));
 	children_table_config->keysize = sizeof(Oid);
 	children_table_config->entrysize = sizeof(ChildScanCommonData);
 
 	children_table = hash_create("RuntimeAppend plan storage",
-								 custom_oids_count,
+								 parts ? Max(nparts, 1) : list_length(custom_oids),
 								 children_table_config,
 								 HASH_ELEM | HASH_BLOBS);
 
@@ -232,10 +483,19 @@ unpack_runtimeappend_private(RuntimeAppendState *scan_state, CustomScan *cscan)
 	{
 		bool				child_found;
 		Oid					cur_oid = lfirst_oid(oid_cell);
+		ChildScanCommon		child;
+
+		/* Skip plans of partitions which have been pruned */
+		if (sorted_parts && !bsearch(&cur_oid, sorted_parts, nparts,
+									 sizeof(Oid), cmp_oids))
+		{
+			i++;
+			continue;
+		}
 
-		ChildScanCommon		child = hash_search(children_table,
-												(const void *) &cur_oid,
-												HASH_ENTER, &child_found);
+		child = hash_search(children_table,
+							(const void *) &cur_oid,
+							HASH_ENTER, &child_found);
 
 		Assert(!child_found); /* there should be no collisions */
 
@@ -244,10 +504,152 @@ unpack_runtimeappend_private(RuntimeAppendState *scan_state, CustomScan *cscan)
 		child->original_order = i++; /* will be used in EXPLAIN */
 	}
 
-	/* Finally fill 'scan_state' with unpacked elements */
+	if (sorted_parts)
+		pfree(sorted_parts);
+
 	scan_state->children_table = children_table;
-	scan_state->relid = linitial_oid(linitial(runtimeappend_private));
-	scan_state->enable_parent = (bool) linitial_int(lthird(runtimeappend_private));
+}
+
+/*
+ * Run scan_state->key_plan and make "KEY = ANY(collected values)" of its
+ * output. Inner side of a hash join is supposed to be small (see
+ * add_join_key_filter_paths()), so all keys fit into memory.
+ */
+static Expr *
+build_join_key_filter(RuntimeAppendState *scan_state,
+					  const PartRelationInfo *prel)
+{
+	EState			   *estate = scan_state->css.ss.ps.state;
+	PlanState		   *key_state;
+	TypeCacheEntry	   *tce;
+	MemoryContext		keys_mcxt,
+						old_mcxt;
+	Datum			   *values;
+	int					allocated = INITIAL_ALLOC_NUM,
+						used = 0;
+	ArrayType		   *keys;
+	ScalarArrayOpExpr  *result;
+
+	tce = lookup_type_cache(prel->atttype, TYPECACHE_EQ_OPR);
+
+	keys_mcxt = AllocSetContextCreate(CurrentMemoryContext,
+									  "RuntimeAppend join keys",
+									  ALLOCSET_DEFAULT_MINSIZE,
+									  ALLOCSET_DEFAULT_INITSIZE,
+									  ALLOCSET_DEFAULT_MAXSIZE);
+
+	values = (Datum *) MemoryContextAlloc(keys_mcxt, allocated * sizeof(Datum));
+
+	key_state = ExecInitNode(scan_state->key_plan, estate, 0);
+
+	for (;;)
+	{
+		TupleTableSlot *slot = ExecProcNode(key_state);
+		Datum			value;
+		bool			isnull;
+
+		if (TupIsNull(slot))
+			break;
+
+		/* NULL never matches */
+		value = slot_getattr(slot, scan_state->key_resno, &isnull);
+		if (isnull)
+			continue;
+
+		if (allocated <= used)
+		{
+			allocated *= ALLOC_EXP;
+			values = repalloc(values, allocated * sizeof(Datum));
+		}
+
+		old_mcxt = MemoryContextSwitchTo(keys_mcxt);
+		values[used++] = datumCopy(value, tce->typbyval, tce->typlen);
+		MemoryContextSwitchTo(old_mcxt);
+	}
+
+	/* Keys are collected again if params change (see rescan_append_common()) */
+	ExecEndNode(key_state);
+
+	/* Filter is used by subsequent rescans */
+	old_mcxt = MemoryContextSwitchTo(estate->es_query_cxt);
+
+	keys = construct_array(values, used, prel->atttype,
+						   tce->typlen, tce->typbyval, tce->typalign);
+
+	result = makeNode(ScalarArrayOpExpr);
+	result->opno = tce->eq_opr;
+	result->opfuncid = get_opcode(tce->eq_opr);
+	result->useOr = true;
+	result->inputcollid = prel->attcollid;
+	result->args = list_make2(makeVar(1, prel->attnum,
+									  prel->atttype,
+									  prel->atttypmod,
+									  prel->attcollid, 0),
+							  makeConst(get_array_type(prel->atttype), -1,
+										InvalidOid, -1,
+										PointerGetDatum(keys),
+										false, false));
+	result->location = -1;
+
+	MemoryContextSwitchTo(old_mcxt);
+	MemoryContextDelete(keys_mcxt);
+
+	return (Expr *) result;
+}
+
+/*
+ * Select partitions using scan_state->custom_exprs,
+ * current values of params stored in ps_ExprContext
+ * and join keys (if any).
+ */
+static Oid *
+select_partitions_for_scan(RuntimeAppendState *scan_state, int *nparts)
+{
+	ExprContext			   *econtext = scan_state->css.ss.ps.ps_ExprContext;
+	const PartRelationInfo *prel;
+	RangeSet			   *ranges;
+	WalkerContext			wcxt;
+	Oid					   *parts;
+	List				   *clauses = scan_state->custom_exprs;
+	int						uncovered = UNCOVERED_ALL;
+
+	prel = get_pathman_relation_info(scan_state->relid);
+	Assert(prel);
+
+	/* Skip partitions which can't contain any of the join keys */
+	if (scan_state->key_plan)
+	{
+		if (!scan_state->key_filter)
+			scan_state->key_filter = build_join_key_filter(scan_state, prel);
+
+		clauses = lappend(list_copy(clauses), scan_state->key_filter);
+	}
+
+	/* First we select all available partitions... */
+	ranges = rangeset_make1(make_irange(0, PrelLastChild(prel), false));
+
+	InitWalkerContext(&wcxt, prel, econtext, false);
+	if (clauses != NIL)
+	{
+		WrapperNode	   *wn;
+
+		/* ... then we cut off irrelevant ones using the provided clauses */
+		wn = walk_expr_tree(makeBoolExpr(AND_EXPR, clauses, -1), &wcxt);
+		ranges = rangeset_intersect(ranges, wn->rangeset);
+		uncovered &= wn->uncovered;
+	}
+
+	/* Get Oids of the required partitions */
+	parts = get_partition_oids(ranges, nparts, prel, scan_state->enable_parent);
+
+	/* Default partition might contain some matching rows as well */
+	if (PrelHasDefaultPart(prel) && uncovered != UNCOVERED_NONE)
+	{
+		parts = repalloc(parts, (*nparts + 1) * sizeof(Oid));
+		parts[(*nparts)++] = prel->default_part;
+	}
+
+	return parts;
 }
 
 /*
@@ -285,35 +687,30 @@ get_partitioned_attr_clauses(List *restrictinfo_list,
 
 /* Transform partition ranges into plain array of partition Oids */
 Oid *
-get_partition_oids(List *ranges, int *n, const PartRelationInfo *prel,
+get_partition_oids(RangeSet *ranges, int *n, const PartRelationInfo *prel,
 				   bool include_parent)
 {
-	ListCell   *range_cell;
-	uint32		allocated = INITIAL_ALLOC_NUM;
-	uint32		used = 0;
-	Oid		   *result = (Oid *) palloc(allocated * sizeof(Oid));
+	uint32		used = 0,
+				j;
+	Oid		   *result;
 	Oid		   *children = PrelGetChildrenArray(prel);
 
+	/* Size of result is known in advance (plus one for parent) */
+	result = (Oid *) palloc((rangeset_length(ranges) + 1) * sizeof(Oid));
+
 	/* If required, add parent to result */
-	Assert(INITIAL_ALLOC_NUM >= 1);
 	if (include_parent)
 		result[used++] = PrelParentRelid(prel);
 
 	/* Deal with selected partitions */
-	foreach (range_cell, ranges)
+	for (j = 0; j < rangeset_nranges(ranges); j++)
 	{
 		uint32	i;
-		uint32	a = lfirst_irange(range_cell).ir_lower,
-				b = lfirst_irange(range_cell).ir_upper;
+		uint32	a = rangeset_get(ranges, j).ir_lower,
+				b = rangeset_get(ranges, j).ir_upper;
 
 		for (i = a; i <= b; i++)
 		{
-			if (allocated <= used)
-			{
-				allocated *= ALLOC_EXP;
-				result = repalloc(result, allocated * sizeof(Oid));
-			}
-
 			Assert(i < PrelChildrenCount(prel));
 			result[used++] = children[i];
 		}
@@ -323,6 +720,103 @@ get_partition_oids(List *ranges, int *n, const PartRelationInfo *prel,
 	return result;
 }
 
+/* Substitute partition's relid for the parent's one in scan nodes */
+static void
+defer_locks_visitor(Plan *plan, void *context)
+{
+	defer_locks_cxt	   *cxt = (defer_locks_cxt *) context;
+	Index				scanrelid;
+	RangeTblEntry	   *rte;
+
+	switch (nodeTag(plan))
+	{
+		case T_SeqScan:
+		case T_SampleScan:
+		case T_IndexScan:
+		case T_IndexOnlyScan:
+		case T_BitmapHeapScan:
+		case T_TidScan:
+			scanrelid = ((Scan *) plan)->scanrelid;
+			break;
+
+		default:
+			return;
+	}
+
+	rte = rt_fetch(scanrelid, cxt->rtable);
+
+	/* Skip foreign RTEs and RTEs that have been patched already */
+	if (rte->relid != cxt->child || rte->relkind != RELKIND_RELATION)
+		return;
+
+	/* Make sure EXPLAIN will show partition's name */
+	if (!rte->alias)
+		rte->alias = makeAlias(get_rel_name(cxt->child), NIL);
+
+	rte->relid = cxt->parent;
+
+	cxt->rtis = lappend_int(cxt->rtis, scanrelid);
+	cxt->oids = lappend_oid(cxt->oids, cxt->child);
+}
+
+static void
+defer_partition_locks_visitor(Plan *plan, void *context)
+{
+	CustomScan	   *cscan = (CustomScan *) plan;
+	List		   *runtimeappend_private;
+	ListCell	   *oid_cell,
+				   *plan_cell;
+	defer_locks_cxt	cxt;
+
+	/* Skip if not RuntimeAppend or RuntimeMergeAppend */
+	if (!IsA(cscan, CustomScan) ||
+		(cscan->methods != &runtimeappend_plan_methods &&
+		 cscan->methods != &runtime_merge_append_plan_methods))
+		return;
+
+	runtimeappend_private = linitial(cscan->custom_private);
+
+	cxt.rtable = (List *) context;
+	cxt.parent = linitial_oid(linitial(runtimeappend_private));
+	cxt.rtis = NIL;
+	cxt.oids = NIL;
+
+	forboth (oid_cell, lsecond(runtimeappend_private),
+			 plan_cell, cscan->custom_plans)
+	{
+		cxt.child = lfirst_oid(oid_cell);
+
+		/* Parent is locked anyway */
+		if (cxt.child == cxt.parent)
+			continue;
+
+		/* Vars of child plans are deparsed using parent's tuple descriptor */
+		if (get_relnatts(cxt.child) != get_relnatts(cxt.parent))
+			continue;
+
+		plan_tree_walker((Plan *) lfirst(plan_cell), defer_locks_visitor, &cxt);
+	}
+
+	/* Let executor know which RTEs it should restore */
+	if (cxt.rtis)
+		lfirst(list_nth_cell(runtimeappend_private, 3)) = list_make2(cxt.rtis,
+																	 cxt.oids);
+}
+
+/*
+ * Make partitions scanned by RuntimeAppend (and RuntimeMergeAppend)
+ * look like their parent in 'rtable', so that AcquireExecutorLocks()
+ * wouldn't lock them each time a cached plan is executed. Partitions
+ * selected at runtime are locked by ExecInitNode() instead.
+ *
+ * 'rtable' should point to the PlannedStmt->rtable
+ */
+void
+defer_partition_locks(List *rtable, Plan *plan)
+{
+	plan_tree_walker(plan, defer_partition_locks_visitor, rtable);
+}
+
 Path *
 create_append_path_common(PlannerInfo *root,
 						  AppendPath *inner_append,
@@ -348,6 +842,9 @@ create_append_path_common(PlannerInfo *root,
 	result->cpath.path.pathkeys = inner_append->path.pathkeys;
 #if PG_VERSION_NUM >= 90600
 	result->cpath.path.pathtarget = inner_append->path.pathtarget;
+
+	/* Workers can run this node if they can run all of its children */
+	result->cpath.path.parallel_safe = inner_append->path.parallel_safe;
 #endif
 	result->cpath.path.rows = inner_append->path.rows * sel;
 	result->cpath.flags = 0;
@@ -389,6 +886,40 @@ create_append_path_common(PlannerInfo *root,
 	result->cpath.path.startup_cost *= sel;
 	result->cpath.path.total_cost *= sel;
 
+	/*
+	 * If 'innerrel' is the only relation of the query and this path provides
+	 * the required ordering, LIMIT applies directly to its output (see
+	 * 'limit_tuples' in grouping_planner()). LockRows might skip some rows,
+	 * so FOR UPDATE/SHARE queries get no bound.
+	 */
+	if (bms_equal(innerrel->relids, root->all_baserels) &&
+		root->limit_tuples > 0 && root->parse->rowMarks == NIL &&
+		pathkeys_contained_in(root->query_pathkeys, result->cpath.path.pathkeys))
+		result->tuple_bound = root->limit_tuples;
+	else
+		result->tuple_bound = -1.0;
+
+	/* RuntimeAppend initializes and scans its children one by one */
+	if (path_methods == &runtimeappend_path_methods && inner_append->subpaths)
+	{
+		Path *first = (Path *) linitial(inner_append->subpaths);
+
+		result->cpath.path.startup_cost = Min(first->startup_cost,
+											  result->cpath.path.total_cost);
+
+		/* It also stops as soon as LIMIT is reached (see fetch_next_tuple()) */
+		if (result->tuple_bound > 0 &&
+			result->tuple_bound < result->cpath.path.rows)
+		{
+			Cost run_cost = result->cpath.path.total_cost -
+							result->cpath.path.startup_cost;
+
+			result->cpath.path.total_cost = result->cpath.path.startup_cost +
+					run_cost * result->tuple_bound / result->cpath.path.rows;
+			result->cpath.path.rows = result->tuple_bound;
+		}
+	}
+
 	return &result->cpath.path;
 }
 
@@ -401,10 +932,29 @@ create_append_plan_common(PlannerInfo *root, RelOptInfo *rel,
 	RuntimeAppendPath	   *rpath = (RuntimeAppendPath *) best_path;
 	const PartRelationInfo *prel;
 	CustomScan			   *cscan;
+	Plan				   *key_plan = NULL;
+	AttrNumber				key_resno = 0;
 
 	prel = get_pathman_relation_info(rpath->relid);
 	Assert(prel);
 
+	/*
+	 * Plan of join keys' source comes last
+	 * (see create_runtimeappend_key_filter_path())
+	 */
+	if (rpath->key_path)
+	{
+		TargetEntry *key_tle;
+
+		key_plan = (Plan *) llast(custom_plans);
+		custom_plans = list_truncate(list_copy(custom_plans), rpath->nchildren);
+
+		/* Join key is needed by the join, thus it should be there */
+		key_tle = tlist_member((Node *) rpath->key_var, key_plan->targetlist);
+		if (key_tle)
+			key_resno = key_tle->resno;
+	}
+
 	cscan = makeNode(CustomScan);
 	cscan->custom_scan_tlist = NIL; /* initial value (empty list) */
 	cscan->scan.plan.targetlist = NIL;
@@ -445,8 +995,12 @@ create_append_plan_common(PlannerInfo *root, RelOptInfo *rel,
 	cscan->custom_plans = custom_plans;
 	cscan->methods = scan_methods;
 
+	/* Otherwise key column is not available, forget about join keys */
+	if (key_resno > 0)
+		cscan->custom_plans = lappend(cscan->custom_plans, key_plan);
+
 	/* Cache 'prel->enable_parent' as well */
-	pack_runtimeappend_private(cscan, rpath, prel->enable_parent);
+	pack_runtimeappend_private(cscan, rpath, prel->enable_parent, key_resno);
 
 	return &cscan->scan.plan;
 }
@@ -470,6 +1024,8 @@ create_append_scan_state_common(CustomScan *node,
 	scan_state->cur_plans = NULL;
 	scan_state->ncur_plans = 0;
 	scan_state->running_idx = 0;
+	scan_state->prepared_idx = -1;
+	scan_state->ntuples = 0;
 
 	return (Node *) scan_state;
 }
@@ -479,10 +1035,56 @@ begin_append_common(CustomScanState *node, EState *estate, int eflags)
 {
 	RuntimeAppendState *scan_state = (RuntimeAppendState *) node;
 
+	CustomScan		   *cscan = (CustomScan *) node->ss.ps.plan;
+
 	scan_state->custom_expr_states =
 		(List *) ExecInitExpr((Expr *) scan_state->custom_exprs,
 							  (PlanState *) scan_state);
 
+	/* Child plans should scan partitions, not their parent */
+	if (scan_state->deferred_rtis)
+		restore_partition_rtes(scan_state, estate);
+
+	/*
+	 * If clauses don't depend on PARAM_EXEC params (i.e. only
+	 * PARAM_EXTERN params of a generic plan are used), their
+	 * values are already known, so we can prune partitions
+	 * right now and never initialize (or lock) the rest.
+	 * Join keys are not known until the first scan, though.
+	 */
+	scan_state->initial_pruning =
+			!clause_contains_exec_params((Node *) scan_state->custom_exprs) &&
+			!scan_state->key_plan;
+
+	if (!scan_state->initial_pruning)
+		build_children_table(scan_state, cscan, NULL, 0);
+#if PG_VERSION_NUM >= 90600
+	/* Worker will scan partitions selected by the leader */
+	else if (node->ss.ps.plan->parallel_aware && IsParallelWorker())
+		scan_state->children_table = NULL;
+#endif
+	else
+	{
+		scan_state->initial_parts =
+				select_partitions_for_scan(scan_state,
+										   &scan_state->ninitial_parts);
+
+		build_children_table(scan_state, cscan,
+							 scan_state->initial_parts,
+							 scan_state->ninitial_parts);
+	}
+
+#if PG_VERSION_NUM >= 90600
+	/*
+	 * Selected partitions of parallel-aware RuntimeAppend are initialized
+	 * right away, so that all participants have the same plan states
+	 * (see initialize_append_worker_common()).
+	 */
+	if (node->ss.ps.plan->parallel_aware && scan_state->initial_pruning &&
+		!IsParallelWorker() && !(eflags & EXEC_FLAG_EXPLAIN_ONLY))
+		rescan_append_common(node, false);
+#endif
+
 	node->ss.ps.ps_TupFromTlist = false;
 }
 
@@ -535,41 +1137,50 @@ void
 end_append_common(CustomScanState *node)
 {
 	RuntimeAppendState *scan_state = (RuntimeAppendState *) node;
+	ListCell		   *lc;
 
 	clear_plan_states(&scan_state->css);
 	hash_destroy(scan_state->children_table);
+
+	/* Plan states created by parallel worker on its own */
+	foreach (lc, scan_state->worker_ps)
+		ExecEndNode((PlanState *) lfirst(lc));
+
+	if (scan_state->initial_parts)
+		pfree(scan_state->initial_parts);
 }
 
+/*
+ * Select partitions for a new scan. Selected plans are kept in the order
+ * of subpaths, which is the order of bounds for an ordered RuntimeAppend.
+ * If 'lazy' is true, plan states are left for prepare_child_plan_state().
+ */
 void
-rescan_append_common(CustomScanState *node)
+rescan_append_common(CustomScanState *node, bool lazy)
 {
 	RuntimeAppendState	   *scan_state = (RuntimeAppendState *) node;
-	ExprContext			   *econtext = node->ss.ps.ps_ExprContext;
-	const PartRelationInfo *prel;
-	List				   *ranges;
-	ListCell			   *lc;
-	WalkerContext			wcxt;
 	Oid					   *parts;
 	int						nparts;
 
-	prel = get_pathman_relation_info(scan_state->relid);
-	Assert(prel);
-
-	/* First we select all available partitions... */
-	ranges = list_make1_irange(make_irange(0, PrelLastChild(prel), false));
-
-	InitWalkerContext(&wcxt, prel, econtext, false);
-	foreach (lc, scan_state->custom_exprs)
+	/* Join keys depend on changed params, they have to be collected again */
+	if (scan_state->key_filter &&
+		bms_overlap(node->ss.ps.chgParam, scan_state->key_plan->extParam))
 	{
-		WrapperNode	   *wn;
+		ScalarArrayOpExpr  *filter = (ScalarArrayOpExpr *) scan_state->key_filter;
+		Const			   *keys = (Const *) lsecond(filter->args);
 
-		/* ... then we cut off irrelevant ones using the provided clauses */
-		wn = walk_expr_tree((Expr *) lfirst(lc), &wcxt);
-		ranges = irange_list_intersect(ranges, wn->rangeset);
+		pfree(DatumGetPointer(keys->constvalue));
+		scan_state->key_filter = NULL;
 	}
 
-	/* Get Oids of the required partitions */
-	parts = get_partition_oids(ranges, &nparts, prel, scan_state->enable_parent);
+	/* Partitions have already been selected at startup */
+	if (scan_state->initial_pruning)
+	{
+		parts = scan_state->initial_parts;
+		nparts = scan_state->ninitial_parts;
+	}
+	else
+		parts = select_partitions_for_scan(scan_state, &nparts);
 
 	/* Select new plans for this run using 'parts' */
 	if (scan_state->cur_plans)
@@ -578,20 +1189,62 @@ rescan_append_common(CustomScanState *node)
 	scan_state->cur_plans = select_required_plans(scan_state->children_table,
 												  parts, nparts,
 												  &scan_state->ncur_plans);
-	pfree(parts);
+
+	if (!scan_state->initial_pruning)
+		pfree(parts);
+
+	/* Partitions have not been locked yet (see defer_partition_locks()) */
+	if (scan_state->deferred_oids)
+		lock_deferred_partitions(scan_state,
+								 scan_state->cur_plans,
+								 &scan_state->ncur_plans);
+
+	/* Restore the order of subpaths (e.g. descending bounds) */
+	qsort(scan_state->cur_plans, scan_state->ncur_plans,
+		  sizeof(ChildScanCommon), cmp_child_scan_common_by_orig_order);
 
 	/* Transform selected plans into executable plan states */
-	transform_plans_into_states(scan_state,
-								scan_state->cur_plans,
-								scan_state->ncur_plans,
-								scan_state->css.ss.ps.state);
+	if (!lazy)
+		transform_plans_into_states(scan_state,
+									scan_state->cur_plans,
+									scan_state->ncur_plans,
+									scan_state->css.ss.ps.state);
 
-	scan_state->running_idx = 0;
+#if PG_VERSION_NUM >= 90600
+	/*
+	 * Shared state might be gone (or reused by relaunched workers),
+	 * so the leader performs rescans alone.
+	 */
+	if (scan_state->pstate && !IsParallelWorker())
+		scan_state->pstate = NULL;
+#endif
+
+	/* Parallel participants claim plans one by one (see fetch_next_tuple()) */
+	scan_state->running_idx = scan_state->pstate ? -1 : 0;
+	scan_state->prepared_idx = -1;
+	scan_state->ntuples = 0;
 }
 
 void
 explain_append_common(CustomScanState *node, HTAB *children_table, ExplainState *es)
 {
+	RuntimeAppendState *scan_state = (RuntimeAppendState *) node;
+
+	/* Child plans will be explained using the restored range table */
+	if (scan_state->deferred_rtis)
+		es->rtable = node->ss.ps.state->es_range_table;
+
+	/* Show the column filtered by join keys */
+	if (scan_state->key_plan)
+	{
+		const PartRelationInfo *prel = get_pathman_relation_info(scan_state->relid);
+
+		if (prel && !PrelHasKeyExpression(prel))
+			ExplainPropertyText("Join Key Filter",
+								get_attname(scan_state->relid, prel->attnum),
+								es);
+	}
+
 	/* Construct excess PlanStates */
 	if (!es->analyze)
 	{
@@ -621,6 +1274,10 @@ explain_append_common(CustomScanState *node, HTAB *children_table, ExplainState
 			custom_ps[used++] = child;
 		}
 
+		/* Skip partitions dropped since the plan has been cached */
+		if (scan_state->deferred_oids)
+			lock_deferred_partitions(scan_state, custom_ps, &used);
+
 		/*
 		 * We have to restore the original plan order
 		 * which has been lost within the hash table
@@ -639,3 +1296,68 @@ explain_append_common(CustomScanState *node, HTAB *children_table, ExplainState
 												   0));
 	}
 }
+
+#if PG_VERSION_NUM >= 90600
+/*
+ * Parallel-aware RuntimeAppend shares partitions selected
+ * by the leader at startup (they don't depend on PARAM_EXEC
+ * params, since those are not passed to workers).
+ */
+Size
+estimate_append_dsm_common(CustomScanState *node)
+{
+	RuntimeAppendState *scan_state = (RuntimeAppendState *) node;
+	long				nparts = hash_get_num_entries(scan_state->children_table);
+
+	return add_size(offsetof(RuntimeAppendSharedState, parts),
+					mul_size(sizeof(Oid), nparts));
+}
+
+void
+initialize_append_dsm_common(CustomScanState *node, void *coordinate)
+{
+	RuntimeAppendState		   *scan_state = (RuntimeAppendState *) node;
+	RuntimeAppendSharedState   *pstate = (RuntimeAppendSharedState *) coordinate;
+	ChildScanCommon				child;
+	HASH_SEQ_STATUS				seqstat;
+
+	pg_atomic_init_u32(&pstate->next_plan, 0);
+
+	pstate->nparts = 0;
+	hash_seq_init(&seqstat, scan_state->children_table);
+	while ((child = (ChildScanCommon) hash_seq_search(&seqstat)))
+		pstate->parts[pstate->nparts++] = child->relid;
+
+	/* Leader claims plans as well */
+	scan_state->pstate = pstate;
+	scan_state->running_idx = -1;
+}
+
+void
+initialize_append_worker_common(CustomScanState *node, void *coordinate)
+{
+	RuntimeAppendState		   *scan_state = (RuntimeAppendState *) node;
+	RuntimeAppendSharedState   *pstate = (RuntimeAppendSharedState *) coordinate;
+	CustomScan				   *cscan = (CustomScan *) node->ss.ps.plan;
+
+	if (scan_state->children_table)
+		hash_destroy(scan_state->children_table);
+
+	if (scan_state->initial_parts)
+		pfree(scan_state->initial_parts);
+
+	/* Scan exactly the same partitions as the leader does */
+	scan_state->initial_pruning = true;
+	scan_state->ninitial_parts = pstate->nparts;
+	scan_state->initial_parts = (Oid *) palloc(Max(pstate->nparts, 1) * sizeof(Oid));
+	memcpy(scan_state->initial_parts, pstate->parts, pstate->nparts * sizeof(Oid));
+
+	build_children_table(scan_state, cscan,
+						 scan_state->initial_parts,
+						 scan_state->ninitial_parts);
+
+	/* Plan states have to match the leader's ones */
+	scan_state->pstate = pstate;
+	rescan_append_common(node, false);
+}
+#endif
@@ -12,6 +12,7 @@
 #define NODES_COMMON_H
 
 #include "relation_info.h"
+#include "rangeset.h"
 
 #include "postgres.h"
 #include "commands/explain.h"
@@ -41,7 +42,7 @@ typedef struct
 		PlanState  *plan_state;
 	}			content;
 
-	int			original_order;		/* for sorting in EXPLAIN */
+	int			original_order;		/* position among subpaths (scan order) */
 } ChildScanCommonData;
 
 typedef ChildScanCommonData *ChildScanCommon;
@@ -64,9 +65,11 @@ List * get_partitioned_attr_clauses(List *restrictinfo_list,
 									const PartRelationInfo *prel,
 									Index partitioned_rel);
 
-Oid * get_partition_oids(List *ranges, int *n, const PartRelationInfo *prel,
+Oid * get_partition_oids(RangeSet *ranges, int *n, const PartRelationInfo *prel,
 						 bool include_parent);
 
+void defer_partition_locks(List *rtable, Plan *plan);
+
 Path * create_append_path_common(PlannerInfo *root,
 								 AppendPath *inner_append,
 								 ParamPathInfo *param_info,
@@ -90,10 +93,20 @@ TupleTableSlot * exec_append_common(CustomScanState *node,
 
 void end_append_common(CustomScanState *node);
 
-void rescan_append_common(CustomScanState *node);
+void prepare_child_plan_state(CustomScanState *node, ChildScanCommon child);
+
+void rescan_append_common(CustomScanState *node, bool lazy);
 
 void explain_append_common(CustomScanState *node,
 						   HTAB *children_table,
 						   ExplainState *es);
 
+#if PG_VERSION_NUM >= 90600
+Size estimate_append_dsm_common(CustomScanState *node);
+
+void initialize_append_dsm_common(CustomScanState *node, void *coordinate);
+
+void initialize_append_worker_common(CustomScanState *node, void *coordinate);
+#endif
+
 #endif
@@ -27,6 +27,13 @@ CustomExecMethods	partition_filter_exec_methods;
 
 static List * pfilter_build_tlist(List *tlist);
 static ResultRelInfo * getResultRelInfo(Oid partid, PartitionFilterState *state);
+static ExprState * get_key_expr_state(Oid parent,
+									  const PartRelationInfo *prel,
+									  PartitionFilterState *state);
+static Oid select_partition_for_insert(Oid parent,
+									   const PartRelationInfo *prel,
+									   TupleTableSlot *slot,
+									   PartitionFilterState *state);
 
 void
 init_partition_filter_static_data(void)
@@ -116,6 +123,7 @@ partition_filter_begin(CustomScanState *node, EState *estate, int eflags)
 
 	HTAB	   *result_rels_table;
 	HASHCTL	   *result_rels_table_config = &state->result_rels_table_config;
+	HASHCTL	   *key_expr_states_config = &state->key_expr_states_config;
 
 	node->custom_ps = list_make1(ExecInitNode(state->subplan, estate, eflags));
 	state->savedRelInfo = NULL;
@@ -129,16 +137,21 @@ partition_filter_begin(CustomScanState *node, EState *estate, int eflags)
 									HASH_ELEM | HASH_BLOBS);
 
 	state->result_rels_table = result_rels_table;
+
+	memset(key_expr_states_config, 0, sizeof(HASHCTL));
+	key_expr_states_config->keysize = sizeof(Oid);
+	key_expr_states_config->entrysize = sizeof(KeyExprStateHolder);
+
+	state->key_expr_states = hash_create("Partitioning expression states", 10,
+										 key_expr_states_config,
+										 HASH_ELEM | HASH_BLOBS);
+
 	state->warning_triggered = false;
 }
 
 TupleTableSlot *
 partition_filter_exec(CustomScanState *node)
 {
-#define CopyToTempConst(const_field, attr_field) \
-	( state->temp_const.const_field = \
-		slot->tts_tupleDescriptor->attrs[prel->attnum - 1]->attr_field )
-
 	PartitionFilterState   *state = (PartitionFilterState *) node;
 
 	ExprContext			   *econtext = node->ss.ps.ps_ExprContext;
@@ -157,16 +170,8 @@ partition_filter_exec(CustomScanState *node)
 		const PartRelationInfo *prel;
 
 		MemoryContext			old_cxt;
-
-		List				   *ranges;
-		int						nparts;
-		Oid					   *parts;
 		Oid						selected_partid;
 
-		WalkerContext			wcxt;
-		bool					isnull;
-		Datum					value;
-
 		/* Fetch PartRelationInfo for this partitioned relation */
 		prel = get_pathman_relation_info(state->partitioned_table);
 		if (!prel)
@@ -179,6 +184,99 @@ partition_filter_exec(CustomScanState *node)
 			return slot;
 		}
 
+		/* Switch to per-tuple context */
+		old_cxt = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+
+		selected_partid = select_partition_for_insert(state->partitioned_table,
+													  prel, slot, state);
+
+		/*
+		 * Selected partition might be partitioned as well (e.g. RANGE
+		 * partition split by HASH), descend until we reach a leaf.
+		 */
+		while ((prel = get_pathman_relation_info(selected_partid)) != NULL)
+			selected_partid = select_partition_for_insert(selected_partid,
+														  prel, slot, state);
+
+		/* Switch back and clean up per-tuple context */
+		MemoryContextSwitchTo(old_cxt);
+		ResetExprContext(econtext);
+
+		/* Replace parent table with a suitable partition */
+		old_cxt = MemoryContextSwitchTo(estate->es_query_cxt);
+		estate->es_result_relation_info = getResultRelInfo(selected_partid, state);
+		MemoryContextSwitchTo(old_cxt);
+
+		return slot;
+	}
+
+	return NULL;
+}
+
+/*
+ * Find a partition of 'parent' for the tuple stored in 'slot'.
+ * NOTE: partitions are expected to share the parent's attribute numbers.
+ */
+static Oid
+select_partition_for_insert(Oid parent, const PartRelationInfo *prel,
+							TupleTableSlot *slot, PartitionFilterState *state)
+{
+#define CopyToTempConst(const_field, attr_field) \
+	( state->temp_const.const_field = \
+		slot->tts_tupleDescriptor->attrs[prel->attnum - 1]->attr_field )
+
+	ExprContext	   *econtext = state->css.ss.ps.ps_ExprContext;
+	RangeSet	   *ranges;
+	int				nparts;
+	Oid			   *parts;
+	Oid				selected_partid;
+	WalkerContext	wcxt;
+	bool			isnull;
+	Datum			value;
+
+	/* Composite HASH key: hash all columns at once */
+	if (PrelHasCompositeKey(prel))
+	{
+		Datum	values[PART_MAX_KEY_ATTS];
+		int		i;
+
+		for (i = 0; i < prel->key_natts; i++)
+		{
+			values[i] = slot_getattr(slot, prel->key_attnums[i], &isnull);
+
+			if (isnull)
+				elog(ERROR, "Partitioning key column \"%s\" contains NULL value",
+					 get_attname(parent, prel->key_attnums[i]));
+		}
+
+		return PrelGetChildrenArray(prel)[composite_key_part_index(prel, values)];
+	}
+
+	/* Partitioning expression: compute its value for this tuple */
+	if (PrelHasKeyExpression(prel))
+	{
+		ExprState	   *keystate = get_key_expr_state(parent, prel, state);
+		TupleTableSlot *saved_scantuple = econtext->ecxt_scantuple;
+
+		econtext->ecxt_scantuple = slot;
+		value = ExecEvalExpr(keystate, econtext, &isnull, NULL);
+		econtext->ecxt_scantuple = saved_scantuple;
+
+		if (isnull)
+			elog(ERROR, "Partitioning expression of \"%s\" returned NULL",
+				 get_rel_name_or_relid(parent));
+
+		state->temp_const.constvalue = value;
+		state->temp_const.constisnull = false;
+
+		state->temp_const.consttype = prel->atttype;
+		state->temp_const.consttypmod = prel->atttypmod;
+		state->temp_const.constcollid = prel->attcollid;
+		state->temp_const.constlen = prel->attlen;
+		state->temp_const.constbyval = prel->attbyval;
+	}
+	else
+	{
 		/* Extract partitioned column value */
 		value = slot_getattr(slot, prel->attnum, &isnull);
 
@@ -192,54 +290,44 @@ partition_filter_exec(CustomScanState *node)
 		CopyToTempConst(constcollid, attcollation);
 		CopyToTempConst(constlen,    attlen);
 		CopyToTempConst(constbyval,  attbyval);
+	}
 
-		InitWalkerContext(&wcxt, prel, econtext, true);
-
-		/* Switch to per-tuple context */
-		old_cxt = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
+	InitWalkerContext(&wcxt, prel, econtext, true);
 
-		ranges = walk_expr_tree((Expr *) &state->temp_const, &wcxt)->rangeset;
-		parts = get_partition_oids(ranges, &nparts, prel, false);
+	ranges = walk_expr_tree((Expr *) &state->temp_const, &wcxt)->rangeset;
+	parts = get_partition_oids(ranges, &nparts, prel, false);
 
-		if (nparts > 1)
-			elog(ERROR, "PartitionFilter selected more than one partition");
-		else if (nparts == 0)
+	if (nparts > 1)
+		elog(ERROR, "PartitionFilter selected more than one partition");
+	else if (nparts == 0)
+	{
+		/*
+		 * Route tuple to the default partition if there's one,
+		 * else if auto partition propagation is enabled then
+		 * try to create new partitions for the key (RANGE only)
+		 */
+		if (PrelHasDefaultPart(prel))
+			selected_partid = prel->default_part;
+		else if (prel->parttype == PT_RANGE &&
+				 prel->auto_partition && IsAutoPartitionEnabled())
 		{
-			/*
-			 * If auto partition propagation is enabled then try to create
-			 * new partitions for the key
-			 */
-			if (prel->auto_partition && IsAutoPartitionEnabled())
-			{
-				selected_partid = create_partitions(state->partitioned_table,
-													state->temp_const.constvalue,
-													state->temp_const.consttype);
-
-				/* get_pathman_relation_info() will refresh this entry */
-				invalidate_pathman_relation_info(state->partitioned_table, NULL);
-			}
-			else
-				elog(ERROR,
-					 "There is no suitable partition for key '%s'",
-					 datum_to_cstring(state->temp_const.constvalue,
-									  state->temp_const.consttype));
+			selected_partid = create_partitions(parent,
+												state->temp_const.constvalue,
+												state->temp_const.consttype);
+
+			/* get_pathman_relation_info() will refresh this entry */
+			invalidate_pathman_relation_info(parent, NULL);
 		}
 		else
-			selected_partid = parts[0];
-
-		/* Switch back and clean up per-tuple context */
-		MemoryContextSwitchTo(old_cxt);
-		ResetExprContext(econtext);
-
-		/* Replace parent table with a suitable partition */
-		old_cxt = MemoryContextSwitchTo(estate->es_query_cxt);
-		estate->es_result_relation_info = getResultRelInfo(selected_partid, state);
-		MemoryContextSwitchTo(old_cxt);
-
-		return slot;
+			elog(ERROR,
+				 "There is no suitable partition for key '%s'",
+				 datum_to_cstring(state->temp_const.constvalue,
+								  state->temp_const.consttype));
 	}
+	else
+		selected_partid = parts[0];
 
-	return NULL;
+	return selected_partid;
 }
 
 void
@@ -259,6 +347,7 @@ partition_filter_end(CustomScanState *node)
 				   RowExclusiveLock);
 	}
 	hash_destroy(state->result_rels_table);
+	hash_destroy(state->key_expr_states);
 
 	Assert(list_length(node->custom_ps) == 1);
 	ExecEndNode((PlanState *) linitial(node->custom_ps));
@@ -278,6 +367,34 @@ partition_filter_explain(CustomScanState *node, List *ancestors, ExplainState *e
 }
 
 
+/*
+ * Prepare partitioning expression of 'parent' once per query
+ * (we're called in per-tuple context, which is reset afterwards).
+ */
+static ExprState *
+get_key_expr_state(Oid parent, const PartRelationInfo *prel,
+				   PartitionFilterState *state)
+{
+	KeyExprStateHolder *holder;
+	bool				found;
+
+	holder = hash_search(state->key_expr_states,
+						 (const void *) &parent,
+						 HASH_ENTER, &found);
+
+	if (!found)
+	{
+		MemoryContext old_cxt;
+
+		/* PartRelationInfo might be invalidated, so copy the expression */
+		old_cxt = MemoryContextSwitchTo(state->css.ss.ps.state->es_query_cxt);
+		holder->keystate = ExecInitExpr((Expr *) copyObject(prel->key_expr), NULL);
+		MemoryContextSwitchTo(old_cxt);
+	}
+
+	return holder->keystate;
+}
+
 /*
  * Construct ResultRelInfo for a partition.
  */
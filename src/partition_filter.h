@@ -25,6 +25,12 @@ typedef struct
 	ResultRelInfo	   *resultRelInfo;
 } ResultRelInfoHolder;
 
+typedef struct
+{
+	Oid					relid;			/* partitioned table */
+	ExprState		   *keystate;		/* its partitioning expression */
+} KeyExprStateHolder;
+
 typedef struct
 {
 	CustomScanState		css;
@@ -39,6 +45,10 @@ typedef struct
 	HTAB			   *result_rels_table;
 	HASHCTL				result_rels_table_config;
 
+	/* Partitioning expressions prepared for this query */
+	HTAB			   *key_expr_states;
+	HASHCTL				key_expr_states_config;
+
 	bool				warning_triggered;
 } PartitionFilterState;
 
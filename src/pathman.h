@@ -29,6 +29,15 @@
 	#warning "It is STRONGLY recommended to use pg_pathman with PostgreSQL 9.5.4 since it contains important fixes"
 #endif
 
+/* Since 9.6 create_append_path() takes the number of parallel workers */
+#if PG_VERSION_NUM >= 90600
+	#define create_append_path_compat(rel, subpaths, required_outer, parallel_workers) \
+		create_append_path((rel), (subpaths), (required_outer), (parallel_workers))
+#else
+	#define create_append_path_compat(rel, subpaths, required_outer, parallel_workers) \
+		create_append_path((rel), (subpaths), (required_outer))
+#endif
+
 /* Get CString representation of Datum (simple wrapper) */
 #ifdef USE_ASSERT_CHECKING
 	#include "utils.h"
@@ -55,10 +64,12 @@
  * Definitions for the "pathman_config_params" table
  */
 #define PATHMAN_CONFIG_PARAMS						"pathman_config_params"
-#define Natts_pathman_config_params					3
+#define Natts_pathman_config_params					5
 #define Anum_pathman_config_params_partrel			1	/* primary key */
 #define Anum_pathman_config_params_enable_parent	2	/* include parent into plan */
 #define Anum_pathman_config_params_auto				3	/* auto partitions creation */
+#define Anum_pathman_config_params_default			4	/* default partition (regclass) */
+#define Anum_pathman_config_params_monotonic		5	/* key expression is monotonic */
 
 /*
  * Cache current PATHMAN_CONFIG relid (set during load_config()).
@@ -108,6 +119,16 @@ extern List			   *inheritance_disabled_relids;
  */
 extern PathmanState    *pmstate;
 
+/*
+ * Should GROUP BY be performed partition by partition (if possible)?
+ */
+extern bool				pg_pathman_enable_partitionwise_agg;
+
+/*
+ * Should joins of equally partitioned tables be performed partition by partition?
+ */
+extern bool				pg_pathman_enable_partitionwise_join;
+
 
 int append_child_relation(PlannerInfo *root, RelOptInfo *rel, Index rti,
 						  RangeTblEntry *rte, int index, Oid childOID, List *wrappers);
@@ -118,6 +139,11 @@ search_rangerel_result search_range_partition_eq(const Datum value,
 												 RangeEntry *out_re);
 
 uint32 hash_to_part_index(uint32 value, uint32 partitions);
+uint32 combine_hash_values(uint32 hash1, uint32 hash2);
+uint32 composite_key_part_index(const PartRelationInfo *prel,
+								const Datum *values);
+RangeSet *select_composite_hash_partitions(const PartRelationInfo *prel,
+										   Index varno, List *clauses);
 
 void handle_modification_query(Query *parse);
 void disable_inheritance(Query *parse);
@@ -131,12 +157,32 @@ void set_append_rel_pathlist(PlannerInfo *root, RelOptInfo *rel, Index rti,
 							 RangeTblEntry *rte, PathKey *pathkeyAsc,
 							 PathKey *pathkeyDesc);
 
+#if PG_VERSION_NUM >= 90600
+void add_partitionwise_agg_paths(PlannerInfo *root, RelOptInfo *input_rel,
+								 RelOptInfo *grouped_rel,
+								 const PartRelationInfo *prel);
+void add_partitionwise_join_paths(PlannerInfo *root, RelOptInfo *joinrel,
+								  RelOptInfo *outerrel, RelOptInfo *innerrel,
+								  JoinType jointype, JoinPathExtraData *extra);
+#endif
+
+/*
+ * Key values which might satisfy an expression but
+ * are not covered by any RANGE partition (see 'uncovered').
+ */
+#define UNCOVERED_NONE		0x00
+#define UNCOVERED_BELOW		0x01	/* values below the first partition */
+#define UNCOVERED_ABOVE		0x02	/* values above the last partition */
+#define UNCOVERED_GAP		0x04	/* values between two partitions */
+#define UNCOVERED_ALL		( UNCOVERED_BELOW | UNCOVERED_ABOVE | UNCOVERED_GAP )
+
 typedef struct
 {
 	const Node			   *orig;		/* examined expression */
 	List				   *args;		/* extracted from 'orig' */
-	List				   *rangeset;	/* IndexRanges representing selected parts */
+	RangeSet			   *rangeset;	/* IndexRanges representing selected parts */
 	bool					found_gap;	/* were there any gaps? */
+	int						uncovered;	/* UNCOVERED_* flags (for default part.) */
 	double					paramsel;	/* estimated selectivity */
 } WrapperNode;
 
@@ -145,6 +191,7 @@ typedef struct
 	const PartRelationInfo *prel;		/* main partitioning structure */
 	ExprContext			   *econtext;	/* for ExecEvalExpr() */
 	bool					for_insert;	/* are we in PartitionFilter now? */
+	bool					planning;	/* 'econtext' belongs to planner */
 } WalkerContext;
 
 /*
@@ -155,6 +202,7 @@ typedef struct
 		(context)->prel = (prel_info); \
 		(context)->econtext = (ecxt); \
 		(context)->for_insert = (for_ins); \
+		(context)->planning = false; \
 	} while (0)
 
 /* Check that WalkerContext contains ExprContext (plan execution stage) */
@@ -169,11 +217,18 @@ Oid create_partitions_internal(Oid relid, Datum value, Oid value_type);
 
 void select_range_partitions(const Datum value,
 							 FmgrInfo *cmp_func,
+							 const Oid collid,
 							 const RangeEntry *ranges,
 							 const int nranges,
 							 const int strategy,
 							 WrapperNode *result);
 
+void select_list_partitions(const Datum value,
+							FmgrInfo *cmp_func,
+							const PartRelationInfo *prel,
+							const int strategy,
+							WrapperNode *result);
+
 /* Examine expression in order to select partitions. */
 WrapperNode *walk_expr_tree(Expr *expr, WalkerContext *context);
 
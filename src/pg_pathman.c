@@ -24,23 +24,32 @@
 #include "access/transam.h"
 #include "access/xact.h"
 #include "catalog/pg_cast.h"
+#include "catalog/pg_opfamily.h"
+#include "catalog/pg_operator.h"
 #include "catalog/pg_type.h"
+#include "executor/nodeAgg.h"
 #include "executor/spi.h"
 #include "foreign/fdwapi.h"
 #include "fmgr.h"
 #include "miscadmin.h"
 #include "optimizer/clauses.h"
+#include "optimizer/planmain.h"
 #include "optimizer/prep.h"
 #include "optimizer/restrictinfo.h"
 #include "optimizer/cost.h"
+#include "optimizer/tlist.h"
+#include "optimizer/var.h"
 #include "utils/builtins.h"
 #include "utils/datum.h"
+#include "utils/fmgroids.h"
 #include "utils/lsyscache.h"
 #include "utils/memutils.h"
+#include "utils/pg_locale.h"
 #include "utils/rel.h"
 #include "utils/syscache.h"
 #include "utils/selfuncs.h"
 #include "utils/snapmgr.h"
+#include "utils/timestamp.h"
 #include "utils/typcache.h"
 
 
@@ -52,6 +61,25 @@ List		   *inheritance_enabled_relids = NIL;
 PathmanState   *pmstate;
 Oid				pathman_config_relid = InvalidOid;
 Oid				pathman_config_params_relid = InvalidOid;
+bool			pg_pathman_enable_partitionwise_agg = true;
+bool			pg_pathman_enable_partitionwise_join = true;
+
+
+/* Bound of the partitioning key found among arguments of AND */
+typedef struct
+{
+	const OpExpr   *expr;		/* "KEY OP VALUE" clause */
+	Node		   *value;		/* VALUE (see IsConstValue) */
+	int				strategy;	/* btree strategy of OP */
+	int				argno;		/* position among arguments of AND */
+} RangeBound;
+
+/* Argument of cmp_array_values() */
+typedef struct
+{
+	FmgrInfo	   *cmp_func;	/* element type's comparison function */
+	Oid				collid;		/* collation of the partitioning key */
+} ArrayCmpContext;
 
 
 /* pg module functions */
@@ -82,8 +110,34 @@ static void handle_binary_opexpr_param(const PartRelationInfo *prel, WrapperNode
 static WrapperNode *handle_opexpr(const OpExpr *expr, WalkerContext *context);
 static WrapperNode *handle_boolexpr(const BoolExpr *expr, WalkerContext *context);
 static WrapperNode *handle_arrexpr(const ScalarArrayOpExpr *expr, WalkerContext *context);
+static WrapperNode *handle_nulltest(const NullTest *expr, WalkerContext *context);
+static bool is_key_not_null(const PartRelationInfo *prel);
+static bool is_never_null(WalkerContext *context, const Node *node);
+static bool find_range_bounds(const BoolExpr *expr, WalkerContext *context,
+							  RangeBound *lower, RangeBound *upper);
+static bool get_range_bound(WalkerContext *context, Node *clause, RangeBound *bound);
+static RangeSet *handle_range_bounds(WalkerContext *context,
+									 const RangeBound *lower, const RangeBound *upper,
+									 WrapperNode **lower_wrap, WrapperNode **upper_wrap);
+static void handle_range_arrexpr(const PartRelationInfo *prel, WrapperNode *result,
+								 const ScalarArrayOpExpr *expr, const Node *varnode,
+								 Oid elemtype, const Datum *elem_values,
+								 const bool *elem_nulls, int num_elems);
+static void select_range_partitions_sorted(const Datum *values, int nvalues,
+										   FmgrInfo *cmp_func,
+										   const PartRelationInfo *prel,
+										   WrapperNode *result);
+static int cmp_array_values(const void *p1, const void *p2, void *arg);
 static RestrictInfo *rebuild_restrictinfo(Node *clause, RestrictInfo *old_rinfo);
 static bool pull_var_param(const WalkerContext *ctx, const OpExpr *expr, Node **var_ptr, Node **param_ptr);
+static bool is_key_column(const PartRelationInfo *prel, const Node *node);
+static bool match_key_expression(const PartRelationInfo *prel, const Node *node);
+static bool is_key_cast(const PartRelationInfo *prel, const Node *node);
+static bool is_stable_value(const WalkerContext *wcxt, Node *node);
+static void handle_key_column_opexpr(WalkerContext *context, WrapperNode *result, const Node *varnode, const Const *c);
+static void handle_like_opexpr(WalkerContext *context, WrapperNode *result, const Const *c);
+static Const *eval_key_expression(const PartRelationInfo *prel, const Const *c);
+static Node *replace_key_column_mutator(Node *node, void *context);
 
 /* copied from allpaths.h */
 static void set_plain_rel_size(PlannerInfo *root, RelOptInfo *rel,
@@ -96,6 +150,28 @@ static void generate_mergeappend_paths(PlannerInfo *root, RelOptInfo *rel,
 						   PathKey *pathkeyAsc,
 						   PathKey *pathkeyDesc);
 static Path *get_cheapest_parameterized_child_path(PlannerInfo *root, RelOptInfo *rel, Relids required_outer);
+#if PG_VERSION_NUM >= 90600
+static void create_plain_partial_paths(PlannerInfo *root, RelOptInfo *rel);
+static bool groups_fit_partitions(PlannerInfo *root, const PartRelationInfo *prel);
+static bool hashagg_fits_work_mem(Path *input_path, const AggClauseCosts *agg_costs,
+								  double num_groups);
+static Path *create_child_projection_path(PlannerInfo *root, RelOptInfo *childrel,
+										  Path *subpath, PathTarget *target);
+static PathTarget *make_partial_agg_target(PlannerInfo *root, PathTarget *grouping_target);
+static bool is_aligned_date_trunc(const PartRelationInfo *prel, const Node *node);
+static bool partitions_are_equal(const PartRelationInfo *prel1,
+								 const PartRelationInfo *prel2);
+static bool is_key_equijoin_clause(RestrictInfo *rinfo,
+								   const PartRelationInfo *outer_prel, Index outer_relid,
+								   const PartRelationInfo *inner_prel, Index inner_relid);
+static bool is_rel_key_column(const PartRelationInfo *prel, Index relid, Node *node);
+static AppendRelInfo **get_partition_appinfos(PlannerInfo *root, Index parent_relid,
+											  const PartRelationInfo *prel);
+static Path *create_partition_join_path(PlannerInfo *root, RelOptInfo *joinrel,
+										AppendRelInfo *outer_appinfo,
+										AppendRelInfo *inner_appinfo,
+										JoinPathExtraData *extra);
+#endif
 
 
 /*
@@ -115,12 +191,19 @@ static Path *get_cheapest_parameterized_child_path(PlannerInfo *root, RelOptInfo
 #define check_gt(finfo, arg1, arg2) \
 	((int) FunctionCall2(finfo, arg1, arg2) > 0)
 
-/* We can transform Param into Const provided that 'econtext' is available */
+/*
+ * We can transform Param or stable expression (e.g. now()) into Const
+ * provided that 'econtext' is available. Planner can't evaluate Params.
+ */
 #define IsConstValue(wcxt, node) \
-	( IsA((node), Const) || (WcxtHasExprContext(wcxt) ? IsA((node), Param) : false) )
+	( IsA((node), Const) || \
+	  (WcxtHasExprContext(wcxt) ? \
+		  (IsA((node), Param) ? !(wcxt)->planning : \
+								is_stable_value((wcxt), (node))) : \
+		  false) )
 
 #define ExtractConst(wcxt, node) \
-	( IsA((node), Param) ? extract_const((wcxt), (Param *) (node)) : ((Const *) (node)) )
+	( IsA((node), Const) ? ((Const *) (node)) : extract_const((wcxt), (Expr *) (node)) )
 
 
 /*
@@ -161,6 +244,10 @@ _PG_init(void)
 	post_parse_analyze_hook			= pathman_post_parse_analysis_hook;
 	planner_hook_next				= planner_hook;
 	planner_hook					= pathman_planner_hook;
+#if PG_VERSION_NUM >= 90600
+	create_upper_paths_hook_next	= create_upper_paths_hook;
+	create_upper_paths_hook			= pathman_upper_paths_hook;
+#endif
 
 	/* Initialize static data for all subsystems */
 	init_main_pathman_toggle();
@@ -303,7 +390,7 @@ void
 handle_modification_query(Query *parse)
 {
 	const PartRelationInfo *prel;
-	List				   *ranges;
+	RangeSet			   *ranges;
 	RangeTblEntry		   *rte;
 	WrapperNode			   *wrap;
 	Expr				   *expr;
@@ -320,7 +407,7 @@ handle_modification_query(Query *parse)
 		return;
 
 	/* Parse syntax tree and extract partition ranges */
-	ranges = list_make1_irange(make_irange(0, PrelLastChild(prel), false));
+	ranges = rangeset_make1(make_irange(0, PrelLastChild(prel), false));
 	expr = (Expr *) eval_const_expressions(NULL, parse->jointree->quals);
 	if (!expr)
 		return;
@@ -329,17 +416,35 @@ handle_modification_query(Query *parse)
 	InitWalkerContext(&context, prel, NULL, false);
 	wrap = walk_expr_tree(expr, &context);
 
-	ranges = irange_list_intersect(ranges, wrap->rangeset);
+	ranges = rangeset_intersect(ranges, wrap->rangeset);
+
+	/* Composite HASH key is handled by all clauses at once */
+	if (PrelHasCompositeKey(prel))
+		ranges = rangeset_intersect(ranges,
+									select_composite_hash_partitions(prel,
+																	 parse->resultRelation,
+																	 make_ands_implicit(expr)));
+
+	/* Default partition might be affected as well, give up */
+	if (PrelHasDefaultPart(prel) && wrap->uncovered != UNCOVERED_NONE)
+		return;
 
 	/* If only one partition is affected then substitute parent table with partition */
-	if (irange_list_length(ranges) == 1)
+	if (rangeset_length(ranges) == 1)
 	{
-		IndexRange irange = linitial_irange(ranges);
+		IndexRange irange = rangeset_first(ranges);
 		if (irange.ir_lower == irange.ir_upper)
 		{
 			Oid *children = PrelGetChildrenArray(prel);
 			rte->relid = children[irange.ir_lower];
 			rte->inh = false;
+
+			/* Partition might be partitioned as well, try to go deeper */
+			if (get_pathman_relation_info(rte->relid) != NULL)
+			{
+				rte->inh = true;
+				handle_modification_query(parse);
+			}
 		}
 	}
 
@@ -370,6 +475,10 @@ set_append_rel_size(PlannerInfo *root, RelOptInfo *rel,
 		childrel = find_base_rel(root, childRTindex);
 		Assert(childrel->reloptkind == RELOPT_OTHER_MEMBER_REL);
 
+		/* Sub-partitioned child might have no partitions left */
+		if (IS_DUMMY_REL(childrel))
+			continue;
+
 		/*
 		 * Accumulate size information from each live child.
 		 */
@@ -447,11 +556,11 @@ append_child_relation(PlannerInfo *root, RelOptInfo *rel, Index rti,
 		   (rel->max_attr - rel->min_attr + 1) * sizeof(int32));
 
 	/*
-	 * Copy restrictions. If it's not the parent table then copy only those
-	 * restrictions that reference to this partition
+	 * Copy restrictions. If it's a partition selected using 'wrappers'
+	 * then copy only those restrictions that reference to this partition
 	 */
 	childrel->baserestrictinfo = NIL;
-	if (rte->relid != childOid)
+	if (wrappers != NIL)
 	{
 		forboth(lc, wrappers, lc2, rel->baserestrictinfo)
 		{
@@ -492,7 +601,7 @@ append_child_relation(PlannerInfo *root, RelOptInfo *rel, Index rti,
 			}
 		}
 	}
-	/* If it's the parent table then copy all restrictions */
+	/* If it's the parent table (or default partition) then copy all restrictions */
 	else
 	{
 		foreach(lc, rel->baserestrictinfo)
@@ -554,7 +663,8 @@ append_child_relation(PlannerInfo *root, RelOptInfo *rel, Index rti,
 		child_rowmark = makeNode(PlanRowMark);
 
 		child_rowmark->rti = childRTindex;
-		child_rowmark->prti = rti;
+		/* Point to the topmost parent (partition might be a parent too) */
+		child_rowmark->prti = parent_rowmark->prti;
 		child_rowmark->rowmarkId = parent_rowmark->rowmarkId;
 		/* Reselect rowmark type, because relkind might not match parent */
 		child_rowmark->markType = select_rowmark_type(childrte,
@@ -599,7 +709,7 @@ wrapper_make_expression(WrapperNode *wrap, int index, bool *alwaysTrue)
 	 * TODO: use faster algorithm using knowledge that we enumerate indexes
 	 * sequntially.
 	 */
-	found = irange_list_find(wrap->rangeset, index, &lossy);
+	found = rangeset_find(wrap->rangeset, index, &lossy);
 
 	/* Return NULL for always true and always false. */
 	if (!found)
@@ -670,6 +780,7 @@ walk_expr_tree(Expr *expr, WalkerContext *context)
 	BoolExpr		   *boolexpr;
 	OpExpr			   *opexpr;
 	ScalarArrayOpExpr  *arrexpr;
+	NullTest		   *nulltest;
 	WrapperNode		   *result;
 
 	switch (expr->type)
@@ -693,12 +804,18 @@ walk_expr_tree(Expr *expr, WalkerContext *context)
 			arrexpr = (ScalarArrayOpExpr *) expr;
 			return handle_arrexpr(arrexpr, context);
 
+		/* IS [NOT] NULL */
+		case T_NullTest:
+			nulltest = (NullTest *) expr;
+			return handle_nulltest(nulltest, context);
+
 		default:
 			result = (WrapperNode *) palloc(sizeof(WrapperNode));
 			result->orig = (const Node *) expr;
 			result->args = NIL;
-			result->rangeset = list_make1_irange(
+			result->rangeset = rangeset_make1(
 						make_irange(0, PrelLastChild(context->prel), true));
+			result->uncovered = UNCOVERED_ALL;
 			result->paramsel = 1.0;
 			return result;
 	}
@@ -1007,6 +1124,7 @@ create_partitions(Oid relid, Datum value, Oid value_type)
 void
 select_range_partitions(const Datum value,
 						FmgrInfo *cmp_func,
+						const Oid collid,
 						const RangeEntry *ranges,
 						const int nranges,
 						const int strategy,
@@ -1034,7 +1152,8 @@ select_range_partitions(const Datum value,
 	/* Check boundaries */
 	if (nranges == 0)
 	{
-		result->rangeset = NIL;
+		result->rangeset = NULL;
+		result->uncovered = UNCOVERED_ALL;
 		return;
 	}
 	else
@@ -1043,14 +1162,43 @@ select_range_partitions(const Datum value,
 		Assert(cmp_func);
 
 		/* Corner cases */
-		cmp_min = FunctionCall2(cmp_func, value, ranges[startidx].min),
-		cmp_max = FunctionCall2(cmp_func, value, ranges[endidx].max);
+		cmp_min = FunctionCall2Coll(cmp_func, collid, value, ranges[startidx].min),
+		cmp_max = FunctionCall2Coll(cmp_func, collid, value, ranges[endidx].max);
+
+		/* Which values beyond the first\last partition might be selected? */
+		switch (strategy)
+		{
+			case BTLessStrategyNumber:
+				result->uncovered = UNCOVERED_BELOW |
+									(cmp_max > 0 ? UNCOVERED_ABOVE : 0);
+				break;
+
+			case BTLessEqualStrategyNumber:
+				result->uncovered = UNCOVERED_BELOW |
+									(cmp_max >= 0 ? UNCOVERED_ABOVE : 0);
+				break;
+
+			case BTEqualStrategyNumber:
+				result->uncovered = (cmp_min < 0 ? UNCOVERED_BELOW : 0) |
+									(cmp_max >= 0 ? UNCOVERED_ABOVE : 0);
+				break;
+
+			case BTGreaterEqualStrategyNumber:
+			case BTGreaterStrategyNumber:
+				result->uncovered = UNCOVERED_ABOVE |
+									(cmp_min < 0 ? UNCOVERED_BELOW : 0);
+				break;
+
+			default:
+				result->uncovered = UNCOVERED_ALL;
+				break;
+		}
 
 		if ((cmp_min <= 0 && strategy == BTLessStrategyNumber) ||
 			(cmp_min < 0 && (strategy == BTLessEqualStrategyNumber ||
 							 strategy == BTEqualStrategyNumber)))
 		{
-			result->rangeset = NIL;
+			result->rangeset = NULL;
 			return;
 		}
 
@@ -1058,21 +1206,21 @@ select_range_partitions(const Datum value,
 							 strategy == BTGreaterStrategyNumber ||
 							 strategy == BTEqualStrategyNumber))
 		{
-			result->rangeset = NIL;
+			result->rangeset = NULL;
 			return;
 		}
 
 		if ((cmp_min < 0 && strategy == BTGreaterStrategyNumber) ||
 			(cmp_min <= 0 && strategy == BTGreaterEqualStrategyNumber))
 		{
-			result->rangeset = list_make1_irange(make_irange(startidx, endidx, false));
+			result->rangeset = rangeset_make1(make_irange(startidx, endidx, false));
 			return;
 		}
 
 		if (cmp_max >= 0 && (strategy == BTLessEqualStrategyNumber ||
 							 strategy == BTLessStrategyNumber))
 		{
-			result->rangeset = list_make1_irange(make_irange(startidx, endidx, false));
+			result->rangeset = rangeset_make1(make_irange(startidx, endidx, false));
 			return;
 		}
 	}
@@ -1087,8 +1235,8 @@ select_range_partitions(const Datum value,
 
 		current_re = &ranges[i];
 
-		cmp_min = FunctionCall2(cmp_func, value, current_re->min);
-		cmp_max = FunctionCall2(cmp_func, value, current_re->max);
+		cmp_min = FunctionCall2Coll(cmp_func, collid, value, current_re->min);
+		cmp_max = FunctionCall2Coll(cmp_func, collid, value, current_re->max);
 
 		is_less = (cmp_min < 0 || (cmp_min == 0 && strategy == BTLessStrategyNumber));
 		is_greater = (cmp_max > 0 || (cmp_max >= 0 && strategy != BTLessStrategyNumber));
@@ -1110,8 +1258,9 @@ select_range_partitions(const Datum value,
 		/* If we still haven't found partition then it doesn't exist */
 		if (startidx >= endidx)
 		{
-			result->rangeset = NIL;
+			result->rangeset = NULL;
 			result->found_gap = true;
+			result->uncovered |= UNCOVERED_GAP;
 			return;
 		}
 
@@ -1133,39 +1282,40 @@ select_range_partitions(const Datum value,
 		case BTLessEqualStrategyNumber:
 			if (lossy)
 			{
-				result->rangeset = list_make1_irange(make_irange(i, i, true));
+				result->rangeset = NULL;
 				if (i > 0)
-					result->rangeset = lcons_irange(make_irange(0, i - 1, false),
-													result->rangeset);
+					result->rangeset = rangeset_make1(make_irange(0, i - 1, false));
+				result->rangeset = rangeset_append(result->rangeset,
+												   make_irange(i, i, true));
 			}
 			else
 			{
-				result->rangeset = list_make1_irange(make_irange(0, i, false));
+				result->rangeset = rangeset_make1(make_irange(0, i, false));
 			}
 			break;
 
 		case BTEqualStrategyNumber:
-			result->rangeset = list_make1_irange(make_irange(i, i, true));
+			result->rangeset = rangeset_make1(make_irange(i, i, true));
 			break;
 
 		case BTGreaterEqualStrategyNumber:
 		case BTGreaterStrategyNumber:
 			if (lossy)
 			{
-				result->rangeset = list_make1_irange(make_irange(i, i, true));
+				result->rangeset = rangeset_make1(make_irange(i, i, true));
 				if (i < nranges - 1)
 					result->rangeset =
-							lappend_irange(result->rangeset,
-										   make_irange(i + 1,
-													   nranges - 1,
-													   false));
+							rangeset_append(result->rangeset,
+											make_irange(i + 1,
+														nranges - 1,
+														false));
 			}
 			else
 			{
 				result->rangeset =
-						list_make1_irange(make_irange(i,
-													  nranges - 1,
-													  false));
+						rangeset_make1(make_irange(i,
+												   nranges - 1,
+												   false));
 			}
 			break;
 
@@ -1175,6 +1325,115 @@ select_range_partitions(const Datum value,
 	}
 }
 
+/*
+ * Find index of the first ListEntry which is greater than 'value'
+ * (or greater or equal, if 'inclusive' is false).
+ */
+static uint32
+list_entries_bound(const Datum value,
+				   FmgrInfo *cmp_func,
+				   const ListEntry *entries,
+				   const uint32 nentries,
+				   const bool inclusive)
+{
+	uint32	startidx = 0,
+			endidx = nentries;
+
+	while (startidx < endidx)
+	{
+		uint32	i = startidx + (endidx - startidx) / 2;
+		int		cmp = DatumGetInt32(FunctionCall2(cmp_func, value,
+												  entries[i].value));
+
+		if (cmp > 0 || (cmp == 0 && inclusive))
+			startidx = i + 1;
+		else
+			endidx = i;
+	}
+
+	return startidx;
+}
+
+/*
+ * Given sorted ListEntry array and 'value', return selected
+ * LIST partitions inside the WrapperNode.
+ */
+void
+select_list_partitions(const Datum value,
+					   FmgrInfo *cmp_func,
+					   const PartRelationInfo *prel,
+					   const int strategy,
+					   WrapperNode *result)
+{
+	const ListEntry	   *entries = PrelGetListArray(prel);
+	uint32				nentries = PrelListEntriesCount(prel),
+						first,
+						last,
+						i;
+	bool			   *selected;
+
+	result->found_gap = false;
+	result->rangeset = NULL;
+
+	switch (strategy)
+	{
+		case BTEqualStrategyNumber:
+			i = list_entries_bound(value, cmp_func, entries, nentries, false);
+
+			if (i < nentries &&
+				DatumGetInt32(FunctionCall2(cmp_func, value,
+											entries[i].value)) == 0)
+			{
+				uint32 idx = entries[i].child_idx;
+
+				result->rangeset = rangeset_make1(make_irange(idx, idx, true));
+				result->uncovered = UNCOVERED_NONE;
+			}
+			else
+			{
+				/* This value is not listed in any partition */
+				result->uncovered = UNCOVERED_GAP;
+			}
+
+			return;
+
+		case BTLessStrategyNumber:
+		case BTLessEqualStrategyNumber:
+			first = 0;
+			last = list_entries_bound(value, cmp_func, entries, nentries,
+									  strategy == BTLessEqualStrategyNumber);
+			break;
+
+		case BTGreaterEqualStrategyNumber:
+		case BTGreaterStrategyNumber:
+			first = list_entries_bound(value, cmp_func, entries, nentries,
+									   strategy == BTGreaterStrategyNumber);
+			last = nentries;
+			break;
+
+		default:
+			result->rangeset = rangeset_make1(make_irange(0,
+														  PrelLastChild(prel),
+														  true));
+			result->uncovered = UNCOVERED_ALL;
+			return;
+	}
+
+	/* Mark partitions containing values from [first, last) */
+	selected = palloc0(PrelChildrenCount(prel) * sizeof(bool));
+	for (i = first; i < last; i++)
+		selected[entries[i].child_idx] = true;
+
+	/* Build rangeset out of selected partitions */
+	result->rangeset = rangeset_from_flags(selected,
+										   PrelChildrenCount(prel),
+										   true);
+	pfree(selected);
+
+	/* Default partition might contain some other values */
+	result->uncovered = UNCOVERED_ALL;
+}
+
 /*
  * This function determines which partitions should appear in query plan.
  */
@@ -1184,44 +1443,73 @@ handle_binary_opexpr(WalkerContext *context, WrapperNode *result,
 {
 	int						strategy;
 	TypeCacheEntry		   *tce;
-	FmgrInfo				cmp_func;
+	FmgrInfo			   *cmp_func;
 	Oid						vartype;
 	const OpExpr		   *expr = (const OpExpr *) result->orig;
 	const PartRelationInfo *prel = context->prel;
 
-	Assert(IsA(varnode, Var) || IsA(varnode, RelabelType));
-
-	vartype = !IsA(varnode, RelabelType) ?
-			((Var *) varnode)->vartype :
-			((RelabelType *) varnode)->resulttype;
+	/* Var, RelabelType, partitioning expression or cast of the key */
+	vartype = exprType(varnode);
 
 	tce = lookup_type_cache(vartype, TYPECACHE_BTREE_OPFAMILY);
 	strategy = get_op_opfamily_strategy(expr->opno, tce->btree_opf);
-	fill_type_cmp_fmgr_info(&cmp_func, c->consttype, prel->atttype);
+	cmp_func = lookup_type_cmp_func(c->consttype, prel->atttype);
+
+	/* Pattern operators (e.g. "~>=~") agree with C collation's ordering */
+	if (strategy == 0 && prel->parttype == PT_RANGE &&
+		prel->atttype == TEXTOID && lc_collate_is_c(prel->attcollid))
+		strategy = get_op_opfamily_strategy(expr->opno,
+											TEXT_PATTERN_BTREE_FAM_OID);
 
 	switch (prel->parttype)
 	{
 		case PT_HASH:
-			if (strategy == BTEqualStrategyNumber)
+			/* Composite key needs all columns, see select_composite_hash_partitions() */
+			if (strategy == BTEqualStrategyNumber && !PrelHasCompositeKey(prel) &&
+				!is_key_cast(prel, varnode))
 			{
 				Datum	value = OidFunctionCall1(prel->hash_proc, c->constvalue);
 				uint32	idx = hash_to_part_index(DatumGetInt32(value),
 												 PrelChildrenCount(prel));
 
-				result->rangeset = list_make1_irange(make_irange(idx, idx, true));
+				result->rangeset = rangeset_make1(make_irange(idx, idx, true));
+				result->uncovered = UNCOVERED_NONE;
 
 				return; /* exit on equal */
 			}
 			break; /* continue to function's end */
 
 		case PT_RANGE:
+			/* Operator is not a btree comparison (e.g. "<>") */
+			if (strategy == 0 || !cmp_func)
+				break;
+
 			{
 				select_range_partitions(c->constvalue,
-										&cmp_func,
+										cmp_func,
+										prel->attcollid,
 										context->prel->ranges,
 										PrelChildrenCount(context->prel),
 										strategy,
 										result);
+
+				/* Inequality might also select values from gaps */
+				if (strategy != BTEqualStrategyNumber && prel->has_gaps)
+					result->uncovered |= UNCOVERED_GAP;
+
+				return;
+			}
+
+		case PT_LIST:
+			if (!cmp_func)
+				break;
+
+			{
+				select_list_partitions(c->constvalue,
+									   cmp_func,
+									   prel,
+									   strategy,
+									   result);
 				return;
 			}
 
@@ -1229,7 +1517,8 @@ handle_binary_opexpr(WalkerContext *context, WrapperNode *result,
 			elog(ERROR, "Unknown partitioning type %u", prel->parttype);
 	}
 
-	result->rangeset = list_make1_irange(make_irange(0, PrelLastChild(prel), true));
+	result->rangeset = rangeset_make1(make_irange(0, PrelLastChild(prel), true));
+	result->uncovered = UNCOVERED_ALL;
 	result->paramsel = 1.0;
 }
 
@@ -1245,17 +1534,15 @@ handle_binary_opexpr_param(const PartRelationInfo *prel,
 	int					strategy;
 	Oid					vartype;
 
-	Assert(IsA(varnode, Var) || IsA(varnode, RelabelType));
-
-	vartype = !IsA(varnode, RelabelType) ?
-			((Var *) varnode)->vartype :
-			((RelabelType *) varnode)->resulttype;
+	/* Var, RelabelType or partitioning expression */
+	vartype = exprType(varnode);
 
 	/* Determine operator type */
 	tce = lookup_type_cache(vartype, TYPECACHE_BTREE_OPFAMILY);
 	strategy = get_op_opfamily_strategy(expr->opno, tce->btree_opf);
 
-	result->rangeset = list_make1_irange(make_irange(0, PrelLastChild(prel), true));
+	result->rangeset = rangeset_make1(make_irange(0, PrelLastChild(prel), true));
+	result->uncovered = UNCOVERED_ALL;
 
 	if (strategy == BTEqualStrategyNumber)
 	{
@@ -1280,6 +1567,120 @@ hash_to_part_index(uint32 value, uint32 partitions)
 	return value % partitions;
 }
 
+/*
+ * Mix hash values of two columns (composite HASH key).
+ */
+uint32
+combine_hash_values(uint32 hash1, uint32 hash2)
+{
+	return hash1 ^ (hash2 + 0x9e3779b9 + (hash1 << 6) + (hash1 >> 2));
+}
+
+/*
+ * Convert values of composite HASH key's columns to the partition index.
+ */
+uint32
+composite_key_part_index(const PartRelationInfo *prel, const Datum *values)
+{
+	uint32	hash = 0;
+	int		i;
+
+	for (i = 0; i < prel->key_natts; i++)
+	{
+		uint32 col_hash = DatumGetUInt32(OidFunctionCall1(prel->key_hash_procs[i],
+														  values[i]));
+
+		hash = (i == 0) ? col_hash : combine_hash_values(hash, col_hash);
+	}
+
+	return hash_to_part_index(hash, PrelChildrenCount(prel));
+}
+
+/*
+ * Select partition of a composite HASH key using 'key_column = CONST'
+ * clauses of relation 'varno' (implicitly ANDed). Every key column
+ * must be restricted, otherwise all partitions are returned.
+ */
+RangeSet *
+select_composite_hash_partitions(const PartRelationInfo *prel,
+								 Index varno, List *clauses)
+{
+	Datum		values[PART_MAX_KEY_ATTS];
+	bool		found[PART_MAX_KEY_ATTS];
+	ListCell   *lc;
+	uint32		idx;
+	int			i;
+
+	Assert(prel->parttype == PT_HASH);
+
+	memset(found, 0, sizeof(found));
+
+	foreach (lc, clauses)
+	{
+		Node		   *clause = (Node *) lfirst(lc);
+		const OpExpr   *expr;
+		Node		   *left,
+					   *right;
+		const Var	   *var;
+		const Const	   *c;
+		TypeCacheEntry *tce;
+
+		if (IsA(clause, RestrictInfo))
+			clause = (Node *) ((RestrictInfo *) clause)->clause;
+
+		if (!is_opclause(clause) || list_length(((OpExpr *) clause)->args) != 2)
+			continue;
+
+		expr = (const OpExpr *) clause;
+		left = strip_implicit_coercions((Node *) linitial(expr->args));
+		right = strip_implicit_coercions((Node *) lsecond(expr->args));
+
+		/* Accept both 'VAR = CONST' and 'CONST = VAR' */
+		if (IsA(left, Var) && IsA(right, Const))
+		{
+			var = (const Var *) left;
+			c = (const Const *) right;
+		}
+		else if (IsA(right, Var) && IsA(left, Const))
+		{
+			var = (const Var *) right;
+			c = (const Const *) left;
+		}
+		else continue;
+
+		if (var->varno != varno || c->constisnull)
+			continue;
+
+		/* Is it a key column? */
+		for (i = 0; i < prel->key_natts; i++)
+			if (prel->key_attnums[i] == var->varoattno)
+				break;
+
+		if (i == prel->key_natts)
+			continue;
+
+		/* Hash functions of other types might produce different values */
+		if (c->consttype != prel->key_atttypes[i])
+			continue;
+
+		tce = lookup_type_cache(prel->key_atttypes[i], TYPECACHE_BTREE_OPFAMILY);
+		if (get_op_opfamily_strategy(expr->opno,
+									 tce->btree_opf) != BTEqualStrategyNumber)
+			continue;
+
+		values[i] = c->constvalue;
+		found[i] = true;
+	}
+
+	for (i = 0; i < prel->key_natts; i++)
+		if (!found[i])
+			return rangeset_make1(make_irange(0, PrelLastChild(prel), true));
+
+	idx = composite_key_part_index(prel, values);
+
+	return rangeset_make1(make_irange(idx, idx, true));
+}
+
 search_rangerel_result
 search_range_partition_eq(const Datum value,
 						  FmgrInfo *cmp_func,
@@ -1295,6 +1696,7 @@ search_range_partition_eq(const Datum value,
 
 	select_range_partitions(value,
 							cmp_func,
+							prel->attcollid,
 							ranges,
 							nranges,
 							BTEqualStrategyNumber,
@@ -1304,15 +1706,15 @@ search_range_partition_eq(const Datum value,
 	{
 		return SEARCH_RANGEREL_GAP;
 	}
-	else if (result.rangeset == NIL)
+	else if (result.rangeset == NULL)
 	{
 		return SEARCH_RANGEREL_OUT_OF_RANGE;
 	}
 	else
 	{
-		IndexRange irange = linitial_irange(result.rangeset);
+		IndexRange irange = rangeset_first(result.rangeset);
 
-		Assert(list_length(result.rangeset) == 1);
+		Assert(rangeset_nranges(result.rangeset) == 1);
 		Assert(irange.ir_lower == irange.ir_upper);
 		Assert(irange.ir_valid);
 
@@ -1327,15 +1729,34 @@ search_range_partition_eq(const Datum value,
 }
 
 static Const *
-extract_const(WalkerContext *wcxt, Param *param)
+extract_const(WalkerContext *wcxt, Expr *expr)
 {
-	ExprState  *estate = ExecInitExpr((Expr *) param, NULL);
+	ExprState  *estate = ExecInitExpr(expr, NULL);
 	bool		isnull;
 	Datum		value = ExecEvalExpr(estate, wcxt->econtext, &isnull, NULL);
+	Oid			type = exprType((Node *) expr);
+
+	return makeConst(type, exprTypmod((Node *) expr),
+					 exprCollation((Node *) expr), get_typlen(type),
+					 value, isnull, get_typbyval(type));
+}
+
+/*
+ * Check that expression doesn't depend on the current row and returns the
+ * same value during the whole scan (e.g. "now() - interval '1 day'"), so it
+ * can be evaluated once per execution instead of being treated as opaque.
+ */
+static bool
+is_stable_value(const WalkerContext *wcxt, Node *node)
+{
+	/* Consts and Params are handled separately */
+	if (IsA(node, Const) || IsA(node, Param))
+		return false;
 
-	return makeConst(param->paramtype, param->paramtypmod,
-					 param->paramcollid, get_typlen(param->paramtype),
-					 value, isnull, get_typbyval(param->paramtype));
+	return !contain_var_clause(node) &&
+		   !contain_volatile_functions(node) &&
+		   !contain_subplans(node) &&
+		   !(wcxt->planning && clause_contains_params(node));
 }
 
 static WrapperNode *
@@ -1349,12 +1770,14 @@ handle_const(const Const *c, WalkerContext *context)
 	/*
 	 * Had to add this check for queries like:
 	 *   select * from test.hash_rel where txt = NULL;
+	 * Composite HASH key can't be handled by a single value as well.
 	 */
-	if (!context->for_insert)
+	if (!context->for_insert || PrelHasCompositeKey(prel))
 	{
-		result->rangeset = list_make1_irange(make_irange(0,
-														 PrelLastChild(prel),
-														 true));
+		result->rangeset = rangeset_make1(make_irange(0,
+													  PrelLastChild(prel),
+													  true));
+		result->uncovered = UNCOVERED_ALL;
 		result->paramsel = 1.0;
 
 		return result;
@@ -1367,7 +1790,8 @@ handle_const(const Const *c, WalkerContext *context)
 				Datum	value = OidFunctionCall1(prel->hash_proc, c->constvalue);
 				uint32	idx = hash_to_part_index(DatumGetInt32(value),
 												 PrelChildrenCount(prel));
-				result->rangeset = list_make1_irange(make_irange(idx, idx, true));
+				result->rangeset = rangeset_make1(make_irange(idx, idx, true));
+				result->uncovered = UNCOVERED_NONE;
 			}
 			break;
 
@@ -1379,6 +1803,7 @@ handle_const(const Const *c, WalkerContext *context)
 
 				select_range_partitions(c->constvalue,
 										&tce->cmp_proc_finfo,
+										prel->attcollid,
 										context->prel->ranges,
 										PrelChildrenCount(context->prel),
 										BTEqualStrategyNumber,
@@ -1386,6 +1811,20 @@ handle_const(const Const *c, WalkerContext *context)
 			}
 			break;
 
+		case PT_LIST:
+			{
+				TypeCacheEntry *tce;
+
+				tce = lookup_type_cache(c->consttype, TYPECACHE_CMP_PROC_FINFO);
+
+				select_list_partitions(c->constvalue,
+									   &tce->cmp_proc_finfo,
+									   prel,
+									   BTEqualStrategyNumber,
+									   result);
+			}
+			break;
+
 		default:
 			elog(ERROR, "Unknown partitioning type %u", prel->parttype);
 			break;
@@ -1413,10 +1852,22 @@ handle_opexpr(const OpExpr *expr, WalkerContext *context)
 		{
 			if (IsConstValue(context, param))
 			{
-				handle_binary_opexpr(context, result, var, ExtractConst(context, param));
+				/* Predicate on the column of partitioning expression */
+				if (PrelHasKeyExpression(prel) && !match_key_expression(prel, var))
+					handle_key_column_opexpr(context, result, var,
+											 ExtractConst(context, param));
+				/* Prefix pattern, e.g. "KEY LIKE 'abc%'" */
+				else if (expr->opno == OID_TEXT_LIKE_OP &&
+						 var == linitial(expr->args))
+					handle_like_opexpr(context, result,
+									   ExtractConst(context, param));
+				else
+					handle_binary_opexpr(context, result, var,
+										 ExtractConst(context, param));
 				return result;
 			}
-			else if (IsA(param, Param) || IsA(param, Var))
+			else if (IsA(param, Param) || IsA(param, Var) ||
+					 is_stable_value(context, param))
 			{
 				handle_binary_opexpr_param(prel, result, var);
 				return result;
@@ -1424,17 +1875,20 @@ handle_opexpr(const OpExpr *expr, WalkerContext *context)
 		}
 	}
 
-	result->rangeset = list_make1_irange(make_irange(0, PrelLastChild(prel), true));
+	result->rangeset = rangeset_make1(make_irange(0, PrelLastChild(prel), true));
+	result->uncovered = UNCOVERED_ALL;
 	result->paramsel = 1.0;
 	return result;
 }
 
 /*
  * Checks if expression is a KEY OP PARAM or PARAM OP KEY,
- * where KEY is partition key (it could be Var or RelableType) and PARAM is
- * whatever. Function returns variable (or RelableType) and param via var_ptr
- * and param_ptr pointers. If partition key isn't in expression then function
- * returns false.
+ * where KEY is partition key (it could be Var, RelableType or partitioning
+ * expression) and PARAM is whatever. Function returns variable (or
+ * RelableType) and param via var_ptr and param_ptr pointers. If partition
+ * key isn't in expression then function returns false.
+ *
+ * NOTE: for expression keys the underlying column is accepted as well.
  */
 static bool
 pull_var_param(const WalkerContext *ctx,
@@ -1444,36 +1898,25 @@ pull_var_param(const WalkerContext *ctx,
 {
 	Node   *left = linitial(expr->args),
 		   *right = lsecond(expr->args);
-	Var	   *v = NULL;
 
 	/* Check the case when variable is on the left side */
-	if (IsA(left, Var) || IsA(left, RelabelType))
+	if (is_key_column(ctx->prel, left) ||
+		match_key_expression(ctx->prel, left) ||
+		is_key_cast(ctx->prel, left))
 	{
-		v = !IsA(left, RelabelType) ?
-						(Var *) left :
-						(Var *) ((RelabelType *) left)->arg;
-
-		if (v->varoattno == ctx->prel->attnum)
-		{
-			*var_ptr = left;
-			*param_ptr = right;
-			return true;
-		}
+		*var_ptr = left;
+		*param_ptr = right;
+		return true;
 	}
 
 	/* ... variable is on the right side */
-	if (IsA(right, Var) || IsA(right, RelabelType))
+	if (is_key_column(ctx->prel, right) ||
+		match_key_expression(ctx->prel, right) ||
+		is_key_cast(ctx->prel, right))
 	{
-		v = !IsA(right, RelabelType) ?
-						(Var *) right :
-						(Var *) ((RelabelType *) right)->arg;
-
-		if (v->varoattno == ctx->prel->attnum)
-		{
-			*var_ptr = right;
-			*param_ptr = left;
-			return true;
-		}
+		*var_ptr = right;
+		*param_ptr = left;
+		return true;
 	}
 
 	/* Variable isn't a partitionig key */
@@ -1481,657 +1924,2487 @@ pull_var_param(const WalkerContext *ctx,
 }
 
 /*
- * Boolean expression handler
+ * Check if 'node' is the partitioned column (Var or RelabelType).
  */
-static WrapperNode *
-handle_boolexpr(const BoolExpr *expr, WalkerContext *context)
+static bool
+is_key_column(const PartRelationInfo *prel, const Node *node)
 {
-	WrapperNode	*result = (WrapperNode *)palloc(sizeof(WrapperNode));
-	ListCell	*lc;
-	const PartRelationInfo *prel = context->prel;
+	if (IsA(node, RelabelType))
+		node = (const Node *) ((const RelabelType *) node)->arg;
 
-	result->orig = (const Node *)expr;
-	result->args = NIL;
-	result->paramsel = 1.0;
+	return IsA(node, Var) && ((const Var *) node)->varoattno == prel->attnum;
+}
 
-	if (expr->boolop == AND_EXPR)
-		result->rangeset = list_make1_irange(make_irange(0,
-														 PrelLastChild(prel),
-														 false));
-	else
-		result->rangeset = NIL;
+/*
+ * Check if 'node' is the partitioning expression of 'prel'.
+ */
+static bool
+match_key_expression(const PartRelationInfo *prel, const Node *node)
+{
+	Node	   *expr;
+	int			varno;
 
-	foreach (lc, expr->args)
-	{
-		WrapperNode *arg;
+	if (!PrelHasKeyExpression(prel) || exprType(node) != prel->atttype)
+		return false;
 
-		arg = walk_expr_tree((Expr *)lfirst(lc), context);
-		result->args = lappend(result->args, arg);
-		switch (expr->boolop)
-		{
-			case OR_EXPR:
-				result->rangeset = irange_list_union(result->rangeset, arg->rangeset);
-				break;
-			case AND_EXPR:
-				result->rangeset = irange_list_intersect(result->rangeset, arg->rangeset);
-				result->paramsel *= arg->paramsel;
-				break;
-			default:
-				result->rangeset = list_make1_irange(make_irange(0,
-																 PrelLastChild(prel),
-																 false));
-				break;
-		}
-	}
+	/* Expression should reference a single relation */
+	if (!bms_get_singleton_member(pull_varnos((Node *) node), &varno))
+		return false;
 
-	if (expr->boolop == OR_EXPR)
-	{
-		int totallen = irange_list_length(result->rangeset);
+	/* Partitioning expression always references varno 1 */
+	expr = copyObject(node);
+	change_varnos(expr, varno, 1);
 
-		foreach (lc, result->args)
-		{
-			WrapperNode *arg = (WrapperNode *) lfirst(lc);
-			int len = irange_list_length(arg->rangeset);
+	return equal(expr, prel->key_expr);
+}
 
-			result->paramsel *= (1.0 - arg->paramsel * (double)len / (double)totallen);
-		}
-		result->paramsel = 1.0 - result->paramsel;
-	}
+/*
+ * Check if 'node' is a widening cast of the partitioning key to another type
+ * of the same btree opfamily, e.g. "int4_col::int8" or "date_col::timestamptz".
+ * Cross-type operators of an opfamily must agree with such casts, so
+ * "KEY::T OP VALUE" may be checked as "KEY OP VALUE".
+ *
+ * NOTE: only implicit casts are accepted, since narrowing ones (e.g.
+ * "timestamp_col::date") may round or truncate the key.
+ */
+static bool
+is_key_cast(const PartRelationInfo *prel, const Node *node)
+{
+	const FuncExpr *cast = (const FuncExpr *) node;
+	TypeCacheEntry *tce1,
+				   *tce2;
+	HeapTuple		tuple;
+	bool			implicit;
+
+	if (!IsA(node, FuncExpr) || list_length(cast->args) != 1 ||
+		(cast->funcformat != COERCE_IMPLICIT_CAST &&
+		 cast->funcformat != COERCE_EXPLICIT_CAST))
+		return false;
 
-	return result;
+	if (PrelHasKeyExpression(prel) || !is_key_column(prel, linitial(cast->args)))
+		return false;
+
+	tce1 = lookup_type_cache(cast->funcresulttype, TYPECACHE_BTREE_OPFAMILY);
+	tce2 = lookup_type_cache(prel->atttype, TYPECACHE_BTREE_OPFAMILY);
+
+	if (!OidIsValid(tce1->btree_opf) || tce1->btree_opf != tce2->btree_opf)
+		return false;
+
+	tuple = SearchSysCache2(CASTSOURCETARGET,
+							ObjectIdGetDatum(prel->atttype),
+							ObjectIdGetDatum(cast->funcresulttype));
+	if (!HeapTupleIsValid(tuple))
+		return false;
+
+	implicit = ((Form_pg_cast) GETSTRUCT(tuple))->castfunc == cast->funcid &&
+			   ((Form_pg_cast) GETSTRUCT(tuple))->castcontext == COERCION_CODE_IMPLICIT;
+
+	ReleaseSysCache(tuple);
+
+	return implicit;
 }
 
 /*
- * Scalar array expression
+ * Handle predicate on the column of partitioning expression, e.g. "ts >= C"
+ * for "date_trunc('day', ts)". Constant is passed through the expression,
+ * which works for "=" and (iff the expression is monotonic) for "<", "<=",
+ * ">", ">=": e.g. "ts >= C" implies "date_trunc('day', ts) >= date_trunc('day', C)".
+ * Since this is an approximation, selected partitions are always lossy.
  */
-static WrapperNode *
-handle_arrexpr(const ScalarArrayOpExpr *expr, WalkerContext *context)
+static void
+handle_key_column_opexpr(WalkerContext *context, WrapperNode *result,
+						 const Node *varnode, const Const *c)
 {
-	WrapperNode *result = (WrapperNode *)palloc(sizeof(WrapperNode));
-	Node		*varnode = (Node *) linitial(expr->args);
-	Var			*var;
-	Node		*arraynode = (Node *) lsecond(expr->args);
+	int						strategy;
+	TypeCacheEntry		   *tce;
+	FmgrInfo				cmp_func;
+	Const				   *key_value;
+	uint32					i;
+	const OpExpr		   *expr = (const OpExpr *) result->orig;
 	const PartRelationInfo *prel = context->prel;
 
-	result->orig = (const Node *)expr;
-	result->args = NIL;
 	result->paramsel = 1.0;
 
-	Assert(varnode != NULL);
+	/* Constant should be of the column's type */
+	if (c->constisnull || c->consttype != prel->key_atttypes[0])
+		goto handle_key_column_opexpr_return;
 
-	/* If variable is not the partition key then skip it */
-	if (IsA(varnode, Var) || IsA(varnode, RelabelType))
-	{
-		var = !IsA(varnode, RelabelType) ?
-			(Var *) varnode :
-			(Var *) ((RelabelType *) varnode)->arg;
-		if (var->varoattno != prel->attnum)
-			goto handle_arrexpr_return;
-	}
-	else
-		goto handle_arrexpr_return;
+	tce = lookup_type_cache(exprType(varnode), TYPECACHE_BTREE_OPFAMILY);
+	strategy = get_op_opfamily_strategy(expr->opno, tce->btree_opf);
 
-	if (arraynode && IsA(arraynode, Const) &&
-		!((Const *) arraynode)->constisnull)
+	switch (strategy)
 	{
-		ArrayType  *arrayval;
-		int16		elmlen;
-		bool		elmbyval;
-		char		elmalign;
-		int			num_elems;
-		Datum	   *elem_values;
-		bool	   *elem_nulls;
-		int			i;
+		case BTEqualStrategyNumber:
+			break;
 
-		/* Extract values from array */
-		arrayval = DatumGetArrayTypeP(((Const *) arraynode)->constvalue);
-		get_typlenbyvalalign(ARR_ELEMTYPE(arrayval),
-							 &elmlen, &elmbyval, &elmalign);
-		deconstruct_array(arrayval,
-						  ARR_ELEMTYPE(arrayval),
-						  elmlen, elmbyval, elmalign,
-						  &elem_values, &elem_nulls, &num_elems);
+		case BTLessStrategyNumber:
+		case BTLessEqualStrategyNumber:
+			if (!prel->monotonic_key)
+				goto handle_key_column_opexpr_return;
 
-		result->rangeset = NIL;
+			/* "col < C" implies "expr(col) <= expr(C)" */
+			strategy = BTLessEqualStrategyNumber;
+			break;
 
-		/* Construct OIDs list */
-		for (i = 0; i < num_elems; i++)
-		{
-			Datum		value;
-			uint32		idx;
-
-			/* Invoke base hash function for value type */
-			value = OidFunctionCall1(prel->hash_proc, elem_values[i]);
-			idx = hash_to_part_index(DatumGetInt32(value), PrelChildrenCount(prel));
-			result->rangeset = irange_list_union(result->rangeset,
-												 list_make1_irange(make_irange(idx,
-																			   idx,
-																			   true)));
-		}
+		case BTGreaterStrategyNumber:
+		case BTGreaterEqualStrategyNumber:
+			if (!prel->monotonic_key)
+				goto handle_key_column_opexpr_return;
 
-		/* Free resources */
-		pfree(elem_values);
-		pfree(elem_nulls);
+			/* "col > C" implies "expr(col) >= expr(C)" */
+			strategy = BTGreaterEqualStrategyNumber;
+			break;
 
-		return result;
+		default:
+			goto handle_key_column_opexpr_return;
 	}
 
-	if (arraynode && IsA(arraynode, Param))
-		result->paramsel = DEFAULT_INEQ_SEL;
+	key_value = eval_key_expression(prel, c);
+	if (!key_value || key_value->constisnull)
+		goto handle_key_column_opexpr_return;
 
-handle_arrexpr_return:
-	result->rangeset = list_make1_irange(make_irange(0, PrelLastChild(prel), true));
-	return result;
-}
+	fill_type_cmp_fmgr_info(&cmp_func, key_value->consttype, prel->atttype);
+	select_range_partitions(key_value->constvalue,
+							&cmp_func,
+							prel->attcollid,
+							prel->ranges,
+							PrelChildrenCount(prel),
+							strategy,
+							result);
 
-/*
- * Theres are functions below copied from allpaths.c with (or without) some
- * modifications. Couldn't use original because of 'static' modifier.
- */
+	/* Inequality might also select values from gaps */
+	if (strategy != BTEqualStrategyNumber && prel->has_gaps)
+		result->uncovered |= UNCOVERED_GAP;
 
-/*
- * set_plain_rel_size
- *	  Set size estimates for a plain relation (no subquery, no inheritance)
- */
-static void
-set_plain_rel_size(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
-{
-	/*
-	 * Test any partial indexes of rel for applicability.  We must do this
-	 * first since partial unique indexes can affect size estimates.
-	 */
-	check_partial_indexes(root, rel);
+	/* Partitions must keep the original qual */
+	for (i = 0; i < rangeset_nranges(result->rangeset); i++)
+		rangeset_get(result->rangeset, i).ir_lossy = true;
 
-	/* Mark rel with estimated output rows, width, etc */
-	set_baserel_size_estimates(root, rel);
+	return;
+
+handle_key_column_opexpr_return:
+	result->rangeset = rangeset_make1(make_irange(0, PrelLastChild(prel), true));
+	result->uncovered = UNCOVERED_ALL;
 }
 
 /*
- * set_plain_rel_pathlist
- *	  Build access paths for a plain relation (no subquery, no inheritance)
+ * Handle "KEY LIKE 'prefix%'" for RANGE partitioning on a text key. The fixed
+ * prefix of the pattern gives us "KEY >= prefix AND KEY < next(prefix)", which
+ * is valid only if strings are compared bytewise, i.e. under C collation.
+ * Since LIKE is stricter than these bounds, selected partitions are lossy.
  */
 static void
-set_plain_rel_pathlist(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
+handle_like_opexpr(WalkerContext *context, WrapperNode *result, const Const *c)
 {
-	Relids		required_outer;
-	Path *path;
+	const PartRelationInfo *prel = context->prel;
+	Pattern_Prefix_Status	pstatus;
+	Const				   *prefix = NULL,
+						   *greater;
+	FmgrInfo				cmp_func,
+							ltproc;
+	WrapperNode				upper;
+	uint32					i;
 
-	/*
-	 * We don't support pushing join clauses into the quals of a seqscan, but
-	 * it could still have required parameterization due to LATERAL refs in
-	 * its tlist.
-	 */
-	required_outer = rel->lateral_relids;
+	result->paramsel = 1.0;
 
-	/* Consider sequential scan */
-#if PG_VERSION_NUM >= 90600
-	path = create_seqscan_path(root, rel, required_outer, 0);
-#else
-	path = create_seqscan_path(root, rel, required_outer);
-#endif
-	add_path(rel, path);
+	if (prel->parttype != PT_RANGE || prel->atttype != TEXTOID ||
+		!lc_collate_is_c(prel->attcollid))
+		goto handle_like_opexpr_return;
 
-	/* Consider index scans */
-	create_index_paths(root, rel);
+	/* "KEY LIKE NULL" is never true */
+	if (c->constisnull)
+	{
+		result->rangeset = NULL;
+		result->found_gap = false;
+		result->uncovered = UNCOVERED_NONE;
+		return;
+	}
 
-	/* Consider TID scans */
-	create_tidscan_paths(root, rel);
+	pstatus = pattern_fixed_prefix((Const *) c, Pattern_Type_Like,
+								   prel->attcollid, &prefix, NULL);
+
+	/* Pattern starts with a wildcard */
+	if (pstatus == Pattern_Prefix_None)
+		goto handle_like_opexpr_return;
+
+	fill_type_cmp_fmgr_info(&cmp_func, prefix->consttype, prel->atttype);
+
+	/* Pattern without wildcards is just "KEY = prefix" */
+	if (pstatus == Pattern_Prefix_Exact)
+	{
+		select_range_partitions(prefix->constvalue,
+								&cmp_func,
+								prel->attcollid,
+								prel->ranges,
+								PrelChildrenCount(prel),
+								BTEqualStrategyNumber,
+								result);
+		return;
+	}
+
+	select_range_partitions(prefix->constvalue,
+							&cmp_func,
+							prel->attcollid,
+							prel->ranges,
+							PrelChildrenCount(prel),
+							BTGreaterEqualStrategyNumber,
+							result);
+
+	/* There is no upper bound if prefix cannot be incremented */
+	fmgr_info(F_TEXT_LT, &ltproc);
+	greater = make_greater_string(prefix, &ltproc, prel->attcollid);
+	if (greater)
+	{
+		select_range_partitions(greater->constvalue,
+								&cmp_func,
+								prel->attcollid,
+								prel->ranges,
+								PrelChildrenCount(prel),
+								BTLessStrategyNumber,
+								&upper);
+
+		result->rangeset = rangeset_intersect(result->rangeset, upper.rangeset);
+		result->uncovered &= upper.uncovered;
+	}
+
+	/* Prefix range might also cover values from gaps */
+	if (prel->has_gaps)
+		result->uncovered |= UNCOVERED_GAP;
+
+	/* Partitions must keep the original qual */
+	for (i = 0; i < rangeset_nranges(result->rangeset); i++)
+		rangeset_get(result->rangeset, i).ir_lossy = true;
+
+	return;
+
+handle_like_opexpr_return:
+	result->rangeset = rangeset_make1(make_irange(0, PrelLastChild(prel), true));
+	result->uncovered = UNCOVERED_ALL;
 }
 
 /*
- * set_foreign_size
- *		Set size estimates for a foreign table RTE
+ * Compute partitioning expression for a constant value of its column.
+ * Returns NULL if expression could not be reduced to a Const.
  */
-static void
-set_foreign_size(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
+static Const *
+eval_key_expression(const PartRelationInfo *prel, const Const *c)
 {
-	/* Mark rel with estimated output rows, width, etc */
-	set_foreign_size_estimates(root, rel);
+	Node *expr;
 
-	/* Let FDW adjust the size estimates, if it can */
-	rel->fdwroutine->GetForeignRelSize(root, rel, rte->relid);
+	expr = replace_key_column_mutator(prel->key_expr, (void *) c);
+	expr = eval_const_expressions(NULL, expr);
 
-	/* ... but do not let it set the rows estimate to zero */
-	rel->rows = clamp_row_est(rel->rows);
+	return IsA(expr, Const) ? (Const *) expr : NULL;
 }
 
-/*
- * set_foreign_pathlist
- *		Build access paths for a foreign table RTE
- */
-static void
-set_foreign_pathlist(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
+static Node *
+replace_key_column_mutator(Node *node, void *context)
 {
-	/* Call the FDW's GetForeignPaths function to generate path(s) */
-	rel->fdwroutine->GetForeignPaths(root, rel, rte->relid);
+	if (node == NULL)
+		return NULL;
+
+	/* Partitioning expression contains a single column */
+	if (IsA(node, Var))
+		return (Node *) copyObject(context);
+
+	return expression_tree_mutator(node, replace_key_column_mutator, context);
 }
 
 /*
- * set_append_rel_pathlist
- *	  Build access paths for an "append relation"
+ * Boolean expression handler
  */
-void
-set_append_rel_pathlist(PlannerInfo *root, RelOptInfo *rel,
-						Index rti, RangeTblEntry *rte,
-						PathKey *pathkeyAsc, PathKey *pathkeyDesc)
+static WrapperNode *
+handle_boolexpr(const BoolExpr *expr, WalkerContext *context)
 {
-	Index		parentRTindex = rti;
-	List	   *live_childrels = NIL;
-	List	   *subpaths = NIL;
-	bool		subpaths_valid = true;
-	List	   *all_child_pathkeys = NIL;
-	List	   *all_child_outers = NIL;
-	ListCell   *l;
+	WrapperNode	*result = (WrapperNode *)palloc(sizeof(WrapperNode));
+	ListCell	*lc;
+	const PartRelationInfo *prel = context->prel;
+	RangeBound	 lower,
+				 upper;
+	WrapperNode	*lower_arg = NULL,
+				*upper_arg = NULL;
+	int			 i;
 
-	/*
-	 * Generate access paths for each member relation, and remember the
-	 * cheapest path for each one.  Also, identify all pathkeys (orderings)
-	 * and parameterizations (required_outer sets) available for the member
-	 * relations.
-	 */
-	foreach(l, root->append_rel_list)
-	{
-		AppendRelInfo *appinfo = (AppendRelInfo *) lfirst(l);
-		Index		childRTindex;
-		RangeTblEntry *childRTE;
-		RelOptInfo *childrel;
-		ListCell   *lcp;
+	result->orig = (const Node *)expr;
+	result->args = NIL;
+	result->paramsel = 1.0;
 
-		/* append_rel_list contains all append rels; ignore others */
-		if (appinfo->parent_relid != parentRTindex)
-			continue;
+	if (expr->boolop == NOT_EXPR)
+	{
+		Node		*argnode = (Node *) linitial(expr->args);
+		WrapperNode *arg = walk_expr_tree((Expr *) argnode, context);
 
-		/* Re-locate the child RTE and RelOptInfo */
-		childRTindex = appinfo->child_relid;
-		childRTE = root->simple_rte_array[childRTindex];
-		childrel = root->simple_rel_array[childRTindex];
+		result->args = list_make1(arg);
 
 		/*
-		 * Compute the child's access paths.
+		 * NOT (NULL) is NULL as well, thus partitions which are not
+		 * selected by the argument can only be inverted if it never
+		 * returns NULL.
 		 */
-		if (childRTE->relkind == RELKIND_FOREIGN_TABLE)
+		if (is_never_null(context, argnode))
+			result->rangeset = rangeset_negate(arg->rangeset,
+											   PrelChildrenCount(prel));
+		else
+			result->rangeset = rangeset_make1(make_irange(0,
+														  PrelLastChild(prel),
+														  true));
+
+		/* Default partition might contain anything but the selected values */
+		result->uncovered = UNCOVERED_ALL;
+
+		return result;
+	}
+
+	if (expr->boolop == AND_EXPR)
+	{
+		/* "KEY >= A AND KEY < B" is resolved as a single range */
+		if (prel->parttype == PT_RANGE &&
+			find_range_bounds(expr, context, &lower, &upper))
 		{
-			set_foreign_size(root, childrel, childRTE);
-			set_foreign_pathlist(root, childrel, childRTE);
+			result->rangeset = handle_range_bounds(context, &lower, &upper,
+												   &lower_arg, &upper_arg);
+			result->uncovered = lower_arg->uncovered & upper_arg->uncovered;
 		}
 		else
 		{
-			set_plain_rel_size(root, childrel, childRTE);
-			set_plain_rel_pathlist(root, childrel, childRTE);
+			result->rangeset = rangeset_make1(make_irange(0,
+														  PrelLastChild(prel),
+														  false));
+			result->uncovered = UNCOVERED_ALL;
 		}
-		set_cheapest(childrel);
+	}
+	else
+	{
+		result->rangeset = NULL;
+		result->uncovered = UNCOVERED_NONE;
+	}
 
-		/*
-		 * If child is dummy, ignore it.
-		 */
-		if (IS_DUMMY_REL(childrel))
+	i = 0;
+	foreach (lc, expr->args)
+	{
+		WrapperNode *arg;
+		RangeSet	*prev_rangeset = result->rangeset;
+
+		/* Bounds have already been taken into account */
+		if (lower_arg && (i == lower.argno || i == upper.argno))
+		{
+			arg = (i == lower.argno) ? lower_arg : upper_arg;
+			result->args = lappend(result->args, arg);
+			i++;
 			continue;
+		}
 
-		/*
-		 * Child is live, so add it to the live_childrels list for use below.
-		 */
-		live_childrels = lappend(live_childrels, childrel);
+		arg = walk_expr_tree((Expr *)lfirst(lc), context);
+		result->args = lappend(result->args, arg);
+		switch (expr->boolop)
+		{
+			case OR_EXPR:
+				result->rangeset = rangeset_union(result->rangeset, arg->rangeset);
+				result->uncovered |= arg->uncovered;
+				break;
+			case AND_EXPR:
+				result->rangeset = rangeset_intersect(result->rangeset, arg->rangeset);
+				result->uncovered &= arg->uncovered;
+				result->paramsel *= arg->paramsel;
+				break;
+			default:
+				elog(ERROR, "Unknown boolean operator %u", expr->boolop);
+				break;
+		}
 
-		/*
-		 * If child has an unparameterized cheapest-total path, add that to
-		 * the unparameterized Append path we are constructing for the parent.
-		 * If not, there's no workable unparameterized path.
-		 */
-		if (childrel->cheapest_total_path->param_info == NULL)
-			subpaths = accumulate_append_subpath(subpaths,
-											  childrel->cheapest_total_path);
-		else
-			subpaths_valid = false;
+		/* Intermediate range set is not referenced by anyone else */
+		if (prev_rangeset)
+			pfree(prev_rangeset);
 
-		/*
-		 * Collect lists of all the available path orderings and
-		 * parameterizations for all the children.  We use these as a
-		 * heuristic to indicate which sort orderings and parameterizations we
-		 * should build Append and MergeAppend paths for.
-		 */
-		foreach(lcp, childrel->pathlist)
-		{
-			Path	   *childpath = (Path *) lfirst(lcp);
-			List	   *childkeys = childpath->pathkeys;
-			Relids		childouter = PATH_REQ_OUTER(childpath);
+		i++;
+	}
 
-			/* Unsorted paths don't contribute to pathkey list */
-			if (childkeys != NIL)
-			{
-				ListCell   *lpk;
-				bool		found = false;
+	if (expr->boolop == OR_EXPR)
+	{
+		int totallen = rangeset_length(result->rangeset);
 
-				/* Have we already seen this ordering? */
-				foreach(lpk, all_child_pathkeys)
-				{
-					List	   *existing_pathkeys = (List *) lfirst(lpk);
+		foreach (lc, result->args)
+		{
+			WrapperNode *arg = (WrapperNode *) lfirst(lc);
+			int len = rangeset_length(arg->rangeset);
 
-					if (compare_pathkeys(existing_pathkeys,
-										 childkeys) == PATHKEYS_EQUAL)
-					{
-						found = true;
-						break;
-					}
-				}
-				if (!found)
-				{
-					/* No, so add it to all_child_pathkeys */
-					all_child_pathkeys = lappend(all_child_pathkeys,
-												 childkeys);
-				}
-			}
+			result->paramsel *= (1.0 - arg->paramsel * (double)len / (double)totallen);
+		}
+		result->paramsel = 1.0 - result->paramsel;
+	}
 
-			/* Unparameterized paths don't contribute to param-set list */
-			if (childouter)
+	return result;
+}
+
+/*
+ * NullTest handler. Partitioning key is NOT NULL, thus "KEY IS NULL"
+ * selects nothing (not even the default partition), while "KEY IS NOT
+ * NULL" holds for all partitions.
+ */
+static WrapperNode *
+handle_nulltest(const NullTest *expr, WalkerContext *context)
+{
+	WrapperNode			   *result = (WrapperNode *) palloc(sizeof(WrapperNode));
+	const PartRelationInfo *prel = context->prel;
+
+	result->orig = (const Node *) expr;
+	result->args = NIL;
+	result->paramsel = 1.0;
+
+	if (!expr->argisrow &&
+		is_key_column(prel, (Node *) expr->arg) &&
+		is_key_not_null(prel))
+	{
+		if (expr->nulltesttype == IS_NULL)
+		{
+			result->rangeset = NULL;
+			result->uncovered = UNCOVERED_NONE;
+		}
+		else
+		{
+			result->rangeset = rangeset_make1(make_irange(0,
+														  PrelLastChild(prel),
+														  false));
+			result->uncovered = UNCOVERED_ALL;
+		}
+
+		return result;
+	}
+
+	result->rangeset = rangeset_make1(make_irange(0, PrelLastChild(prel), true));
+	result->uncovered = UNCOVERED_ALL;
+
+	return result;
+}
+
+/*
+ * Check that partitioned column is still NOT NULL (it's checked
+ * by common_relation_checks(), but might have been altered since).
+ */
+static bool
+is_key_not_null(const PartRelationInfo *prel)
+{
+	HeapTuple	tp;
+	bool		result = false;
+
+	tp = SearchSysCache2(ATTNUM,
+						 ObjectIdGetDatum(PrelParentRelid(prel)),
+						 Int16GetDatum(prel->attnum));
+	if (HeapTupleIsValid(tp))
+	{
+		result = ((Form_pg_attribute) GETSTRUCT(tp))->attnotnull;
+		ReleaseSysCache(tp);
+	}
+
+	return result;
+}
+
+/*
+ * Check that the handler of 'node' never deals with NULL, i.e. 'node' is
+ * "KEY IS [NOT] NULL", "KEY OP CONST" (non-NULL CONST and strict OP) or
+ * AND\OR\NOT of such clauses.
+ */
+static bool
+is_never_null(WalkerContext *context, const Node *node)
+{
+	const PartRelationInfo *prel = context->prel;
+
+	switch (nodeTag(node))
+	{
+		case T_NullTest:
+			return !((const NullTest *) node)->argisrow &&
+				   is_key_column(prel, (Node *) ((const NullTest *) node)->arg) &&
+				   is_key_not_null(prel);
+
+		case T_OpExpr:
 			{
-				ListCell   *lco;
-				bool		found = false;
+				const OpExpr   *expr = (const OpExpr *) node;
+				Node		   *var,
+							   *param;
+
+				return list_length(expr->args) == 2 &&
+					   pull_var_param(context, expr, &var, &param) &&
+					   is_key_column(prel, var) &&
+					   IsA(param, Const) &&
+					   !((Const *) param)->constisnull &&
+					   op_strict(expr->opno) &&
+					   is_key_not_null(prel);
+			}
 
-				/* Have we already seen this param set? */
-				foreach(lco, all_child_outers)
+		case T_BoolExpr:
+			{
+				ListCell *lc;
+
+				foreach (lc, ((const BoolExpr *) node)->args)
+					if (!is_never_null(context, (const Node *) lfirst(lc)))
+						return false;
+
+				return true;
+			}
+
+		default:
+			return false;
+	}
+}
+
+/*
+ * Find the first lower ("KEY > A", "KEY >= A") and the first upper
+ * ("KEY < B", "KEY <= B") bound of RANGE partitioning key among the
+ * arguments of AND.
+ */
+static bool
+find_range_bounds(const BoolExpr *expr, WalkerContext *context,
+				  RangeBound *lower, RangeBound *upper)
+{
+	ListCell   *lc;
+	int			i = 0;
+
+	lower->expr = NULL;
+	upper->expr = NULL;
+
+	foreach (lc, expr->args)
+	{
+		RangeBound	bound;
+
+		if (get_range_bound(context, (Node *) lfirst(lc), &bound))
+		{
+			bound.argno = i;
+
+			switch (bound.strategy)
+			{
+				case BTGreaterStrategyNumber:
+				case BTGreaterEqualStrategyNumber:
+					if (!lower->expr)
+						*lower = bound;
+					break;
+
+				case BTLessStrategyNumber:
+				case BTLessEqualStrategyNumber:
+					if (!upper->expr)
+						*upper = bound;
+					break;
+
+				default:
+					break;
+			}
+		}
+
+		i++;
+	}
+
+	return lower->expr && upper->expr;
+}
+
+/*
+ * Check that 'clause' is "KEY OP VALUE", where VALUE is known and OP
+ * is an inequality operator (see handle_binary_opexpr()).
+ */
+static bool
+get_range_bound(WalkerContext *context, Node *clause, RangeBound *bound)
+{
+	const PartRelationInfo *prel = context->prel;
+	const OpExpr		   *expr = (const OpExpr *) clause;
+	Node				   *varnode;
+	TypeCacheEntry		   *tce;
+
+	if (!IsA(clause, OpExpr) || list_length(expr->args) != 2)
+		return false;
+
+	/* Key should be on the left side */
+	varnode = (Node *) linitial(expr->args);
+	if (PrelHasKeyExpression(prel) ?
+			!match_key_expression(prel, varnode) :
+			!is_key_column(prel, varnode))
+		return false;
+
+	if (!IsConstValue(context, (Node *) lsecond(expr->args)))
+		return false;
+
+	tce = lookup_type_cache(exprType(varnode), TYPECACHE_BTREE_OPFAMILY);
+
+	bound->expr = expr;
+	bound->value = (Node *) lsecond(expr->args);
+	bound->strategy = get_op_opfamily_strategy(expr->opno, tce->btree_opf);
+
+	return bound->strategy != InvalidStrategy &&
+		   bound->strategy != BTEqualStrategyNumber;
+}
+
+/*
+ * Handle a pair of bounds found by find_range_bounds(). The upper bound
+ * is only searched for among partitions selected by the lower one, and
+ * the result is a single contiguous range, so no intersection is needed.
+ * Both clauses get their WrapperNodes for wrapper_make_expression().
+ */
+static RangeSet *
+handle_range_bounds(WalkerContext *context,
+					const RangeBound *lower, const RangeBound *upper,
+					WrapperNode **lower_wrap, WrapperNode **upper_wrap)
+{
+	const PartRelationInfo *prel = context->prel;
+	const RangeEntry	   *ranges = PrelGetRangesArray(prel);
+	uint32					nranges = PrelChildrenCount(prel);
+	Const				   *lower_value,
+						   *upper_value;
+	WrapperNode			   *lw = (WrapperNode *) palloc(sizeof(WrapperNode)),
+						   *uw = (WrapperNode *) palloc(sizeof(WrapperNode));
+	FmgrInfo				cmp_func;
+	RangeSet			   *result;
+	uint32					lo,
+							hi,
+							i;
+	bool					lo_lossy,
+							hi_lossy;
+
+	lw->orig = (const Node *) lower->expr;
+	lw->args = NIL;
+	lw->paramsel = 1.0;
+
+	uw->orig = (const Node *) upper->expr;
+	uw->args = NIL;
+	uw->paramsel = 1.0;
+
+	*lower_wrap = lw;
+	*upper_wrap = uw;
+
+	lower_value = ExtractConst(context, lower->value);
+	upper_value = ExtractConst(context, upper->value);
+
+	/* Comparison with NULL is never true */
+	if (lower_value->constisnull || upper_value->constisnull)
+	{
+		lw->rangeset = uw->rangeset = NULL;
+		lw->uncovered = uw->uncovered = UNCOVERED_NONE;
+		return NULL;
+	}
+
+	fill_type_cmp_fmgr_info(&cmp_func, lower_value->consttype, prel->atttype);
+	select_range_partitions(lower_value->constvalue,
+							&cmp_func,
+							prel->attcollid,
+							ranges,
+							nranges,
+							lower->strategy,
+							lw);
+
+	/* Skip partitions that don't satisfy the lower bound */
+	lo = lw->rangeset ? rangeset_first(lw->rangeset).ir_lower : 0;
+
+	fill_type_cmp_fmgr_info(&cmp_func, upper_value->consttype, prel->atttype);
+	select_range_partitions(upper_value->constvalue,
+							&cmp_func,
+							prel->attcollid,
+							ranges + lo,
+							nranges - lo,
+							upper->strategy,
+							uw);
+
+	/* Inequality might also select values from gaps */
+	if (prel->has_gaps)
+	{
+		lw->uncovered |= UNCOVERED_GAP;
+		uw->uncovered |= UNCOVERED_GAP;
+	}
+
+	/* Make indices of upper bound's partitions absolute */
+	for (i = 0; i < rangeset_nranges(uw->rangeset); i++)
+	{
+		rangeset_get(uw->rangeset, i).ir_lower += lo;
+		rangeset_get(uw->rangeset, i).ir_upper += lo;
+	}
+
+	if (!lw->rangeset || !uw->rangeset)
+		return NULL;
+
+	/* Both sets start with 'lo', the upper one ends with 'hi' */
+	lo_lossy = rangeset_first(lw->rangeset).ir_lossy;
+	hi = rangeset_last(uw->rangeset).ir_upper;
+	hi_lossy = rangeset_last(uw->rangeset).ir_lossy;
+
+	if (lo == hi)
+		return rangeset_make1(make_irange(lo, lo, lo_lossy || hi_lossy));
+
+	result = rangeset_make1(make_irange(lo, lo, lo_lossy));
+	if (hi - lo > 1)
+		result = rangeset_append(result, make_irange(lo + 1, hi - 1, false));
+	result = rangeset_append(result, make_irange(hi, hi, hi_lossy));
+
+	return result;
+}
+
+/*
+ * Scalar array expression
+ */
+static WrapperNode *
+handle_arrexpr(const ScalarArrayOpExpr *expr, WalkerContext *context)
+{
+	WrapperNode *result = (WrapperNode *)palloc(sizeof(WrapperNode));
+	Node		*varnode = (Node *) linitial(expr->args);
+	Node		*arraynode = (Node *) lsecond(expr->args);
+	const PartRelationInfo *prel = context->prel;
+
+	result->orig = (const Node *)expr;
+	result->args = NIL;
+	result->uncovered = UNCOVERED_ALL;
+	result->paramsel = 1.0;
+
+	Assert(varnode != NULL);
+
+	/* If variable is not the partition key then skip it */
+	if (PrelHasKeyExpression(prel) ?
+			!match_key_expression(prel, varnode) :
+			!is_key_column(prel, varnode))
+		goto handle_arrexpr_return;
+
+	/* Composite HASH key can't be handled by a single column */
+	if (PrelHasCompositeKey(prel))
+		goto handle_arrexpr_return;
+
+	/* Param is evaluated here as well if RuntimeAppend rescans the plan */
+	if (arraynode && IsConstValue(context, arraynode))
+	{
+		Const	   *arrayconst = ExtractConst(context, arraynode);
+		ArrayType  *arrayval;
+		int16		elmlen;
+		bool		elmbyval;
+		char		elmalign;
+		int			num_elems;
+		Datum	   *elem_values;
+		bool	   *elem_nulls;
+		bool	   *selected;
+		int			i;
+
+		if (arrayconst->constisnull)
+			goto handle_arrexpr_return;
+
+		/* Extract values from array */
+		arrayval = DatumGetArrayTypeP(arrayconst->constvalue);
+		get_typlenbyvalalign(ARR_ELEMTYPE(arrayval),
+							 &elmlen, &elmbyval, &elmalign);
+		deconstruct_array(arrayval,
+						  ARR_ELEMTYPE(arrayval),
+						  elmlen, elmbyval, elmalign,
+						  &elem_values, &elem_nulls, &num_elems);
+
+		result->rangeset = NULL;
+
+		switch (prel->parttype)
+		{
+			case PT_LIST:
 				{
-					Relids		existing_outers = (Relids) lfirst(lco);
+					TypeCacheEntry *tce;
+					FmgrInfo		cmp_func;
+					int				strategy;
 
-					if (bms_equal(existing_outers, childouter))
+					tce = lookup_type_cache(prel->atttype, TYPECACHE_BTREE_OPFAMILY);
+					strategy = get_op_opfamily_strategy(expr->opno, tce->btree_opf);
+
+					/* Only "= ANY" is supported at the moment */
+					if (strategy != BTEqualStrategyNumber || !expr->useOr)
 					{
-						found = true;
-						break;
+						pfree(elem_values);
+						pfree(elem_nulls);
+
+						goto handle_arrexpr_return;
+					}
+
+					fill_type_cmp_fmgr_info(&cmp_func,
+											ARR_ELEMTYPE(arrayval),
+											prel->atttype);
+
+					result->uncovered = UNCOVERED_NONE;
+					selected = palloc0(PrelChildrenCount(prel) * sizeof(bool));
+
+					/* Look up each value in the sorted ListEntry array */
+					for (i = 0; i < num_elems; i++)
+					{
+						WrapperNode	elem_result;
+
+						/* NULL never matches */
+						if (elem_nulls[i])
+							continue;
+
+						select_list_partitions(elem_values[i],
+											   &cmp_func,
+											   prel,
+											   BTEqualStrategyNumber,
+											   &elem_result);
+
+						if (elem_result.rangeset != NULL)
+							selected[rangeset_first(elem_result.rangeset).ir_lower] = true;
+						result->uncovered |= elem_result.uncovered;
 					}
+
+					/* Build rangeset in one pass */
+					result->rangeset = rangeset_from_flags(selected,
+														   PrelChildrenCount(prel),
+														   true);
+					pfree(selected);
 				}
-				if (!found)
+				break;
+
+			case PT_RANGE:
+				handle_range_arrexpr(prel, result, expr, varnode,
+									 ARR_ELEMTYPE(arrayval),
+									 elem_values, elem_nulls, num_elems);
+				break;
+
+			case PT_HASH:
 				{
-					/* No, so add it to all_child_outers */
-					all_child_outers = lappend(all_child_outers,
-											   childouter);
+					TypeCacheEntry *tce;
+					int				strategy;
+
+					tce = lookup_type_cache(prel->atttype, TYPECACHE_BTREE_OPFAMILY);
+					strategy = get_op_opfamily_strategy(expr->opno, tce->btree_opf);
+
+					/* Only "= ANY" can be mapped to hash values */
+					if (strategy != BTEqualStrategyNumber || !expr->useOr)
+					{
+						pfree(elem_values);
+						pfree(elem_nulls);
+
+						goto handle_arrexpr_return;
+					}
 				}
-			}
+
+				result->uncovered = UNCOVERED_NONE;
+				selected = palloc0(PrelChildrenCount(prel) * sizeof(bool));
+
+				/* Mark partitions which might contain listed values */
+				for (i = 0; i < num_elems; i++)
+				{
+					Datum		value;
+					uint32		idx;
+
+					/* NULL never matches */
+					if (elem_nulls[i])
+						continue;
+
+					/* Invoke base hash function for value type */
+					value = OidFunctionCall1(prel->hash_proc, elem_values[i]);
+					idx = hash_to_part_index(DatumGetInt32(value), PrelChildrenCount(prel));
+					selected[idx] = true;
+				}
+
+				/* Build rangeset in one pass */
+				result->rangeset = rangeset_from_flags(selected,
+													   PrelChildrenCount(prel),
+													   true);
+				pfree(selected);
+				break;
+
+			default:
+				elog(ERROR, "Unknown partitioning type %u", prel->parttype);
 		}
+
+		/* Free resources */
+		pfree(elem_values);
+		pfree(elem_nulls);
+
+		return result;
 	}
 
-	/*
-	 * If we found unparameterized paths for all children, build an unordered,
-	 * unparameterized Append path for the rel.  (Note: this is correct even
-	 * if we have zero or one live subpath due to constraint exclusion.)
-	 */
-	if (subpaths_valid)
-		add_path(rel, (Path *) create_append_path(rel, subpaths, NULL));
+	if (arraynode && IsA(arraynode, Param))
+		result->paramsel = DEFAULT_INEQ_SEL;
 
-	/*
-	 * Also build unparameterized MergeAppend paths based on the collected
-	 * list of child pathkeys.
-	 */
-	if (subpaths_valid)
-		generate_mergeappend_paths(root, rel, live_childrels,
-								   all_child_pathkeys, pathkeyAsc,
-								   pathkeyDesc);
+handle_arrexpr_return:
+	result->rangeset = rangeset_make1(make_irange(0, PrelLastChild(prel), true));
+	return result;
+}
 
-	/*
-	 * Build Append paths for each parameterization seen among the child rels.
-	 * (This may look pretty expensive, but in most cases of practical
-	 * interest, the child rels will expose mostly the same parameterizations,
-	 * so that not that many cases actually get considered here.)
-	 *
-	 * The Append node itself cannot enforce quals, so all qual checking must
-	 * be done in the child paths.  This means that to have a parameterized
-	 * Append path, we must have the exact same parameterization for each
-	 * child path; otherwise some children might be failing to check the
-	 * moved-down quals.  To make them match up, we can try to increase the
-	 * parameterization of lesser-parameterized paths.
-	 */
-	foreach(l, all_child_outers)
+/*
+ * Handle "KEY OP ANY|ALL (ARRAY[...])" for RANGE partitioning.
+ *
+ * Values are sorted, so that "=" ANY is resolved by a single merged sweep
+ * over 'ranges', while other operators are reduced to one comparison, e.g.
+ * "KEY < ANY (...)" is equivalent to "KEY < max(...)".
+ */
+static void
+handle_range_arrexpr(const PartRelationInfo *prel,
+					 WrapperNode *result,
+					 const ScalarArrayOpExpr *expr,
+					 const Node *varnode,
+					 Oid elemtype,
+					 const Datum *elem_values,
+					 const bool *elem_nulls,
+					 int num_elems)
+{
+	TypeCacheEntry *tce;
+	FmgrInfo		cmp_func;
+	ArrayCmpContext	sort_cxt;
+	int				strategy;
+	Datum		   *values;
+	int				nvalues = 0,
+					i;
+	bool			has_nulls = false;
+
+	tce = lookup_type_cache(exprType(varnode), TYPECACHE_BTREE_OPFAMILY);
+	strategy = get_op_opfamily_strategy(expr->opno, tce->btree_opf);
+
+	if (strategy == 0)
+	{
+		result->rangeset = rangeset_make1(make_irange(0, PrelLastChild(prel), true));
+		result->uncovered = UNCOVERED_ALL;
+		return;
+	}
+
+	/* Collect non-NULL values */
+	values = (Datum *) palloc(sizeof(Datum) * (num_elems + 1));
+	for (i = 0; i < num_elems; i++)
+	{
+		if (elem_nulls[i])
+			has_nulls = true;
+		else
+			values[nvalues++] = elem_values[i];
+	}
+
+	/* "ANY" without non-NULL values and "ALL" with NULLs are never true */
+	if (expr->useOr ? nvalues == 0 : has_nulls)
+	{
+		result->rangeset = NULL;
+		result->uncovered = UNCOVERED_NONE;
+		pfree(values);
+		return;
+	}
+
+	/* "ALL" over an empty array is always true */
+	if (nvalues == 0)
+	{
+		result->rangeset = rangeset_make1(make_irange(0, PrelLastChild(prel), true));
+		result->uncovered = UNCOVERED_ALL;
+		pfree(values);
+		return;
+	}
+
+	/* Sort values using the element type's comparison function */
+	tce = lookup_type_cache(elemtype, TYPECACHE_CMP_PROC_FINFO);
+	sort_cxt.cmp_func = &tce->cmp_proc_finfo;
+	sort_cxt.collid = prel->attcollid;
+	qsort_arg((void *) values, nvalues, sizeof(Datum),
+			  cmp_array_values, (void *) &sort_cxt);
+
+	fill_type_cmp_fmgr_info(&cmp_func, elemtype, prel->atttype);
+
+	switch (strategy)
+	{
+		case BTEqualStrategyNumber:
+			if (expr->useOr)
+				select_range_partitions_sorted(values, nvalues, &cmp_func,
+											   prel, result);
+
+			/* "KEY = ALL (...)" holds only if all values are equal */
+			else if (DatumGetInt32(FunctionCall2Coll(&tce->cmp_proc_finfo,
+													 prel->attcollid,
+													 values[0],
+													 values[nvalues - 1])) != 0)
+			{
+				result->rangeset = NULL;
+				result->uncovered = UNCOVERED_NONE;
+			}
+			else
+				select_range_partitions(values[0], &cmp_func,
+										prel->attcollid,
+										PrelGetRangesArray(prel),
+										PrelChildrenCount(prel),
+										strategy, result);
+			break;
+
+		case BTLessStrategyNumber:
+		case BTLessEqualStrategyNumber:
+			/* "< ANY" means "< max", "< ALL" means "< min" */
+			select_range_partitions(expr->useOr ? values[nvalues - 1] : values[0],
+									&cmp_func,
+									prel->attcollid,
+									PrelGetRangesArray(prel),
+									PrelChildrenCount(prel),
+									strategy, result);
+			break;
+
+		case BTGreaterEqualStrategyNumber:
+		case BTGreaterStrategyNumber:
+			/* "> ANY" means "> min", "> ALL" means "> max" */
+			select_range_partitions(expr->useOr ? values[0] : values[nvalues - 1],
+									&cmp_func,
+									prel->attcollid,
+									PrelGetRangesArray(prel),
+									PrelChildrenCount(prel),
+									strategy, result);
+			break;
+	}
+
+	/* Inequality might also select values from gaps */
+	if (strategy != BTEqualStrategyNumber && prel->has_gaps)
+		result->uncovered |= UNCOVERED_GAP;
+
+	pfree(values);
+}
+
+/*
+ * Select RANGE partitions containing any of the sorted 'values'.
+ * Both 'values' and 'ranges' are traversed only once.
+ */
+static void
+select_range_partitions_sorted(const Datum *values, int nvalues,
+							   FmgrInfo *cmp_func,
+							   const PartRelationInfo *prel,
+							   WrapperNode *result)
+{
+	const RangeEntry   *ranges = PrelGetRangesArray(prel);
+	uint32				nranges = PrelChildrenCount(prel),
+						idx = 0;
+	int					i;
+
+	result->rangeset = NULL;
+	result->found_gap = false;
+	result->uncovered = UNCOVERED_NONE;
+
+	for (i = 0; i < nvalues; i++)
+	{
+		/* Skip partitions which are entirely below this value */
+		while (idx < nranges &&
+			   DatumGetInt32(FunctionCall2Coll(cmp_func, prel->attcollid,
+											 values[i], ranges[idx].max)) >= 0)
+			idx++;
+
+		/* All remaining values are above the last partition */
+		if (idx == nranges)
+		{
+			result->uncovered |= UNCOVERED_ABOVE;
+			break;
+		}
+
+		/* Value is below the current partition */
+		if (DatumGetInt32(FunctionCall2Coll(cmp_func, prel->attcollid,
+											  values[i], ranges[idx].min)) < 0)
+		{
+			if (idx == 0)
+				result->uncovered |= UNCOVERED_BELOW;
+			else
+			{
+				result->uncovered |= UNCOVERED_GAP;
+				result->found_gap = true;
+			}
+
+			continue;
+		}
+
+		/* Extend the last IndexRange if possible */
+		if (result->rangeset != NULL &&
+			rangeset_last(result->rangeset).ir_upper + 1 >= idx)
+			rangeset_last(result->rangeset).ir_upper = idx;
+		else
+			result->rangeset = rangeset_append(result->rangeset,
+											   make_irange(idx, idx, true));
+	}
+}
+
+/* qsort comparison function for array values */
+static int
+cmp_array_values(const void *p1, const void *p2, void *arg)
+{
+	ArrayCmpContext *cxt = (ArrayCmpContext *) arg;
+
+	return DatumGetInt32(FunctionCall2Coll(cxt->cmp_func, cxt->collid,
+										   *(const Datum *) p1,
+										   *(const Datum *) p2));
+}
+
+/*
+ * Theres are functions below copied from allpaths.c with (or without) some
+ * modifications. Couldn't use original because of 'static' modifier.
+ */
+
+/*
+ * set_plain_rel_size
+ *	  Set size estimates for a plain relation (no subquery, no inheritance)
+ */
+static void
+set_plain_rel_size(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
+{
+	/*
+	 * Test any partial indexes of rel for applicability.  We must do this
+	 * first since partial unique indexes can affect size estimates.
+	 */
+	check_partial_indexes(root, rel);
+
+	/* Mark rel with estimated output rows, width, etc */
+	set_baserel_size_estimates(root, rel);
+}
+
+/*
+ * set_plain_rel_pathlist
+ *	  Build access paths for a plain relation (no subquery, no inheritance)
+ */
+static void
+set_plain_rel_pathlist(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
+{
+	Relids		required_outer;
+	Path *path;
+
+	/*
+	 * We don't support pushing join clauses into the quals of a seqscan, but
+	 * it could still have required parameterization due to LATERAL refs in
+	 * its tlist.
+	 */
+	required_outer = rel->lateral_relids;
+
+	/* Consider sequential scan */
+#if PG_VERSION_NUM >= 90600
+	path = create_seqscan_path(root, rel, required_outer, 0);
+#else
+	path = create_seqscan_path(root, rel, required_outer);
+#endif
+	add_path(rel, path);
+
+	/* Consider index scans */
+	create_index_paths(root, rel);
+
+	/* Consider TID scans */
+	create_tidscan_paths(root, rel);
+
+#if PG_VERSION_NUM >= 90600
+	/* If appropriate, consider parallel sequential scan */
+	if (rel->consider_parallel && required_outer == NULL)
+		create_plain_partial_paths(root, rel);
+#endif
+}
+
+#if PG_VERSION_NUM >= 90600
+/*
+ * create_plain_partial_paths
+ *	  Build partial access paths for parallel scan of a plain relation
+ */
+static void
+create_plain_partial_paths(PlannerInfo *root, RelOptInfo *rel)
+{
+	int			parallel_workers;
+
+	/*
+	 * If the user has set the parallel_workers reloption, use that; otherwise
+	 * select a default number of workers.
+	 */
+	if (rel->rel_parallel_workers != -1)
+		parallel_workers = rel->rel_parallel_workers;
+	else
+	{
+		int			parallel_threshold;
+
+		/*
+		 * If this relation is too small to be worth a parallel scan, just
+		 * return without doing anything ... unless it's a partition. It
+		 * might not be worthwhile just for this relation, but when combined
+		 * with all of its siblings it may well pay off.
+		 */
+		if (rel->pages < (BlockNumber) min_parallel_relation_size &&
+			rel->reloptkind == RELOPT_BASEREL)
+			return;
+
+		/*
+		 * Select the number of workers based on the log of the size of the
+		 * relation.
+		 */
+		parallel_workers = 1;
+		parallel_threshold = Max(min_parallel_relation_size, 1);
+		while (rel->pages >= (BlockNumber) (parallel_threshold * 3))
+		{
+			parallel_workers++;
+			parallel_threshold *= 3;
+			if (parallel_threshold > INT_MAX / 3)
+				break;			/* avoid overflow */
+		}
+	}
+
+	/*
+	 * In no case use more than max_parallel_workers_per_gather workers.
+	 */
+	parallel_workers = Min(parallel_workers, max_parallel_workers_per_gather);
+
+	/* If any limit was set to zero, the user doesn't want a parallel scan. */
+	if (parallel_workers <= 0)
+		return;
+
+	/* Add an unordered partial path based on a parallel sequential scan. */
+	add_partial_path(rel, create_seqscan_path(root, rel, NULL, parallel_workers));
+}
+#endif
+
+/*
+ * set_foreign_size
+ *		Set size estimates for a foreign table RTE
+ */
+static void
+set_foreign_size(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
+{
+	/* Mark rel with estimated output rows, width, etc */
+	set_foreign_size_estimates(root, rel);
+
+	/* Let FDW adjust the size estimates, if it can */
+	rel->fdwroutine->GetForeignRelSize(root, rel, rte->relid);
+
+	/* ... but do not let it set the rows estimate to zero */
+	rel->rows = clamp_row_est(rel->rows);
+}
+
+/*
+ * set_foreign_pathlist
+ *		Build access paths for a foreign table RTE
+ */
+static void
+set_foreign_pathlist(PlannerInfo *root, RelOptInfo *rel, RangeTblEntry *rte)
+{
+	/* Call the FDW's GetForeignPaths function to generate path(s) */
+	rel->fdwroutine->GetForeignPaths(root, rel, rte->relid);
+}
+
+/*
+ * set_append_rel_pathlist
+ *	  Build access paths for an "append relation"
+ */
+void
+set_append_rel_pathlist(PlannerInfo *root, RelOptInfo *rel,
+						Index rti, RangeTblEntry *rte,
+						PathKey *pathkeyAsc, PathKey *pathkeyDesc)
+{
+	Index		parentRTindex = rti;
+	List	   *live_childrels = NIL;
+	List	   *subpaths = NIL;
+	bool		subpaths_valid = true;
+#if PG_VERSION_NUM >= 90600
+	List	   *partial_subpaths = NIL;
+	bool		partial_subpaths_valid = rel->consider_parallel;
+#endif
+	List	   *all_child_pathkeys = NIL;
+	List	   *all_child_outers = NIL;
+	ListCell   *l;
+
+	/*
+	 * Generate access paths for each member relation, and remember the
+	 * cheapest path for each one.  Also, identify all pathkeys (orderings)
+	 * and parameterizations (required_outer sets) available for the member
+	 * relations.
+	 */
+	foreach(l, root->append_rel_list)
+	{
+		AppendRelInfo *appinfo = (AppendRelInfo *) lfirst(l);
+		Index		childRTindex;
+		RangeTblEntry *childRTE;
+		RelOptInfo *childrel;
+		const PartRelationInfo *child_prel;
+		ListCell   *lcp;
+
+		/* append_rel_list contains all append rels; ignore others */
+		if (appinfo->parent_relid != parentRTindex)
+			continue;
+
+		/* Re-locate the child RTE and RelOptInfo */
+		childRTindex = appinfo->child_relid;
+		childRTE = root->simple_rte_array[childRTindex];
+		childrel = root->simple_rel_array[childRTindex];
+
+#if PG_VERSION_NUM >= 90600
+		/*
+		 * Partitions inherit quals and target list of the parent, so they
+		 * are as parallel-safe as the parent itself (foreign and temporary
+		 * partitions excepted).
+		 */
+		childrel->consider_parallel = rel->consider_parallel &&
+			childRTE->relkind != RELKIND_FOREIGN_TABLE &&
+			get_rel_persistence(childRTE->relid) != RELPERSISTENCE_TEMP;
+#endif
+
+		/*
+		 * Compute the child's access paths.
+		 */
+		if (childRTE->relkind == RELKIND_FOREIGN_TABLE)
+		{
+			set_foreign_size(root, childrel, childRTE);
+			set_foreign_pathlist(root, childrel, childRTE);
+		}
+		/* Partition is partitioned as well (but it's not the parent itself) */
+		else if (childRTE->relid != rte->relid &&
+				 (child_prel = get_pathman_relation_info(childRTE->relid)) != NULL)
+		{
+			set_partitioned_rel_pathlist(root, childrel, childRTindex,
+										 childRTE, child_prel);
+		}
+		else
+		{
+			set_plain_rel_size(root, childrel, childRTE);
+			set_plain_rel_pathlist(root, childrel, childRTE);
+		}
+		set_cheapest(childrel);
+
+		/*
+		 * If child is dummy, ignore it.
+		 */
+		if (IS_DUMMY_REL(childrel))
+			continue;
+
+		/*
+		 * Child is live, so add it to the live_childrels list for use below.
+		 */
+		live_childrels = lappend(live_childrels, childrel);
+
+		/*
+		 * If child has an unparameterized cheapest-total path, add that to
+		 * the unparameterized Append path we are constructing for the parent.
+		 * If not, there's no workable unparameterized path.
+		 */
+		if (childrel->cheapest_total_path->param_info == NULL)
+			subpaths = accumulate_append_subpath(subpaths,
+											  childrel->cheapest_total_path);
+		else
+			subpaths_valid = false;
+
+#if PG_VERSION_NUM >= 90600
+		/* Same idea, but for a partial plan. */
+		if (childrel->partial_pathlist != NIL)
+			partial_subpaths = accumulate_append_subpath(partial_subpaths,
+									   linitial(childrel->partial_pathlist));
+		else
+			partial_subpaths_valid = false;
+#endif
+
+		/*
+		 * Collect lists of all the available path orderings and
+		 * parameterizations for all the children.  We use these as a
+		 * heuristic to indicate which sort orderings and parameterizations we
+		 * should build Append and MergeAppend paths for.
+		 */
+		foreach(lcp, childrel->pathlist)
+		{
+			Path	   *childpath = (Path *) lfirst(lcp);
+			List	   *childkeys = childpath->pathkeys;
+			Relids		childouter = PATH_REQ_OUTER(childpath);
+
+			/* Unsorted paths don't contribute to pathkey list */
+			if (childkeys != NIL)
+			{
+				ListCell   *lpk;
+				bool		found = false;
+
+				/* Have we already seen this ordering? */
+				foreach(lpk, all_child_pathkeys)
+				{
+					List	   *existing_pathkeys = (List *) lfirst(lpk);
+
+					if (compare_pathkeys(existing_pathkeys,
+										 childkeys) == PATHKEYS_EQUAL)
+					{
+						found = true;
+						break;
+					}
+				}
+				if (!found)
+				{
+					/* No, so add it to all_child_pathkeys */
+					all_child_pathkeys = lappend(all_child_pathkeys,
+												 childkeys);
+				}
+			}
+
+			/* Unparameterized paths don't contribute to param-set list */
+			if (childouter)
+			{
+				ListCell   *lco;
+				bool		found = false;
+
+				/* Have we already seen this param set? */
+				foreach(lco, all_child_outers)
+				{
+					Relids		existing_outers = (Relids) lfirst(lco);
+
+					if (bms_equal(existing_outers, childouter))
+					{
+						found = true;
+						break;
+					}
+				}
+				if (!found)
+				{
+					/* No, so add it to all_child_outers */
+					all_child_outers = lappend(all_child_outers,
+											   childouter);
+				}
+			}
+		}
+	}
+
+	/*
+	 * If we found unparameterized paths for all children, build an unordered,
+	 * unparameterized Append path for the rel.  (Note: this is correct even
+	 * if we have zero or one live subpath due to constraint exclusion.)
+	 */
+	if (subpaths_valid)
+		add_path(rel, (Path *)
+				 create_append_path_compat(rel, subpaths, NULL, 0));
+
+#if PG_VERSION_NUM >= 90600
+	/*
+	 * Consider an append of partial unordered, unparameterized partial paths
+	 * of selected partitions. Workers of Gather share blocks of each parallel
+	 * scan, so they go through partitions together and large ones are split
+	 * into block ranges.
+	 */
+	if (partial_subpaths_valid && partial_subpaths != NIL)
+	{
+		AppendPath *appendpath;
+		int			parallel_workers = 0;
+
+		/*
+		 * Decide on the number of workers to request for this append path.
+		 * Append doesn't spread workers among partitions, so we just use the
+		 * maximum value from among the members.
+		 */
+		foreach(l, partial_subpaths)
+		{
+			Path	   *path = lfirst(l);
+
+			parallel_workers = Max(parallel_workers, path->parallel_workers);
+		}
+		Assert(parallel_workers > 0);
+
+		/* Generate a partial append path. */
+		appendpath = create_append_path_compat(rel, partial_subpaths, NULL,
+											   parallel_workers);
+		add_partial_path(rel, (Path *) appendpath);
+	}
+#endif
+
+	/*
+	 * Also build unparameterized MergeAppend paths based on the collected
+	 * list of child pathkeys.
+	 */
+	if (subpaths_valid)
+		generate_mergeappend_paths(root, rel, live_childrels,
+								   all_child_pathkeys, pathkeyAsc,
+								   pathkeyDesc);
+
+	/*
+	 * Build Append paths for each parameterization seen among the child rels.
+	 * (This may look pretty expensive, but in most cases of practical
+	 * interest, the child rels will expose mostly the same parameterizations,
+	 * so that not that many cases actually get considered here.)
+	 *
+	 * The Append node itself cannot enforce quals, so all qual checking must
+	 * be done in the child paths.  This means that to have a parameterized
+	 * Append path, we must have the exact same parameterization for each
+	 * child path; otherwise some children might be failing to check the
+	 * moved-down quals.  To make them match up, we can try to increase the
+	 * parameterization of lesser-parameterized paths.
+	 */
+	foreach(l, all_child_outers)
+	{
+		Relids		required_outer = (Relids) lfirst(l);
+		ListCell   *lcr;
+
+		/* Select the child paths for an Append with this parameterization */
+		subpaths = NIL;
+		subpaths_valid = true;
+		foreach(lcr, live_childrels)
+		{
+			RelOptInfo *childrel = (RelOptInfo *) lfirst(lcr);
+			Path	   *subpath;
+
+			subpath = get_cheapest_parameterized_child_path(root,
+															childrel,
+															required_outer);
+			if (subpath == NULL)
+			{
+				/* failed to make a suitable path for this child */
+				subpaths_valid = false;
+				break;
+			}
+			subpaths = accumulate_append_subpath(subpaths, subpath);
+		}
+
+		if (subpaths_valid)
+			add_path(rel, (Path *)
+					 create_append_path_compat(rel, subpaths, required_outer, 0));
+	}
+}
+
+static List *
+accumulate_append_subpath(List *subpaths, Path *path)
+{
+	return lappend(subpaths, path);
+}
+
+/*
+ * get_cheapest_parameterized_child_path
+ *		Get cheapest path for this relation that has exactly the requested
+ *		parameterization.
+ *
+ * Returns NULL if unable to create such a path.
+ */
+static Path *
+get_cheapest_parameterized_child_path(PlannerInfo *root, RelOptInfo *rel,
+									  Relids required_outer)
+{
+	Path	   *cheapest;
+	ListCell   *lc;
+
+	/*
+	 * Look up the cheapest existing path with no more than the needed
+	 * parameterization.  If it has exactly the needed parameterization, we're
+	 * done.
+	 */
+	cheapest = get_cheapest_path_for_pathkeys(rel->pathlist,
+											  NIL,
+											  required_outer,
+											  TOTAL_COST);
+	Assert(cheapest != NULL);
+	if (bms_equal(PATH_REQ_OUTER(cheapest), required_outer))
+		return cheapest;
+
+	/*
+	 * Otherwise, we can "reparameterize" an existing path to match the given
+	 * parameterization, which effectively means pushing down additional
+	 * joinquals to be checked within the path's scan.  However, some existing
+	 * paths might check the available joinquals already while others don't;
+	 * therefore, it's not clear which existing path will be cheapest after
+	 * reparameterization.  We have to go through them all and find out.
+	 */
+	cheapest = NULL;
+	foreach(lc, rel->pathlist)
+	{
+		Path	   *path = (Path *) lfirst(lc);
+
+		/* Can't use it if it needs more than requested parameterization */
+		if (!bms_is_subset(PATH_REQ_OUTER(path), required_outer))
+			continue;
+
+		/*
+		 * Reparameterization can only increase the path's cost, so if it's
+		 * already more expensive than the current cheapest, forget it.
+		 */
+		if (cheapest != NULL &&
+			compare_path_costs(cheapest, path, TOTAL_COST) <= 0)
+			continue;
+
+		/* Reparameterize if needed, then recheck cost */
+		if (!bms_equal(PATH_REQ_OUTER(path), required_outer))
+		{
+			path = reparameterize_path(root, path, required_outer, 1.0);
+			if (path == NULL)
+				continue;		/* failed to reparameterize this one */
+			Assert(bms_equal(PATH_REQ_OUTER(path), required_outer));
+
+			if (cheapest != NULL &&
+				compare_path_costs(cheapest, path, TOTAL_COST) <= 0)
+				continue;
+		}
+
+		/* We have a new best path */
+		cheapest = path;
+	}
+
+	/* Return the best path, or NULL if we found no suitable candidate */
+	return cheapest;
+}
+
+/*
+ * generate_mergeappend_paths
+ *		Generate MergeAppend paths for an append relation
+ *
+ * Generate a path for each ordering (pathkey list) appearing in
+ * all_child_pathkeys.
+ *
+ * We consider both cheapest-startup and cheapest-total cases, ie, for each
+ * interesting ordering, collect all the cheapest startup subpaths and all the
+ * cheapest total paths, and build a MergeAppend path for each case.
+ *
+ * We don't currently generate any parameterized MergeAppend paths.  While
+ * it would not take much more code here to do so, it's very unclear that it
+ * is worth the planning cycles to investigate such paths: there's little
+ * use for an ordered path on the inside of a nestloop.  In fact, it's likely
+ * that the current coding of add_path would reject such paths out of hand,
+ * because add_path gives no credit for sort ordering of parameterized paths,
+ * and a parameterized MergeAppend is going to be more expensive than the
+ * corresponding parameterized Append path.  If we ever try harder to support
+ * parameterized mergejoin plans, it might be worth adding support for
+ * parameterized MergeAppends to feed such joins.  (See notes in
+ * optimizer/README for why that might not ever happen, though.)
+ */
+static void
+generate_mergeappend_paths(PlannerInfo *root, RelOptInfo *rel,
+						   List *live_childrels,
+						   List *all_child_pathkeys,
+						   PathKey *pathkeyAsc, PathKey *pathkeyDesc)
+{
+	ListCell   *lcp;
+
+	foreach(lcp, all_child_pathkeys)
+	{
+		List	   *pathkeys = (List *) lfirst(lcp);
+		List	   *startup_subpaths = NIL;
+		List	   *total_subpaths = NIL;
+		bool		startup_neq_total = false;
+		bool		presorted = true;
+		bool		ordered_append;
+		ListCell   *lcr;
+
+		/* Partitions are sorted by bounds, so Append preserves this ordering */
+		ordered_append = (PathKey *) linitial(pathkeys) == pathkeyAsc ||
+						 (PathKey *) linitial(pathkeys) == pathkeyDesc;
+
+		/* Select the child paths for this ordering... */
+		foreach(lcr, live_childrels)
+		{
+			RelOptInfo *childrel = (RelOptInfo *) lfirst(lcr);
+			Path	   *cheapest_startup,
+					   *cheapest_total;
+
+			/* Locate the right paths, if they are available. */
+			cheapest_startup =
+				get_cheapest_path_for_pathkeys(childrel->pathlist,
+											   pathkeys,
+											   NULL,
+											   STARTUP_COST);
+			cheapest_total =
+				get_cheapest_path_for_pathkeys(childrel->pathlist,
+											   pathkeys,
+											   NULL,
+											   TOTAL_COST);
+
+			/*
+			 * If we can't find any paths with the right order just use the
+			 * cheapest-total path; we'll have to sort it later.
+			 */
+			if (cheapest_startup == NULL || cheapest_total == NULL)
+			{
+				cheapest_startup = cheapest_total =
+					childrel->cheapest_total_path;
+				/* Assert we do have an unparameterized path for this child */
+				Assert(cheapest_total->param_info == NULL);
+#if PG_VERSION_NUM >= 90600
+				/*
+				 * Ordered Append may sort each child on its own, so that
+				 * only the children it actually reaches will be sorted.
+				 */
+				if (ordered_append)
+					cheapest_startup = cheapest_total = (Path *)
+							create_sort_path(root, childrel, cheapest_total,
+											 pathkeys, -1.0);
+				else
+#endif
+				presorted = false;
+			}
+
+			/*
+			 * Notice whether we actually have different paths for the
+			 * "cheapest" and "total" cases; frequently there will be no point
+			 * in two create_merge_append_path() calls.
+			 */
+			if (cheapest_startup != cheapest_total)
+				startup_neq_total = true;
+
+			startup_subpaths =
+				accumulate_append_subpath(startup_subpaths, cheapest_startup);
+			total_subpaths =
+				accumulate_append_subpath(total_subpaths, cheapest_total);
+		}
+
+		/*
+		 * When first pathkey matching ascending/descending sort by partition
+		 * column then build path with Append node, because MergeAppend is not
+		 * required in this case.
+		 */
+		if ((PathKey *) linitial(pathkeys) == pathkeyAsc && presorted)
+		{
+			Path *path;
+
+			path = (Path *) create_append_path_compat(rel, startup_subpaths, NULL, 0);
+			path->pathkeys = pathkeys;
+			add_path(rel, path);
+
+			if (startup_neq_total)
+			{
+				path = (Path *) create_append_path_compat(rel, total_subpaths, NULL, 0);
+				path->pathkeys = pathkeys;
+				add_path(rel, path);
+			}
+		}
+		else if ((PathKey *) linitial(pathkeys) == pathkeyDesc && presorted)
+		{
+			/*
+			 * When pathkey is descending sort by partition column then we
+			 * need to scan partitions in reversed order.
+			 */
+			Path *path;
+
+			path = (Path *) create_append_path_compat(rel,
+								list_reverse(startup_subpaths), NULL, 0);
+			path->pathkeys = pathkeys;
+			add_path(rel, path);
+
+			if (startup_neq_total)
+			{
+				path = (Path *) create_append_path_compat(rel,
+								list_reverse(total_subpaths), NULL, 0);
+				path->pathkeys = pathkeys;
+				add_path(rel, path);
+			}
+		}
+		else
+		{
+			/* ... and build the MergeAppend paths */
+			add_path(rel, (Path *) create_merge_append_path(root,
+															rel,
+															startup_subpaths,
+															pathkeys,
+															NULL));
+			if (startup_neq_total)
+				add_path(rel, (Path *) create_merge_append_path(root,
+																rel,
+																total_subpaths,
+																pathkeys,
+																NULL));
+		}
+	}
+}
+
+#if PG_VERSION_NUM >= 90600
+/*
+ * add_partitionwise_agg_paths
+ *		Push aggregation below Append of partitions
+ *
+ * If every group of the query resides in a single partition (see
+ * groups_fit_partitions()), each partition is aggregated on its own.
+ * Results are streamed partition by partition, and hash tables are much
+ * smaller than the one HashAggregate on top of Append would build.
+ *
+ * Otherwise partitions may be aggregated partially (if all aggregates
+ * support this), so that only per-partition groups flow through Append
+ * and get combined by the final Agg.
+ */
+void
+add_partitionwise_agg_paths(PlannerInfo *root, RelOptInfo *input_rel,
+							RelOptInfo *grouped_rel,
+							const PartRelationInfo *prel)
+{
+	Query		   *parse = root->parse;
+	PathTarget	   *input_target,
+				   *grouping_target,
+				   *child_target;
+	AggClauseCosts	agg_costs,
+					agg_partial_costs;
+	AggStrategy		strategy;
+	AggSplit		aggsplit;
+	List		   *group_exprs,
+				   *having,
+				   *subpaths = NIL;
+	double			total_groups,
+					partial_groups = 0.0;
+	bool			partial;
+	Path		   *path;
+	ListCell	   *lc;
+
+	/* Parent's rows would form separate groups */
+	if (prel->enable_parent || parse->hasTargetSRFs)
+		return;
+
+	/* Partitions will use hashed aggregation (if there's GROUP BY) */
+	if (parse->groupClause != NIL &&
+		(!enable_hashagg || !grouping_is_hashable(parse->groupClause)))
+		return;
+
+	/* Paths of 'input_rel' have already been projected to scan/join target */
+	input_target = input_rel->cheapest_total_path->pathtarget;
+	grouping_target = root->upper_targets[UPPERREL_GROUP_AGG];
+
+	MemSet(&agg_costs, 0, sizeof(AggClauseCosts));
+	get_agg_clause_costs(root, (Node *) grouping_target->exprs,
+						 AGGSPLIT_SIMPLE, &agg_costs);
+	get_agg_clause_costs(root, parse->havingQual,
+						 AGGSPLIT_SIMPLE, &agg_costs);
+
+	partial = parse->groupClause == NIL || !groups_fit_partitions(root, prel);
+
+	if (partial)
+	{
+		/* Partial results are passed as if they were sent by workers */
+		if (!parse->hasAggs || agg_costs.hasNonPartial || agg_costs.hasNonSerial)
+			return;
+
+		child_target = make_partial_agg_target(root, grouping_target);
+		aggsplit = AGGSPLIT_INITIAL_SERIAL;
+		having = NIL; /* to be checked by the final Agg */
+
+		MemSet(&agg_partial_costs, 0, sizeof(AggClauseCosts));
+		get_agg_clause_costs(root, (Node *) child_target->exprs,
+							 AGGSPLIT_INITIAL_SERIAL, &agg_partial_costs);
+	}
+	else
+	{
+		child_target = grouping_target;
+		aggsplit = AGGSPLIT_SIMPLE;
+		having = (List *) parse->havingQual;
+
+		agg_partial_costs = agg_costs;
+	}
+
+	strategy = (parse->groupClause != NIL) ? AGG_HASHED : AGG_PLAIN;
+
+	group_exprs = get_sortgrouplist_exprs(parse->groupClause,
+										  parse->targetList);
+	total_groups = (parse->groupClause != NIL) ?
+						estimate_num_groups(root, group_exprs,
+											input_rel->rows, NULL) :
+						1.0;
+
+	foreach (lc, root->append_rel_list)
+	{
+		AppendRelInfo  *appinfo = (AppendRelInfo *) lfirst(lc);
+		RelOptInfo	   *childrel;
+		PathTarget	   *child_input_target,
+					   *child_grouping_target;
+		List		   *child_having;
+		Path		   *child_path;
+		double			num_groups;
+
+		/* append_rel_list contains all append rels; ignore others */
+		if (appinfo->parent_relid != input_rel->relid)
+			continue;
+
+		childrel = root->simple_rel_array[appinfo->child_relid];
+
+		if (IS_DUMMY_REL(childrel))
+			continue;
+
+		child_path = childrel->cheapest_total_path;
+		if (child_path->param_info != NULL)
+			return;
+
+		if (strategy == AGG_PLAIN)
+			num_groups = 1.0;
+
+		/* Each partition contains some values of every group */
+		else if (partial)
+			num_groups = estimate_num_groups(root,
+											 (List *) adjust_appendrel_attrs(root,
+																			 (Node *) group_exprs,
+																			 appinfo),
+											 childrel->rows, NULL);
+
+		/* Groups are distributed among partitions just like rows */
+		else
+			num_groups = clamp_row_est(total_groups * childrel->rows /
+									   input_rel->rows);
+
+		if (strategy == AGG_HASHED &&
+			!hashagg_fits_work_mem(child_path, &agg_partial_costs, num_groups))
+			return;
+
+		partial_groups += num_groups;
+
+		/* Translate targets and HAVING to the partition's attributes */
+		child_input_target = copy_pathtarget(input_target);
+		child_input_target->exprs = (List *)
+				adjust_appendrel_attrs(root, (Node *) input_target->exprs,
+									   appinfo);
+
+		child_grouping_target = copy_pathtarget(child_target);
+		child_grouping_target->exprs = (List *)
+				adjust_appendrel_attrs(root, (Node *) child_target->exprs,
+									   appinfo);
+
+		child_having = (List *) adjust_appendrel_attrs(root,
+													   (Node *) having,
+													   appinfo);
+
+		/* Agg needs GROUP BY columns labeled with sortgrouprefs */
+		child_path = create_child_projection_path(root, childrel,
+												  child_path,
+												  child_input_target);
+
+		child_path = (Path *) create_agg_path(root, childrel, child_path,
+											  child_grouping_target,
+											  strategy,
+											  aggsplit,
+											  parse->groupClause,
+											  child_having,
+											  &agg_partial_costs,
+											  num_groups);
+
+		subpaths = accumulate_append_subpath(subpaths, child_path);
+	}
+
+	if (subpaths == NIL)
+		return;
+
+	path = (Path *) create_append_path_compat(grouped_rel, subpaths, NULL, 0);
+	path->pathtarget = child_target;
+
+	/* Combine partial results of partitions */
+	if (partial)
+	{
+		AggClauseCosts agg_final_costs;
+
+		MemSet(&agg_final_costs, 0, sizeof(AggClauseCosts));
+		get_agg_clause_costs(root, (Node *) grouping_target->exprs,
+							 AGGSPLIT_FINAL_DESERIAL, &agg_final_costs);
+		get_agg_clause_costs(root, parse->havingQual,
+							 AGGSPLIT_FINAL_DESERIAL, &agg_final_costs);
+
+		if (strategy == AGG_HASHED &&
+			!hashagg_fits_work_mem(path, &agg_final_costs, total_groups))
+		{
+			if (!grouping_is_sortable(parse->groupClause))
+				return;
+
+			path = (Path *) create_sort_path(root, grouped_rel, path,
+											 root->group_pathkeys, -1.0);
+			strategy = AGG_SORTED;
+		}
+
+		path = (Path *) create_agg_path(root, grouped_rel, path,
+										grouping_target,
+										strategy,
+										AGGSPLIT_FINAL_DESERIAL,
+										parse->groupClause,
+										(List *) parse->havingQual,
+										&agg_final_costs,
+										total_groups);
+	}
+
+	add_path(grouped_rel, path);
+}
+
+/*
+ * Check that hash table of aggregation fits in work_mem
+ * (cf. estimate_hashagg_tablesize() in planner.c).
+ */
+static bool
+hashagg_fits_work_mem(Path *input_path, const AggClauseCosts *agg_costs,
+					  double num_groups)
+{
+	Size hashentrysize;
+
+	hashentrysize = MAXALIGN(input_path->pathtarget->width) +
+					MAXALIGN(SizeofMinimalTupleHeader) +
+					agg_costs->transitionSpace +
+					hash_agg_entry_size(agg_costs->numAggs);
+
+	return hashentrysize * num_groups <= work_mem * 1024L;
+}
+
+/*
+ * Project partition's path to 'target'. Unlike create_projection_path(),
+ * don't charge for a separate Result if the path is projection capable
+ * (cf. apply_projection_to_path(), which would modify the path in place,
+ * but it's shared with Append paths of the parent).
+ */
+static Path *
+create_child_projection_path(PlannerInfo *root, RelOptInfo *childrel,
+							 Path *subpath, PathTarget *target)
+{
+	Path *path = (Path *) create_projection_path(root, childrel,
+												 subpath, target);
+
+	if (is_projection_capable_path(subpath))
+	{
+		QualCost oldcost = subpath->pathtarget->cost;
+
+		path->startup_cost = subpath->startup_cost +
+							 target->cost.startup - oldcost.startup;
+		path->total_cost = subpath->total_cost +
+						   target->cost.startup - oldcost.startup +
+						   (target->cost.per_tuple - oldcost.per_tuple) * subpath->rows;
+	}
+
+	return path;
+}
+
+/*
+ * Build target of partial aggregation: GROUP BY expressions, Vars and
+ * Aggrefs (in partial mode) needed to compute the final target & HAVING
+ * (copied from make_partial_grouping_target() in planner.c).
+ */
+static PathTarget *
+make_partial_agg_target(PlannerInfo *root, PathTarget *grouping_target)
+{
+	Query	   *parse = root->parse;
+	PathTarget *partial_target;
+	List	   *non_group_cols;
+	List	   *non_group_exprs;
+	int			i;
+	ListCell   *lc;
+
+	partial_target = create_empty_pathtarget();
+	non_group_cols = NIL;
+
+	i = 0;
+	foreach(lc, grouping_target->exprs)
+	{
+		Expr	   *expr = (Expr *) lfirst(lc);
+		Index		sgref = get_pathtarget_sortgroupref(grouping_target, i);
+
+		if (sgref && parse->groupClause &&
+			get_sortgroupref_clause_noerr(sgref, parse->groupClause) != NULL)
+		{
+			/* It's a grouping column, so add it to the target as-is */
+			add_column_to_pathtarget(partial_target, expr, sgref);
+		}
+		else
+		{
+			/* Non-grouping column, pull Vars and Aggrefs from it later */
+			non_group_cols = lappend(non_group_cols, expr);
+		}
+
+		i++;
+	}
+
+	/* We'll need the Vars/Aggrefs of HAVING, too */
+	if (parse->havingQual)
+		non_group_cols = lappend(non_group_cols, parse->havingQual);
+
+	non_group_exprs = pull_var_clause((Node *) non_group_cols,
+									  PVC_INCLUDE_AGGREGATES |
+									  PVC_RECURSE_WINDOWFUNCS |
+									  PVC_INCLUDE_PLACEHOLDERS);
+
+	add_new_columns_to_pathtarget(partial_target, non_group_exprs);
+
+	/* Put Aggrefs into partial mode */
+	foreach(lc, partial_target->exprs)
+	{
+		Aggref *aggref = (Aggref *) lfirst(lc);
+
+		if (IsA(aggref, Aggref))
+		{
+			Aggref *newaggref = makeNode(Aggref);
+
+			memcpy(newaggref, aggref, sizeof(Aggref));
+			mark_partial_aggref(newaggref, AGGSPLIT_INITIAL_SERIAL);
+
+			lfirst(lc) = newaggref;
+		}
+	}
+
+	list_free(non_group_exprs);
+	list_free(non_group_cols);
+
+	return set_pathtarget_cost_width(root, partial_target);
+}
+
+/*
+ * Check that each group of the query is contained in a single partition,
+ * i.e. that GROUP BY includes all columns of the partitioning key, the
+ * partitioning expression or date_trunc() aligned with RANGE bounds.
+ */
+static bool
+groups_fit_partitions(PlannerInfo *root, const PartRelationInfo *prel)
+{
+	List	   *group_exprs;
+	ListCell   *lc;
+	int			i;
+
+	group_exprs = get_sortgrouplist_exprs(root->parse->groupClause,
+										  root->parse->targetList);
+
+	for (i = 0; i < prel->key_natts; i++)
+	{
+		bool found = false;
+
+		foreach (lc, group_exprs)
+		{
+			Node *expr = (Node *) lfirst(lc);
+
+			if (IsA(expr, RelabelType))
+				expr = (Node *) ((RelabelType *) expr)->arg;
+
+			if (IsA(expr, Var) &&
+				((Var *) expr)->varattno == prel->key_attnums[i])
+			{
+				found = true;
+				break;
+			}
+		}
+
+		if (!found)
+			break;
+	}
+
+	/* All columns of the key are grouped */
+	if (i == prel->key_natts)
+		return true;
+
+	foreach (lc, group_exprs)
+	{
+		Node *expr = (Node *) lfirst(lc);
+
+		if (match_key_expression(prel, expr) ||
+			is_aligned_date_trunc(prel, expr))
+			return true;
+	}
+
+	return false;
+}
+
+/*
+ * Check if 'node' is "date_trunc(UNIT, KEY)" of a timestamp RANGE key,
+ * and each bound is the start of some UNIT, e.g. daily or monthly
+ * partitions for 'day'. Since date_trunc(UNIT, KEY) <= KEY, truncated
+ * values of different partitions (and gaps between them) never meet.
+ */
+static bool
+is_aligned_date_trunc(const PartRelationInfo *prel, const Node *node)
+{
+	const FuncExpr *func = (const FuncExpr *) node;
+	const Const	   *unit;
+	RangeEntry	   *ranges;
+	uint32			i;
+
+	if (!IsA(node, FuncExpr) || func->funcid != F_TIMESTAMP_TRUNC ||
+		prel->parttype != PT_RANGE || PrelHasKeyExpression(prel) ||
+		prel->atttype != TIMESTAMPOID)
+		return false;
+
+	unit = (const Const *) linitial(func->args);
+	if (!IsA(unit, Const) || unit->constisnull ||
+		!is_key_column(prel, lsecond(func->args)))
+		return false;
+
+	ranges = PrelGetRangesArray(prel);
+	for (i = 0; i < PrelChildrenCount(prel); i++)
+	{
+		Datum	min = DirectFunctionCall2(timestamp_trunc,
+										  unit->constvalue, ranges[i].min),
+				max = DirectFunctionCall2(timestamp_trunc,
+										  unit->constvalue, ranges[i].max);
+
+		if (DatumGetTimestamp(min) != DatumGetTimestamp(ranges[i].min) ||
+			DatumGetTimestamp(max) != DatumGetTimestamp(ranges[i].max))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+ * add_partitionwise_join_paths
+ *		Join equally partitioned relations partition by partition
+ *
+ * If both relations have the same partitions (identical RANGE bounds or
+ * number of HASH partitions) and are joined by their keys, only rows of
+ * corresponding partitions may match. In this case we build Append of
+ * per-partition HashJoins, each of them having a much smaller hash table.
+ */
+void
+add_partitionwise_join_paths(PlannerInfo *root, RelOptInfo *joinrel,
+							 RelOptInfo *outerrel, RelOptInfo *innerrel,
+							 JoinType jointype, JoinPathExtraData *extra)
+{
+	RangeTblEntry		   *outer_rte,
+						   *inner_rte;
+	const PartRelationInfo *outer_prel,
+						   *inner_prel;
+	AppendRelInfo		  **outer_parts,
+						  **inner_parts;
+	List				   *subpaths = NIL;
+	bool					found = false;
+	ListCell			   *lc;
+	uint32					i;
+
+	/* Unmatched partitions would have to be NULL-extended for outer joins */
+	if (jointype != JOIN_INNER ||
+		outerrel->reloptkind != RELOPT_BASEREL ||
+		innerrel->reloptkind != RELOPT_BASEREL)
+		return;
+
+	outer_rte = root->simple_rte_array[outerrel->relid];
+	inner_rte = root->simple_rte_array[innerrel->relid];
+
+	/* Both relations should have been expanded by pg_pathman */
+	if (!outer_rte->inh || !inner_rte->inh ||
+		!(outer_prel = get_pathman_relation_info(outer_rte->relid)) ||
+		!(inner_prel = get_pathman_relation_info(inner_rte->relid)))
+		return;
+
+	if (!partitions_are_equal(outer_prel, inner_prel))
+		return;
+
+	/* Relations should be joined by their partitioning keys */
+	foreach (lc, extra->restrictlist)
+	{
+		if (is_key_equijoin_clause((RestrictInfo *) lfirst(lc),
+								   outer_prel, outerrel->relid,
+								   inner_prel, innerrel->relid))
+		{
+			found = true;
+			break;
+		}
+	}
+
+	if (!found)
+		return;
+
+	outer_parts = get_partition_appinfos(root, outerrel->relid, outer_prel);
+	inner_parts = get_partition_appinfos(root, innerrel->relid, inner_prel);
+
+	/* Default partitions (if any) are joined with each other as well */
+	for (i = 0; i <= PrelChildrenCount(outer_prel); i++)
+	{
+		Path *path;
+
+		/* Inner join of a pruned partition yields nothing */
+		if (!outer_parts[i] || !inner_parts[i])
+			continue;
+
+		path = create_partition_join_path(root, joinrel,
+										  outer_parts[i], inner_parts[i],
+										  extra);
+
+		/* Every pair of partitions has to be joined */
+		if (!path)
+			return;
+
+		subpaths = accumulate_append_subpath(subpaths, path);
+	}
+
+	if (subpaths != NIL)
+		add_path(joinrel, (Path *)
+				 create_append_path_compat(joinrel, subpaths, NULL, 0));
+}
+
+/*
+ * Check that relations have exactly the same partitions.
+ */
+static bool
+partitions_are_equal(const PartRelationInfo *prel1,
+					 const PartRelationInfo *prel2)
+{
+	RangeEntry *ranges1,
+			   *ranges2;
+	FmgrInfo	cmp_func;
+	uint32		i;
+
+	if (prel1->parttype != prel2->parttype ||
+		prel1->atttype != prel2->atttype ||
+		prel1->attcollid != prel2->attcollid ||
+		PrelChildrenCount(prel1) != PrelChildrenCount(prel2) ||
+		PrelHasDefaultPart(prel1) != PrelHasDefaultPart(prel2))
+		return false;
+
+	/* Parent's rows may match rows of any partition */
+	if (prel1->enable_parent || prel2->enable_parent)
+		return false;
+
+	if (PrelHasKeyExpression(prel1) || PrelHasKeyExpression(prel2) ||
+		PrelHasCompositeKey(prel1) || PrelHasCompositeKey(prel2))
+		return false;
+
+	switch (prel1->parttype)
 	{
-		Relids		required_outer = (Relids) lfirst(l);
-		ListCell   *lcr;
+		case PT_HASH:
+			return prel1->hash_proc == prel2->hash_proc;
 
-		/* Select the child paths for an Append with this parameterization */
-		subpaths = NIL;
-		subpaths_valid = true;
-		foreach(lcr, live_childrels)
-		{
-			RelOptInfo *childrel = (RelOptInfo *) lfirst(lcr);
-			Path	   *subpath;
+		case PT_RANGE:
+			ranges1 = PrelGetRangesArray(prel1);
+			ranges2 = PrelGetRangesArray(prel2);
 
-			subpath = get_cheapest_parameterized_child_path(root,
-															childrel,
-															required_outer);
-			if (subpath == NULL)
+			fmgr_info(prel1->cmp_proc, &cmp_func);
+
+			for (i = 0; i < PrelChildrenCount(prel1); i++)
 			{
-				/* failed to make a suitable path for this child */
-				subpaths_valid = false;
-				break;
+				if (DatumGetInt32(FunctionCall2Coll(&cmp_func, prel1->attcollid,
+													ranges1[i].min,
+													ranges2[i].min)) != 0 ||
+					DatumGetInt32(FunctionCall2Coll(&cmp_func, prel1->attcollid,
+													ranges1[i].max,
+													ranges2[i].max)) != 0)
+					return false;
 			}
-			subpaths = accumulate_append_subpath(subpaths, subpath);
-		}
+			return true;
 
-		if (subpaths_valid)
-			add_path(rel, (Path *)
-					 create_append_path(rel, subpaths, required_outer));
+		default:
+			return false;
 	}
 }
 
-static List *
-accumulate_append_subpath(List *subpaths, Path *path)
+/*
+ * Check if 'rinfo' is "OUTER_KEY = INNER_KEY" (or vice versa).
+ */
+static bool
+is_key_equijoin_clause(RestrictInfo *rinfo,
+					   const PartRelationInfo *outer_prel, Index outer_relid,
+					   const PartRelationInfo *inner_prel, Index inner_relid)
 {
-	return lappend(subpaths, path);
+	const OpExpr   *expr = (const OpExpr *) rinfo->clause;
+	TypeCacheEntry *tce;
+	Node		   *left,
+				   *right;
+
+	if (!rinfo->can_join || !IsA(expr, OpExpr) || list_length(expr->args) != 2)
+		return false;
+
+	/* Both keys have the same type (see partitions_are_equal()) */
+	tce = lookup_type_cache(outer_prel->atttype, TYPECACHE_EQ_OPR);
+	if (expr->opno != tce->eq_opr)
+		return false;
+
+	left = (Node *) linitial(expr->args);
+	right = (Node *) lsecond(expr->args);
+
+	return (is_rel_key_column(outer_prel, outer_relid, left) &&
+			is_rel_key_column(inner_prel, inner_relid, right)) ||
+		   (is_rel_key_column(inner_prel, inner_relid, left) &&
+			is_rel_key_column(outer_prel, outer_relid, right));
 }
 
 /*
- * get_cheapest_parameterized_child_path
- *		Get cheapest path for this relation that has exactly the requested
- *		parameterization.
- *
- * Returns NULL if unable to create such a path.
+ * Check if 'node' is the partitioning key of relation 'relid'.
  */
-static Path *
-get_cheapest_parameterized_child_path(PlannerInfo *root, RelOptInfo *rel,
-									  Relids required_outer)
+static bool
+is_rel_key_column(const PartRelationInfo *prel, Index relid, Node *node)
 {
-	Path	   *cheapest;
-	ListCell   *lc;
+	if (IsA(node, RelabelType))
+		node = (Node *) ((RelabelType *) node)->arg;
 
-	/*
-	 * Look up the cheapest existing path with no more than the needed
-	 * parameterization.  If it has exactly the needed parameterization, we're
-	 * done.
-	 */
-	cheapest = get_cheapest_path_for_pathkeys(rel->pathlist,
-											  NIL,
-											  required_outer,
-											  TOTAL_COST);
-	Assert(cheapest != NULL);
-	if (bms_equal(PATH_REQ_OUTER(cheapest), required_outer))
-		return cheapest;
+	return is_key_column(prel, node) && ((Var *) node)->varno == relid;
+}
 
-	/*
-	 * Otherwise, we can "reparameterize" an existing path to match the given
-	 * parameterization, which effectively means pushing down additional
-	 * joinquals to be checked within the path's scan.  However, some existing
-	 * paths might check the available joinquals already while others don't;
-	 * therefore, it's not clear which existing path will be cheapest after
-	 * reparameterization.  We have to go through them all and find out.
-	 */
-	cheapest = NULL;
-	foreach(lc, rel->pathlist)
+/*
+ * Map each partition's index to its AppendRelInfo (NULL if pruned).
+ * Default partition (if any) goes last.
+ */
+static AppendRelInfo **
+get_partition_appinfos(PlannerInfo *root, Index parent_relid,
+					   const PartRelationInfo *prel)
+{
+	AppendRelInfo **result;
+	Oid			   *children = PrelGetChildrenArray(prel);
+	uint32			nchildren = PrelChildrenCount(prel),
+					i;
+	ListCell	   *lc;
+
+	result = (AppendRelInfo **) palloc0((nchildren + 1) * sizeof(AppendRelInfo *));
+
+	foreach (lc, root->append_rel_list)
 	{
-		Path	   *path = (Path *) lfirst(lc);
+		AppendRelInfo  *appinfo = (AppendRelInfo *) lfirst(lc);
+		Oid				child_oid;
 
-		/* Can't use it if it needs more than requested parameterization */
-		if (!bms_is_subset(PATH_REQ_OUTER(path), required_outer))
+		/* append_rel_list contains all append rels; ignore others */
+		if (appinfo->parent_relid != parent_relid)
 			continue;
 
-		/*
-		 * Reparameterization can only increase the path's cost, so if it's
-		 * already more expensive than the current cheapest, forget it.
-		 */
-		if (cheapest != NULL &&
-			compare_path_costs(cheapest, path, TOTAL_COST) <= 0)
+		/* Skip dummy children (e.g. excluded by constraints) */
+		if (IS_DUMMY_REL(root->simple_rel_array[appinfo->child_relid]))
 			continue;
 
-		/* Reparameterize if needed, then recheck cost */
-		if (!bms_equal(PATH_REQ_OUTER(path), required_outer))
-		{
-			path = reparameterize_path(root, path, required_outer, 1.0);
-			if (path == NULL)
-				continue;		/* failed to reparameterize this one */
-			Assert(bms_equal(PATH_REQ_OUTER(path), required_outer));
+		child_oid = root->simple_rte_array[appinfo->child_relid]->relid;
 
-			if (cheapest != NULL &&
-				compare_path_costs(cheapest, path, TOTAL_COST) <= 0)
-				continue;
+		if (child_oid == prel->default_part)
+		{
+			result[nchildren] = appinfo;
+			continue;
 		}
 
-		/* We have a new best path */
-		cheapest = path;
+		for (i = 0; i < nchildren; i++)
+		{
+			if (children[i] == child_oid)
+			{
+				result[i] = appinfo;
+				break;
+			}
+		}
 	}
 
-	/* Return the best path, or NULL if we found no suitable candidate */
-	return cheapest;
+	return result;
 }
 
 /*
- * generate_mergeappend_paths
- *		Generate MergeAppend paths for an append relation
- *
- * Generate a path for each ordering (pathkey list) appearing in
- * all_child_pathkeys.
- *
- * We consider both cheapest-startup and cheapest-total cases, ie, for each
- * interesting ordering, collect all the cheapest startup subpaths and all the
- * cheapest total paths, and build a MergeAppend path for each case.
- *
- * We don't currently generate any parameterized MergeAppend paths.  While
- * it would not take much more code here to do so, it's very unclear that it
- * is worth the planning cycles to investigate such paths: there's little
- * use for an ordered path on the inside of a nestloop.  In fact, it's likely
- * that the current coding of add_path would reject such paths out of hand,
- * because add_path gives no credit for sort ordering of parameterized paths,
- * and a parameterized MergeAppend is going to be more expensive than the
- * corresponding parameterized Append path.  If we ever try harder to support
- * parameterized mergejoin plans, it might be worth adding support for
- * parameterized MergeAppends to feed such joins.  (See notes in
- * optimizer/README for why that might not ever happen, though.)
+ * Build HashJoin of two corresponding partitions. Returns NULL if
+ * there's no suitable path or hashable clause.
  */
-static void
-generate_mergeappend_paths(PlannerInfo *root, RelOptInfo *rel,
-						   List *live_childrels,
-						   List *all_child_pathkeys,
-						   PathKey *pathkeyAsc, PathKey *pathkeyDesc)
+static Path *
+create_partition_join_path(PlannerInfo *root, RelOptInfo *joinrel,
+						   AppendRelInfo *outer_appinfo,
+						   AppendRelInfo *inner_appinfo,
+						   JoinPathExtraData *extra)
 {
-	ListCell   *lcp;
-
-	foreach(lcp, all_child_pathkeys)
-	{
-		List	   *pathkeys = (List *) lfirst(lcp);
-		List	   *startup_subpaths = NIL;
-		List	   *total_subpaths = NIL;
-		bool		startup_neq_total = false;
-		bool		presorted = true;
-		ListCell   *lcr;
-
-		/* Select the child paths for this ordering... */
-		foreach(lcr, live_childrels)
-		{
-			RelOptInfo *childrel = (RelOptInfo *) lfirst(lcr);
-			Path	   *cheapest_startup,
-					   *cheapest_total;
-
-			/* Locate the right paths, if they are available. */
-			cheapest_startup =
-				get_cheapest_path_for_pathkeys(childrel->pathlist,
-											   pathkeys,
-											   NULL,
-											   STARTUP_COST);
-			cheapest_total =
-				get_cheapest_path_for_pathkeys(childrel->pathlist,
-											   pathkeys,
-											   NULL,
-											   TOTAL_COST);
+	RelOptInfo		   *outer_child = root->simple_rel_array[outer_appinfo->child_relid],
+					   *inner_child = root->simple_rel_array[inner_appinfo->child_relid],
+					   *child_joinrel;
+	Path			   *outer_path = outer_child->cheapest_total_path,
+					   *inner_path = inner_child->cheapest_total_path;
+	List			   *restrictlist,
+					   *hashclauses = NIL;
+	JoinCostWorkspace	workspace;
+	ListCell		   *lc;
+
+	if (outer_path->param_info || inner_path->param_info)
+		return NULL;
 
-			/*
-			 * If we can't find any paths with the right order just use the
-			 * cheapest-total path; we'll have to sort it later.
-			 */
-			if (cheapest_startup == NULL || cheapest_total == NULL)
-			{
-				cheapest_startup = cheapest_total =
-					childrel->cheapest_total_path;
-				/* Assert we do have an unparameterized path for this child */
-				Assert(cheapest_total->param_info == NULL);
-				presorted = false;
-			}
+	/* Translate join clauses to the partitions' attributes */
+	restrictlist = (List *) adjust_appendrel_attrs(root,
+												   (Node *) extra->restrictlist,
+												   outer_appinfo);
+	restrictlist = (List *) adjust_appendrel_attrs(root,
+												   (Node *) restrictlist,
+												   inner_appinfo);
 
-			/*
-			 * Notice whether we actually have different paths for the
-			 * "cheapest" and "total" cases; frequently there will be no point
-			 * in two create_merge_append_path() calls.
-			 */
-			if (cheapest_startup != cheapest_total)
-				startup_neq_total = true;
+	/*
+	 * Make a join rel of the pair to hold its size and target. It's never
+	 * added to planner's lists, since nobody else is going to join it.
+	 */
+	child_joinrel = makeNode(RelOptInfo);
+	memcpy(child_joinrel, joinrel, sizeof(RelOptInfo));
+	child_joinrel->relids = bms_union(outer_child->relids, inner_child->relids);
+	child_joinrel->pathlist = NIL;
+	child_joinrel->partial_pathlist = NIL;
+	child_joinrel->cheapest_startup_path = NULL;
+	child_joinrel->cheapest_total_path = NULL;
+	child_joinrel->cheapest_unique_path = NULL;
+	child_joinrel->cheapest_parameterized_paths = NIL;
+
+	child_joinrel->reltarget = copy_pathtarget(joinrel->reltarget);
+	child_joinrel->reltarget->exprs = (List *)
+			adjust_appendrel_attrs(root,
+								   adjust_appendrel_attrs(root,
+														  (Node *) joinrel->reltarget->exprs,
+														  outer_appinfo),
+								   inner_appinfo);
+
+	set_joinrel_size_estimates(root, child_joinrel, outer_child, inner_child,
+							   extra->sjinfo, restrictlist);
+
+	/* Select hashable join clauses (cf. hash_inner_and_outer()) */
+	foreach (lc, restrictlist)
+	{
+		RestrictInfo *rinfo = (RestrictInfo *) lfirst(lc);
 
-			startup_subpaths =
-				accumulate_append_subpath(startup_subpaths, cheapest_startup);
-			total_subpaths =
-				accumulate_append_subpath(total_subpaths, cheapest_total);
-		}
+		if (!rinfo->can_join || !OidIsValid(rinfo->hashjoinoperator))
+			continue;
 
-		/*
-		 * When first pathkey matching ascending/descending sort by partition
-		 * column then build path with Append node, because MergeAppend is not
-		 * required in this case.
-		 */
-		if ((PathKey *) linitial(pathkeys) == pathkeyAsc && presorted)
-		{
-			Path *path;
+		if (bms_is_subset(rinfo->left_relids, outer_child->relids) &&
+			bms_is_subset(rinfo->right_relids, inner_child->relids))
+			rinfo->outer_is_left = true;
+		else if (bms_is_subset(rinfo->left_relids, inner_child->relids) &&
+				 bms_is_subset(rinfo->right_relids, outer_child->relids))
+			rinfo->outer_is_left = false;
+		else
+			continue;
 
-			path = (Path *) create_append_path(rel, startup_subpaths, NULL);
-			path->pathkeys = pathkeys;
-			add_path(rel, path);
+		hashclauses = lappend(hashclauses, rinfo);
+	}
 
-			if (startup_neq_total)
-			{
-				path = (Path *) create_append_path(rel, total_subpaths, NULL);
-				path->pathkeys = pathkeys;
-				add_path(rel, path);
-			}
-		}
-		else if ((PathKey *) linitial(pathkeys) == pathkeyDesc && presorted)
-		{
-			/*
-			 * When pathkey is descending sort by partition column then we
-			 * need to scan partitions in reversed order.
-			 */
-			Path *path;
+	if (hashclauses == NIL)
+		return NULL;
 
-			path = (Path *) create_append_path(rel,
-								list_reverse(startup_subpaths), NULL);
-			path->pathkeys = pathkeys;
-			add_path(rel, path);
+	initial_cost_hashjoin(root, &workspace, JOIN_INNER, hashclauses,
+						  outer_path, inner_path,
+						  extra->sjinfo, &extra->semifactors);
 
-			if (startup_neq_total)
-			{
-				path = (Path *) create_append_path(rel,
-								list_reverse(total_subpaths), NULL);
-				path->pathkeys = pathkeys;
-				add_path(rel, path);
-			}
-		}
-		else
-		{
-			/* ... and build the MergeAppend paths */
-			add_path(rel, (Path *) create_merge_append_path(root,
-															rel,
-															startup_subpaths,
-															pathkeys,
-															NULL));
-			if (startup_neq_total)
-				add_path(rel, (Path *) create_merge_append_path(root,
-																rel,
-																total_subpaths,
-																pathkeys,
-																NULL));
-		}
-	}
+	return (Path *) create_hashjoin_path(root, child_joinrel, JOIN_INNER,
+										 &workspace,
+										 extra->sjinfo, &extra->semifactors,
+										 outer_path, inner_path,
+										 restrictlist, NULL, hashclauses);
 }
+#endif
 
 /*
  * Get cached PATHMAN_CONFIG relation Oid.
@@ -20,6 +20,7 @@
 #include "catalog/indexing.h"
 #include "commands/sequence.h"
 #include "miscadmin.h"
+#include "nodes/nodeFuncs.h"
 #include "utils/array.h"
 #include "utils/builtins.h"
 #include <utils/inval.h>
@@ -42,7 +43,9 @@ PG_FUNCTION_INFO_V1( get_min_range_value );
 PG_FUNCTION_INFO_V1( get_max_range_value );
 PG_FUNCTION_INFO_V1( get_type_hash_func );
 PG_FUNCTION_INFO_V1( get_hash_part_idx );
+PG_FUNCTION_INFO_V1( combine_hashes );
 PG_FUNCTION_INFO_V1( check_overlap );
+PG_FUNCTION_INFO_V1( check_list_overlap );
 PG_FUNCTION_INFO_V1( build_range_condition );
 PG_FUNCTION_INFO_V1( build_check_constraint_name_attnum );
 PG_FUNCTION_INFO_V1( build_check_constraint_name_attname );
@@ -50,6 +53,7 @@ PG_FUNCTION_INFO_V1( build_update_trigger_func_name );
 PG_FUNCTION_INFO_V1( build_update_trigger_name );
 PG_FUNCTION_INFO_V1( is_date_type );
 PG_FUNCTION_INFO_V1( is_attribute_nullable );
+PG_FUNCTION_INFO_V1( is_partitioning_expression_pl );
 PG_FUNCTION_INFO_V1( add_to_pathman_config );
 PG_FUNCTION_INFO_V1( invalidate_relcache );
 PG_FUNCTION_INFO_V1( lock_partitioned_relation );
@@ -159,7 +163,7 @@ get_parent_of_partition_pl(PG_FUNCTION_ARGS)
 }
 
 /*
- * Get type (as text) of a given attribute.
+ * Get type (as text) of a given attribute (or partitioning expression).
  */
 Datum
 get_attribute_type_name(PG_FUNCTION_ARGS)
@@ -179,6 +183,17 @@ get_attribute_type_name(PG_FUNCTION_ARGS)
 
 		PG_RETURN_TEXT_P(cstring_to_text(result));
 	}
+	else if (is_partitioning_expression(relid, text_to_cstring(attname)))
+	{
+		AttrNumber	key_attnum;
+		Node	   *expr = parse_partitioning_expression(relid,
+														 text_to_cstring(attname),
+														 &key_attnum);
+
+		result = format_type_be(exprType(expr));
+
+		PG_RETURN_TEXT_P(cstring_to_text(result));
+	}
 	else
 		elog(ERROR, "Cannot find type name for attribute \"%s\" "
 					"of relation \"%s\"",
@@ -388,8 +403,10 @@ check_overlap(PG_FUNCTION_ARGS)
 	ranges = PrelGetRangesArray(prel);
 	for (i = 0; i < PrelChildrenCount(prel); i++)
 	{
-		int c1 = FunctionCall2(&cmp_func_1, p1, ranges[i].max);
-		int c2 = FunctionCall2(&cmp_func_2, p2, ranges[i].min);
+		int c1 = FunctionCall2Coll(&cmp_func_1, prel->attcollid,
+								   p1, ranges[i].max);
+		int c2 = FunctionCall2Coll(&cmp_func_2, prel->attcollid,
+								   p2, ranges[i].min);
 
 		if (c1 < 0 && c2 > 0)
 			PG_RETURN_BOOL(true);
@@ -399,6 +416,57 @@ check_overlap(PG_FUNCTION_ARGS)
 }
 
 
+/*
+ * Checks if any of values is already listed in existing LIST partitions.
+ * Returns TRUE if overlaps and FALSE otherwise.
+ */
+Datum
+check_list_overlap(PG_FUNCTION_ARGS)
+{
+	Oid						parent_oid = PG_GETARG_OID(0);
+	ArrayType			   *arrayval = PG_GETARG_ARRAYTYPE_P(1);
+
+	FmgrInfo				cmp_func;
+	int16					elmlen;
+	bool					elmbyval;
+	char					elmalign;
+	Datum				   *elem_values;
+	bool				   *elem_nulls;
+	int						num_elems,
+							i;
+	const PartRelationInfo *prel;
+
+	prel = get_pathman_relation_info(parent_oid);
+	shout_if_prel_is_invalid(parent_oid, prel, PT_LIST);
+
+	/* comparison function */
+	fill_type_cmp_fmgr_info(&cmp_func, ARR_ELEMTYPE(arrayval), prel->atttype);
+
+	get_typlenbyvalalign(ARR_ELEMTYPE(arrayval),
+						 &elmlen, &elmbyval, &elmalign);
+	deconstruct_array(arrayval,
+					  ARR_ELEMTYPE(arrayval),
+					  elmlen, elmbyval, elmalign,
+					  &elem_values, &elem_nulls, &num_elems);
+
+	for (i = 0; i < num_elems; i++)
+	{
+		WrapperNode	result;
+
+		if (elem_nulls[i])
+			continue;
+
+		select_list_partitions(elem_values[i], &cmp_func, prel,
+							   BTEqualStrategyNumber, &result);
+
+		if (result.rangeset != NULL)
+			PG_RETURN_BOOL(true);
+	}
+
+	PG_RETURN_BOOL(false);
+}
+
+
 /*
  * HASH-related stuff.
  */
@@ -425,6 +493,16 @@ get_hash_part_idx(PG_FUNCTION_ARGS)
 	PG_RETURN_UINT32(hash_to_part_index(value, part_count));
 }
 
+/* Wrapper for combine_hash_values() */
+Datum
+combine_hashes(PG_FUNCTION_ARGS)
+{
+	uint32	hash1 = PG_GETARG_UINT32(0),
+			hash2 = PG_GETARG_UINT32(1);
+
+	PG_RETURN_UINT32(combine_hash_values(hash1, hash2));
+}
+
 /*
  * Traits.
  */
@@ -443,6 +521,17 @@ is_attribute_nullable(PG_FUNCTION_ARGS)
 	bool		result = true;
 	HeapTuple	tp;
 
+	/* Partitioning expression is as nullable as its column */
+	if (is_partitioning_expression(relid, text_to_cstring(attname)))
+	{
+		AttrNumber	key_attnum;
+
+		parse_partitioning_expression(relid, text_to_cstring(attname),
+									  &key_attnum);
+
+		attname = cstring_to_text(get_attname(relid, key_attnum));
+	}
+
 	tp = SearchSysCacheAttName(relid, text_to_cstring(attname));
 	if (HeapTupleIsValid(tp))
 	{
@@ -458,6 +547,15 @@ is_attribute_nullable(PG_FUNCTION_ARGS)
 	PG_RETURN_BOOL(result); /* keep compiler happy */
 }
 
+Datum
+is_partitioning_expression_pl(PG_FUNCTION_ARGS)
+{
+	Oid			relid = PG_GETARG_OID(0);
+	text	   *key = PG_GETARG_TEXT_P(1);
+
+	PG_RETURN_BOOL(is_partitioning_expression(relid, text_to_cstring(key)));
+}
+
 
 /*
  * Useful string builders.
@@ -533,6 +631,11 @@ build_check_constraint_name_attname(PG_FUNCTION_ARGS)
 	if (!check_relation_exists(relid))
 		elog(ERROR, "Invalid relation %u", relid);
 
+	/* Constraint on partitioning expression is named after its column */
+	if (attnum == InvalidAttrNumber &&
+		is_partitioning_expression(relid, text_to_cstring(attname)))
+		parse_partitioning_expression(relid, text_to_cstring(attname), &attnum);
+
 	if (attnum == InvalidAttrNumber)
 		elog(ERROR, "Relation \"%s\" has no column '%s'",
 			 get_rel_name_or_relid(relid), text_to_cstring(attname));
@@ -45,49 +45,109 @@ irange_intersect(IndexRange a, IndexRange b)
 					   a.ir_lossy || b.ir_lossy);
 }
 
+/* Allocate an empty RangeSet able to hold 'maxranges' ranges */
+static RangeSet *
+rangeset_alloc(uint32 maxranges)
+{
+	RangeSet *result = (RangeSet *) palloc(RangeSetSize(maxranges));
+
+	result->nranges = 0;
+	result->maxranges = maxranges;
+
+	return result;
+}
+
+/*
+ * Put range at the end of the set, gluing it to the last one if possible.
+ * The range must not precede any of the ranges already stored.
+ */
+static inline void
+rangeset_push(RangeSet *rs, IndexRange irange)
+{
+	Assert(rs->nranges < rs->maxranges);
+
+	if (rs->nranges > 0)
+	{
+		IndexRange *last = &rs->ranges[rs->nranges - 1];
+
+		Assert(last->ir_upper < irange.ir_lower);
+
+		if (irange_conjuncted(*last, irange) &&
+			last->ir_lossy == irange.ir_lossy)
+		{
+			*last = irange_union(*last, irange);
+			return;
+		}
+	}
+
+	rs->ranges[rs->nranges++] = irange;
+}
+
+/* Make a set of a single range */
+RangeSet *
+rangeset_make1(IndexRange irange)
+{
+	RangeSet *result = rangeset_alloc(1);
+
+	rangeset_push(result, irange);
+
+	return result;
+}
+
 /*
- * Make union of two index rage lists.
+ * Append range to the set (possibly NULL) and return the result, which
+ * might have been reallocated.
  */
-List *
-irange_list_union(List *a, List *b)
+RangeSet *
+rangeset_append(RangeSet *rs, IndexRange irange)
 {
-	ListCell   *ca,
-			   *cb;
-	List	   *result = NIL;
+	if (rs == NULL)
+		return rangeset_make1(irange);
+
+	/* Double the capacity if needed */
+	if (rs->nranges == rs->maxranges)
+	{
+		rs->maxranges *= 2;
+		rs = (RangeSet *) repalloc(rs, RangeSetSize(rs->maxranges));
+	}
+
+	rangeset_push(rs, irange);
+
+	return rs;
+}
+
+/*
+ * Make union of two range sets.
+ *
+ * Every boundary of the result is a boundary of some source range, thus
+ * the result is allocated once and nothing is allocated per range.
+ */
+RangeSet *
+rangeset_union(const RangeSet *a, const RangeSet *b)
+{
+	uint32		na = rangeset_nranges(a),
+				nb = rangeset_nranges(b),
+				ia = 0,
+				ib = 0;
+	RangeSet   *result;
 	IndexRange	cur = InvalidIndexRange;
 	bool		have_cur = false;
 
-	ca = list_head(a);
-	cb = list_head(b);
+	if (na + nb == 0)
+		return NULL;
 
-	while (ca || cb)
+	result = rangeset_alloc(2 * (na + nb));
+
+	while (ia < na || ib < nb)
 	{
-		IndexRange next = InvalidIndexRange;
+		IndexRange next;
 
 		/* Fetch next range with lesser lower bound */
-		if (ca && cb)
-		{
-			if (lfirst_irange(ca).ir_lower <= lfirst_irange(cb).ir_lower)
-			{
-				next = lfirst_irange(ca);
-				ca = lnext(ca);
-			}
-			else
-			{
-				next = lfirst_irange(cb);
-				cb = lnext(cb);
-			}
-		}
-		else if (ca)
-		{
-			next = lfirst_irange(ca);
-			ca = lnext(ca);
-		}
-		else if (cb)
-		{
-			next = lfirst_irange(cb);
-			cb = lnext(cb);
-		}
+		if (ia < na &&
+			(ib >= nb || a->ranges[ia].ir_lower <= b->ranges[ib].ir_lower))
+			next = a->ranges[ia++];
+		else
+			next = b->ranges[ib++];
 
 		if (!have_cur)
 		{
@@ -95,141 +155,205 @@ irange_list_union(List *a, List *b)
 			cur = next;
 			have_cur = true;
 		}
-		else
+		else if (irange_conjuncted(next, cur))
 		{
-			if (irange_conjuncted(next, cur))
+			/*
+			 * Ranges are conjuncted, try to unify them. Non-lossy
+			 * range always wins over the lossy one.
+			 */
+			if (next.ir_lossy == cur.ir_lossy)
 			{
-				/*
-				 * Ranges are conjuncted, try to unify them.
-				 */
-				if (next.ir_lossy == cur.ir_lossy)
-				{
-					cur = irange_union(next, cur);
-				}
-				else
+				cur = irange_union(next, cur);
+			}
+			else if (!cur.ir_lossy)
+			{
+				/* Keep the lossy tail of 'next' sticking out of 'cur' */
+				if (next.ir_upper > cur.ir_upper)
 				{
-					if (!cur.ir_lossy)
-					{
-						result = lappend_irange(result, cur);
-						cur = make_irange(cur.ir_upper + 1,
-										  next.ir_upper,
-										  next.ir_lossy);
-					}
-					else
-					{
-						result = lappend_irange(result,
-												make_irange(cur.ir_lower,
-															next.ir_lower - 1,
-															cur.ir_lossy));
-						cur = next;
-					}
+					rangeset_push(result, cur);
+					cur = make_irange(cur.ir_upper + 1,
+									  next.ir_upper,
+									  next.ir_lossy);
 				}
 			}
 			else
 			{
-				/*
-				 * Next range is not conjuncted with current. Put current to the
-				 * result list and put next as current.
-				 */
-				result = lappend_irange(result, cur);
-				cur = next;
+				/* Cut off the lossy part of 'cur' preceding 'next' */
+				if (next.ir_lower > cur.ir_lower)
+					rangeset_push(result, make_irange(cur.ir_lower,
+													  next.ir_lower - 1,
+													  cur.ir_lossy));
+
+				/* Lossy tail of 'cur' might stick out of 'next' */
+				if (cur.ir_upper > next.ir_upper)
+				{
+					rangeset_push(result, next);
+					cur = make_irange(next.ir_upper + 1,
+									  cur.ir_upper,
+									  cur.ir_lossy);
+				}
+				else
+					cur = next;
 			}
 		}
+		else
+		{
+			/*
+			 * Next range is not conjuncted with current. Put current to the
+			 * result and put next as current.
+			 */
+			rangeset_push(result, cur);
+			cur = next;
+		}
 	}
 
-	/* Put current value into result list if any */
+	/* Put current value into result if any */
 	if (have_cur)
-		result = lappend_irange(result, cur);
+		rangeset_push(result, cur);
 
 	return result;
 }
 
 /*
- * Find intersection of two range lists.
+ * Find intersection of two range sets.
  */
-List *
-irange_list_intersect(List *a, List *b)
+RangeSet *
+rangeset_intersect(const RangeSet *a, const RangeSet *b)
 {
-	ListCell   *ca,
-			   *cb;
-	List	   *result = NIL;
-	IndexRange	ra, rb;
+	uint32		na = rangeset_nranges(a),
+				nb = rangeset_nranges(b),
+				ia = 0,
+				ib = 0;
+	RangeSet   *result;
 
-	ca = list_head(a);
-	cb = list_head(b);
+	if (na == 0 || nb == 0)
+		return NULL;
 
-	while (ca && cb)
+	result = rangeset_alloc(na + nb);
+
+	while (ia < na && ib < nb)
 	{
-		ra = lfirst_irange(ca);
-		rb = lfirst_irange(cb);
+		IndexRange	ra = a->ranges[ia],
+					rb = b->ranges[ib];
 
-		/* Only care about intersecting ranges */
+		/*
+		 * Only care about intersecting ranges. The intersection is "glued"
+		 * to the previous range if possible.
+		 */
 		if (irange_intersects(ra, rb))
-		{
-			IndexRange	intersect, last;
-
-			/*
-			 * Get intersection and try to "glue" it to previous range,
-			 * put it separately otherwise.
-			 */
-			intersect = irange_intersect(ra, rb);
-			if (result != NIL)
-			{
-				last = llast_irange(result);
-				if (irange_conjuncted(last, intersect) &&
-					last.ir_lossy == intersect.ir_lossy)
-				{
-					llast(result) = alloc_irange(irange_union(last, intersect));
-				}
-				else
-				{
-					result = lappend_irange(result, intersect);
-				}
-			}
-			else
-			{
-				result = lappend_irange(result, intersect);
-			}
-		}
+			rangeset_push(result, irange_intersect(ra, rb));
 
 		/*
 		 * Fetch next ranges. We use upper bound of current range to determine
-		 * which lists to fetch, since lower bound of next range is greater (or
+		 * which sets to fetch, since lower bound of next range is greater (or
 		 * equal) to upper bound of current.
 		 */
 		if (ra.ir_upper <= rb.ir_upper)
-			ca = lnext(ca);
+			ia++;
 		if (ra.ir_upper >= rb.ir_upper)
-			cb = lnext(cb);
+			ib++;
 	}
+
+	if (result->nranges == 0)
+	{
+		pfree(result);
+		return NULL;
+	}
+
 	return result;
 }
 
-/* Get total number of elements in range list */
+/*
+ * Build range set out of an array of flags (one per partition).
+ */
+RangeSet *
+rangeset_from_flags(const bool *flags, uint32 nflags, bool lossy)
+{
+	RangeSet   *result = NULL;
+	uint32		i;
+
+	for (i = 0; i < nflags; i++)
+	{
+		uint32 lower = i;
+
+		if (!flags[i])
+			continue;
+
+		/* Extend range while consecutive flags are set */
+		while (i + 1 < nflags && flags[i + 1])
+			i++;
+
+		result = rangeset_append(result, make_irange(lower, i, lossy));
+	}
+
+	return result;
+}
+
+/*
+ * Make range set of elements (0 .. nitems - 1) that satisfy NOT
+ * of the expression represented by 'rs': missing elements become
+ * non-lossy, non-lossy ones disappear, lossy ones stay lossy.
+ */
+RangeSet *
+rangeset_negate(const RangeSet *rs, uint32 nitems)
+{
+	RangeSet   *result = NULL;
+	uint32		next = 0,
+				i;
+
+	for (i = 0; i < rangeset_nranges(rs); i++)
+	{
+		IndexRange	irange = rangeset_get(rs, i);
+
+		if (irange.ir_lower > next)
+			result = rangeset_append(result,
+									 make_irange(next, irange.ir_lower - 1,
+												 false));
+
+		if (irange.ir_lossy)
+			result = rangeset_append(result, irange);
+
+		next = irange.ir_upper + 1;
+	}
+
+	if (next < nitems)
+		result = rangeset_append(result, make_irange(next, nitems - 1, false));
+
+	return result;
+}
+
+/* Get total number of elements in range set */
 int
-irange_list_length(List *rangeset)
+rangeset_length(const RangeSet *rs)
 {
-	ListCell   *lc;
 	int			result = 0;
+	uint32		i;
 
-	foreach (lc, rangeset)
+	for (i = 0; i < rangeset_nranges(rs); i++)
 	{
-		IndexRange irange = lfirst_irange(lc);
+		IndexRange irange = rangeset_get(rs, i);
 		result += irange.ir_upper - irange.ir_lower + 1;
 	}
 	return result;
 }
 
-/* Find particular index in range list */
+/* Find particular index in range set using binary search */
 bool
-irange_list_find(List *rangeset, int index, bool *lossy)
+rangeset_find(const RangeSet *rs, int index, bool *lossy)
 {
-	ListCell   *lc;
+	uint32		lo = 0,
+				hi = rangeset_nranges(rs);
 
-	foreach (lc, rangeset)
+	while (lo < hi)
 	{
-		IndexRange irange = lfirst_irange(lc);
-		if (index >= irange.ir_lower && index <= irange.ir_upper)
+		uint32		mid = lo + (hi - lo) / 2;
+		IndexRange	irange = rangeset_get(rs, mid);
+
+		if (index < (int) irange.ir_lower)
+			hi = mid;
+		else if (index > (int) irange.ir_upper)
+			lo = mid + 1;
+		else
 		{
 			if (lossy)
 				*lossy = irange.ir_lossy;
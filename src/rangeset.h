@@ -12,8 +12,7 @@
 #define PATHMAN_RANGESET_H
 
 
-#include "pathman.h"
-#include "nodes/pg_list.h"
+#include "postgres.h"
 
 
 /*
@@ -44,22 +43,24 @@ make_irange(uint32 lower, uint32 upper, bool lossy)
 	return result;
 }
 
-inline static IndexRange *
-alloc_irange(IndexRange irange)
+/*
+ * RangeSet is a sorted array of non-overlapping IndexRanges allocated as a
+ * single chunk. NULL stands for an empty set, just like NIL does for List.
+ */
+typedef struct
 {
-	IndexRange *result = (IndexRange *) palloc(sizeof(IndexRange));
-
-	memcpy((void *) result, (void *) &irange, sizeof(IndexRange));
+	uint32		nranges;		/* number of ranges in use */
+	uint32		maxranges;		/* number of allocated ranges */
+	IndexRange	ranges[FLEXIBLE_ARRAY_MEMBER];
+} RangeSet;
 
-	return result;
-}
+#define RangeSetSize(nranges) \
+	( offsetof(RangeSet, ranges) + sizeof(IndexRange) * (nranges) )
 
-#define lfirst_irange(lc)				( *(IndexRange *) lfirst(lc) )
-#define lappend_irange(list, irange)	( lappend((list), alloc_irange(irange)) )
-#define lcons_irange(irange, list)		( lcons(alloc_irange(irange), (list)) )
-#define list_make1_irange(irange)		( lcons(alloc_irange(irange), NIL) )
-#define llast_irange(list)				( lfirst_irange(list_tail(list)) )
-#define linitial_irange(list)			( lfirst_irange(list_head(list)) )
+#define rangeset_nranges(rs)		( (rs) ? (rs)->nranges : 0 )
+#define rangeset_get(rs, i)			( (rs)->ranges[(i)] )
+#define rangeset_first(rs)			( rangeset_get((rs), 0) )
+#define rangeset_last(rs)			( rangeset_get((rs), (rs)->nranges - 1) )
 
 
 /* rangeset.c */
@@ -67,9 +68,13 @@ bool irange_intersects(IndexRange a, IndexRange b);
 bool irange_conjuncted(IndexRange a, IndexRange b);
 IndexRange irange_union(IndexRange a, IndexRange b);
 IndexRange irange_intersect(IndexRange a, IndexRange b);
-List *irange_list_union(List *a, List *b);
-List *irange_list_intersect(List *a, List *b);
-int irange_list_length(List *rangeset);
-bool irange_list_find(List *rangeset, int index, bool *lossy);
+RangeSet *rangeset_make1(IndexRange irange);
+RangeSet *rangeset_append(RangeSet *rs, IndexRange irange);
+RangeSet *rangeset_union(const RangeSet *a, const RangeSet *b);
+RangeSet *rangeset_intersect(const RangeSet *a, const RangeSet *b);
+RangeSet *rangeset_from_flags(const bool *flags, uint32 nflags, bool lossy);
+RangeSet *rangeset_negate(const RangeSet *rs, uint32 nitems);
+int rangeset_length(const RangeSet *rs);
+bool rangeset_find(const RangeSet *rs, int index, bool *lossy);
 
 #endif
@@ -71,10 +71,13 @@ refresh_pathman_relation_info(Oid relid,
 	const LOCKMODE			lockmode = AccessShareLock;
 	const TypeCacheEntry   *typcache;
 	Oid					   *prel_children;
+	Oid						default_part = InvalidOid;
 	uint32					prel_children_count = 0,
 							i;
 	bool					found;
 	PartRelationInfo	   *prel;
+	List				   *key_columns;
+	ListCell			   *lc;
 	Datum					param_values[Natts_pathman_config_params];
 	bool					param_isnull[Natts_pathman_config_params];
 
@@ -99,29 +102,102 @@ refresh_pathman_relation_info(Oid relid,
 		/* Free these arrays iff they're not NULL */
 		FreeChildrenArray(prel);
 		FreeRangesArray(prel);
+		FreeListArray(prel);
+		FreeKeyExpression(prel);
 	}
 
 	/* First we assume that this entry is invalid */
 	prel->valid = false;
 
-	/* Make both arrays point to NULL */
+	/* Make all arrays point to NULL */
 	prel->children = NULL;
 	prel->ranges = NULL;
+	prel->list_entries = NULL;
+	prel->list_entries_count = 0;
+	prel->default_part = InvalidOid;
+	prel->key_expr = NULL;
+	prel->key_mcxt = NULL;
 
 	/* Set partitioning type */
 	prel->parttype = partitioning_type;
 
-	/* Initialize PartRelationInfo using syscache & typcache */
-	prel->attnum	= get_attnum(relid, part_column_name);
+	/* RANGE key might be an expression of a single column */
+	if (partitioning_type == PT_RANGE &&
+		is_partitioning_expression(relid, part_column_name))
+	{
+		MemoryContext	old_mcxt;
+		Node		   *key_expr;
+		AttrNumber		key_attnum;
+
+		key_expr = parse_partitioning_expression(relid, part_column_name,
+												 &key_attnum);
+
+		/* Store expression in a separate context, it's easier to free it */
+		prel->key_mcxt = AllocSetContextCreate(TopMemoryContext,
+											   "pg_pathman partitioning expression",
+											   ALLOCSET_SMALL_MINSIZE,
+											   ALLOCSET_SMALL_INITSIZE,
+											   ALLOCSET_SMALL_MAXSIZE);
+
+		old_mcxt = MemoryContextSwitchTo(prel->key_mcxt);
+		prel->key_expr = copyObject(key_expr);
+		MemoryContextSwitchTo(old_mcxt);
+
+		prel->key_natts = 1;
+		prel->key_attnums[0] = key_attnum;
+		prel->key_atttypes[0] = get_atttype(relid, key_attnum);
+		prel->key_hash_procs[0] = InvalidOid; /* not used by RANGE */
+	}
+	else
+	{
+		/* Partitioning key might consist of several columns ("a, b") */
+		if (!SplitIdentifierString(pstrdup(part_column_name), ',', &key_columns))
+			elog(ERROR, "Invalid partitioning key \"%s\"", part_column_name);
+
+		if (list_length(key_columns) > PART_MAX_KEY_ATTS)
+			elog(ERROR, "Partitioning key cannot have more than %d columns",
+				 PART_MAX_KEY_ATTS);
 
-	/* Attribute number sanity check */
-	if (prel->attnum == InvalidAttrNumber)
-		elog(ERROR, "Relation \"%s\" has no column \"%s\"",
-			 get_rel_name_or_relid(relid), part_column_name);
+		if (list_length(key_columns) > 1 && partitioning_type != PT_HASH)
+			elog(ERROR, "Multi-column partitioning key is supported only for HASH partitioning");
+
+		prel->key_natts = 0;
+		foreach (lc, key_columns)
+		{
+			const char *key_column = (const char *) lfirst(lc);
+			AttrNumber	key_attnum = get_attnum(relid, key_column);
 
-	/* Fetch atttypid, atttypmod, and attcollation in a single cache lookup */
-	get_atttypetypmodcoll(relid, prel->attnum,
-						  &prel->atttype, &prel->atttypmod, &prel->attcollid);
+			/* Attribute number sanity check */
+			if (key_attnum == InvalidAttrNumber)
+				elog(ERROR, "Relation \"%s\" has no column \"%s\"",
+					 get_rel_name_or_relid(relid), key_column);
+
+			prel->key_attnums[prel->key_natts] = key_attnum;
+			prel->key_atttypes[prel->key_natts] = get_atttype(relid, key_attnum);
+			prel->key_hash_procs[prel->key_natts] =
+					lookup_type_cache(prel->key_atttypes[prel->key_natts],
+									  TYPECACHE_HASH_PROC)->hash_proc;
+
+			prel->key_natts++;
+		}
+	}
+
+	/* Initialize PartRelationInfo using syscache & typcache */
+	prel->attnum	= prel->key_attnums[0];
+
+	/* Partitions are built upon the values of the expression */
+	if (PrelHasKeyExpression(prel))
+	{
+		prel->atttype	= exprType(prel->key_expr);
+		prel->atttypmod	= exprTypmod(prel->key_expr);
+		prel->attcollid	= exprCollation(prel->key_expr);
+	}
+	else
+	{
+		/* Fetch atttypid, atttypmod, and attcollation in a single cache lookup */
+		get_atttypetypmodcoll(relid, prel->attnum,
+							  &prel->atttype, &prel->atttypmod, &prel->attcollid);
+	}
 
 	/* Fetch HASH & CMP fuctions and other stuff from type cache */
 	typcache = lookup_type_cache(prel->atttype,
@@ -139,6 +215,49 @@ refresh_pathman_relation_info(Oid relid,
 													&prel_children_count);
 	UnlockRelationOid(relid, lockmode);
 
+	/* Read additional parameters ('enable_parent', 'auto' & default partition) */
+	if (read_pathman_params(relid, param_values, param_isnull))
+	{
+		prel->enable_parent = param_values[Anum_pathman_config_params_enable_parent - 1];
+		prel->auto_partition = param_values[Anum_pathman_config_params_auto - 1];
+		prel->monotonic_key = param_values[Anum_pathman_config_params_monotonic - 1];
+
+		if (!param_isnull[Anum_pathman_config_params_default - 1])
+			default_part = DatumGetObjectId(param_values[Anum_pathman_config_params_default - 1]);
+	}
+	/* Else set default values if they cannot be found */
+	else
+	{
+		prel->enable_parent = false;
+		prel->auto_partition = true;
+		prel->monotonic_key = false;
+	}
+
+	/* Default partition has no check constraint, exclude it from 'prel_children' */
+	if (OidIsValid(default_part))
+	{
+		bool	default_found = false;
+
+		for (i = 0; i < prel_children_count; i++)
+		{
+			if (default_found)
+				prel_children[i - 1] = prel_children[i];
+			else if (prel_children[i] == default_part)
+				default_found = true;
+		}
+
+		if (default_found)
+			prel_children_count--;
+		else
+		{
+			elog(WARNING, "Default partition \"%s\" is not a partition of \"%s\"",
+				 get_rel_name_or_relid(default_part),
+				 get_rel_name_or_relid(relid));
+
+			default_part = InvalidOid;
+		}
+	}
+
 	/* If there's no children at all, remove this entry */
 	if (prel_children_count == 0)
 	{
@@ -158,21 +277,15 @@ refresh_pathman_relation_info(Oid relid,
 	for (i = 0; i < prel_children_count; i++)
 		cache_parent_of_partition(prel_children[i], relid);
 
-	pfree(prel_children);
-
-	/* Read additional parameters ('enable_parent' and 'auto' at the moment) */
-	if (read_pathman_params(relid, param_values, param_isnull))
-	{
-		prel->enable_parent = param_values[Anum_pathman_config_params_enable_parent - 1];
-		prel->auto_partition = param_values[Anum_pathman_config_params_auto - 1];
-	}
-	/* Else set default values if they cannot be found */
-	else
+	/* Same for the default partition */
+	if (OidIsValid(default_part))
 	{
-		prel->enable_parent = false;
-		prel->auto_partition = true;
+		cache_parent_of_partition(default_part, relid);
+		prel->default_part = default_part;
 	}
 
+	pfree(prel_children);
+
 	/* We've successfully built a cache entry */
 	prel->valid = true;
 
@@ -196,6 +309,8 @@ invalidate_pathman_relation_info(Oid relid, bool *found)
 	{
 		FreeChildrenArray(prel);
 		FreeRangesArray(prel);
+		FreeListArray(prel);
+		FreeKeyExpression(prel);
 
 		prel->valid = false; /* now cache entry is invalid */
 	}
@@ -204,6 +319,8 @@ invalidate_pathman_relation_info(Oid relid, bool *found)
 	{
 		prel->children = NULL;
 		prel->ranges = NULL;
+		prel->key_expr = NULL;
+		prel->key_mcxt = NULL;
 
 		prel->valid = false; /* now cache entry is invalid */
 	}
@@ -286,6 +403,8 @@ remove_pathman_relation_info(Oid relid)
 		/* Free these arrays iff they're not NULL */
 		FreeChildrenArray(prel);
 		FreeRangesArray(prel);
+		FreeListArray(prel);
+		FreeKeyExpression(prel);
 	}
 
 	/* Now let's remove the entry completely */
@@ -619,7 +738,7 @@ DatumGetPartType(Datum datum)
 {
 	uint32 val = DatumGetUInt32(datum);
 
-	if (val < 1 || val > 2)
+	if (val < 1 || val > 3)
 		elog(ERROR, "Unknown partitioning type %u", val);
 
 	return (PartType) val;
@@ -659,6 +778,10 @@ shout_if_prel_is_invalid(Oid parent_oid,
 				expected_str = "RANGE";
 				break;
 
+			case PT_LIST:
+				expected_str = "LIST";
+				break;
+
 			default:
 				elog(ERROR,
 					 "expected_str selection not implemented for type %d",
@@ -15,9 +15,14 @@
 
 #include "postgres.h"
 #include "access/attnum.h"
+#include "nodes/nodes.h"
 #include "port/atomics.h"
+#include "utils/memutils.h"
 
 
+/* Max number of columns in a composite (multi-column) partitioning key */
+#define PART_MAX_KEY_ATTS		8
+
 /*
  * Partitioning type.
  */
@@ -25,7 +30,8 @@ typedef enum
 {
 	PT_INDIFFERENT = 0, /* for part type traits (virtual type) */
 	PT_HASH,
-	PT_RANGE
+	PT_RANGE,
+	PT_LIST
 } PartType;
 
 /*
@@ -39,6 +45,15 @@ typedef struct
 					max;
 } RangeEntry;
 
+/*
+ * Child relation info for LIST partitioning
+ */
+typedef struct
+{
+	Datum			value;
+	uint32			child_idx;		/* index of partition in 'children' */
+} ListEntry;
+
 /*
  * PartRelationInfo
  *		Per-relation partitioning information
@@ -49,12 +64,16 @@ typedef struct
 	bool			valid;			/* is this entry valid? */
 	bool			enable_parent;	/* include parent to the plan */
 	bool			auto_partition; /* auto partition creation */
+	Oid				default_part;	/* catch-all partition or InvalidOid */
 
 	uint32			children_count;
 	Oid			   *children;		/* Oids of child partitions */
 	RangeEntry	   *ranges;			/* per-partition range entry or NULL */
+	bool			has_gaps;		/* are there any gaps between ranges? */
+	ListEntry	   *list_entries;	/* sorted (value -> partition) entries or NULL */
+	uint32			list_entries_count;
 
-	PartType		parttype;		/* partitioning type (HASH | RANGE) */
+	PartType		parttype;		/* partitioning type (HASH | RANGE | LIST) */
 	AttrNumber		attnum;			/* partitioned column's index */
 	Oid				atttype;		/* partitioned column's type */
 	int32			atttypmod;		/* partitioned column type modifier */
@@ -65,6 +84,21 @@ typedef struct
 
 	Oid				cmp_proc,		/* comparison fuction for 'atttype' */
 					hash_proc;		/* hash function for 'atttype' */
+
+	/* All columns of the partitioning key (only HASH may have several) */
+	int				key_natts;
+	AttrNumber		key_attnums[PART_MAX_KEY_ATTS];
+	Oid				key_atttypes[PART_MAX_KEY_ATTS];
+	Oid				key_hash_procs[PART_MAX_KEY_ATTS];
+
+	/*
+	 * RANGE key might be an expression of a single column (key_attnums[0]),
+	 * e.g. "date_trunc('day', ts)". In this case 'att*' fields describe the
+	 * expression's result, not the column.
+	 */
+	Node		   *key_expr;		/* partitioning expression or NULL */
+	MemoryContext	key_mcxt;		/* memory context of 'key_expr' */
+	bool			monotonic_key;	/* is 'key_expr' non-decreasing? */
 } PartRelationInfo;
 
 /*
@@ -102,10 +136,20 @@ typedef enum
 
 #define PrelGetRangesArray(prel)	( (prel)->ranges )
 
+#define PrelGetListArray(prel)		( (prel)->list_entries )
+
+#define PrelListEntriesCount(prel)	( (prel)->list_entries_count )
+
 #define PrelChildrenCount(prel)		( (prel)->children_count )
 
 #define PrelIsValid(prel)			( (prel) && (prel)->valid )
 
+#define PrelHasDefaultPart(prel)	( OidIsValid((prel)->default_part) )
+
+#define PrelHasCompositeKey(prel)	( (prel)->key_natts > 1 )
+
+#define PrelHasKeyExpression(prel)	( (prel)->key_expr != NULL )
+
 inline static uint32
 PrelLastChild(const PartRelationInfo *prel)
 {
@@ -170,6 +214,17 @@ FreeChildrenArray(PartRelationInfo *prel)
 		pfree((prel)->children);
 		(prel)->children = NULL;
 	}
+
+	/* Default partition is not stored in 'children' */
+	if (PrelHasDefaultPart(prel))
+	{
+		Oid child = (prel)->default_part;
+
+		if (PrelParentRelid(prel) == get_parent_of_partition(child, NULL))
+			forget_parent_of_partition(child, NULL);
+
+		(prel)->default_part = InvalidOid;
+	}
 }
 
 static inline void
@@ -197,4 +252,40 @@ FreeRangesArray(PartRelationInfo *prel)
 	}
 }
 
+static inline void
+FreeListArray(PartRelationInfo *prel)
+{
+	uint32	i;
+
+	Assert(PrelIsValid(prel));
+
+	/* Remove ListEntries array */
+	if ((prel)->list_entries)
+	{
+		/* Remove persistent entries if not byVal */
+		if (!(prel)->attbyval)
+		{
+			for (i = 0; i < PrelListEntriesCount(prel); i++)
+				pfree(DatumGetPointer((prel)->list_entries[i].value));
+		}
+
+		pfree((prel)->list_entries);
+		(prel)->list_entries = NULL;
+		(prel)->list_entries_count = 0;
+	}
+}
+
+static inline void
+FreeKeyExpression(PartRelationInfo *prel)
+{
+	/* Partitioning expression has its own memory context */
+	if ((prel)->key_mcxt)
+	{
+		MemoryContextDelete((prel)->key_mcxt);
+		(prel)->key_mcxt = NULL;
+	}
+
+	(prel)->key_expr = NULL;
+}
+
 #endif
@@ -29,6 +29,10 @@
 
 #include "lib/binaryheap.h"
 
+#if PG_VERSION_NUM >= 90600
+#include "nodes/extensible.h"
+#endif
+
 
 bool				pg_pathman_enable_runtime_merge_append = true;
 
@@ -204,6 +208,11 @@ init_runtime_merge_append_static_data(void)
 	runtime_merge_append_exec_methods.RestrPosCustomScan	= NULL;
 	runtime_merge_append_exec_methods.ExplainCustomScan		= runtimemergeappend_explain;
 
+#if PG_VERSION_NUM >= 90600
+	/* Parallel workers have to find it by name */
+	RegisterCustomScanMethods(&runtime_merge_append_plan_methods);
+#endif
+
 	DefineCustomBoolVariable("pg_pathman.enable_runtimemergeappend",
 							 "Enables the planner's use of RuntimeMergeAppend custom node.",
 							 NULL,
@@ -446,7 +455,7 @@ runtimemergeappend_rescan(CustomScanState *node)
 	int							nplans;
 	int							i;
 
-	rescan_append_common(node);
+	rescan_append_common(node, false);
 
 	nplans = scan_state->rstate.ncur_plans;
 
@@ -11,11 +11,18 @@
 #include "runtimeappend.h"
 
 #include "postgres.h"
+#include "optimizer/cost.h"
 #include "utils/memutils.h"
 #include "utils/guc.h"
 
+#if PG_VERSION_NUM >= 90600
+#include "nodes/extensible.h"
+#endif
+
 
 bool				pg_pathman_enable_runtimeappend = true;
+bool				pg_pathman_enable_deferred_locks = false;
+bool				pg_pathman_enable_join_key_filter = true;
 
 CustomPathMethods	runtimeappend_path_methods;
 CustomScanMethods	runtimeappend_plan_methods;
@@ -39,6 +46,14 @@ init_runtimeappend_static_data(void)
 	runtimeappend_exec_methods.MarkPosCustomScan		= NULL;
 	runtimeappend_exec_methods.RestrPosCustomScan		= NULL;
 	runtimeappend_exec_methods.ExplainCustomScan		= runtimeappend_explain;
+#if PG_VERSION_NUM >= 90600
+	runtimeappend_exec_methods.EstimateDSMCustomScan	= runtimeappend_estimate_dsm;
+	runtimeappend_exec_methods.InitializeDSMCustomScan	= runtimeappend_initialize_dsm;
+	runtimeappend_exec_methods.InitializeWorkerCustomScan = runtimeappend_initialize_worker;
+
+	/* Parallel workers have to find it by name */
+	RegisterCustomScanMethods(&runtimeappend_plan_methods);
+#endif
 
 	DefineCustomBoolVariable("pg_pathman.enable_runtimeappend",
 							 "Enables the planner's use of RuntimeAppend custom node.",
@@ -50,6 +65,28 @@ init_runtimeappend_static_data(void)
 							 NULL,
 							 NULL,
 							 NULL);
+
+	DefineCustomBoolVariable("pg_pathman.enable_deferred_locks",
+							 "Lock only partitions selected by RuntimeAppend at runtime.",
+							 NULL,
+							 &pg_pathman_enable_deferred_locks,
+							 false,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+
+	DefineCustomBoolVariable("pg_pathman.enable_join_key_filter",
+							 "Skip partitions which can't match any key of a small hash join's inner side.",
+							 NULL,
+							 &pg_pathman_enable_join_key_filter,
+							 true,
+							 PGC_USERSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
 }
 
 Path *
@@ -65,6 +102,94 @@ create_runtimeappend_path(PlannerInfo *root,
 									 sel);
 }
 
+/*
+ * Build RuntimeAppend which scans only partitions that might contain
+ * values of 'key_var' produced by 'key_path' (see build_join_key_filter()).
+ * 'sel' is the expected fraction of partitions to be scanned.
+ */
+Path *
+create_runtimeappend_key_filter_path(PlannerInfo *root,
+									 AppendPath *inner_append,
+									 Path *key_path,
+									 Var *key_var,
+									 double sel)
+{
+	RuntimeAppendPath  *result;
+	Cost				key_cost;
+
+	result = (RuntimeAppendPath *) create_runtimeappend_path(root, inner_append,
+															 NULL, sel);
+
+	/* Plan of 'key_path' goes after plans of partitions */
+	result->key_path = key_path;
+	result->key_var = key_var;
+	result->cpath.custom_paths = lappend(result->cpath.custom_paths, key_path);
+
+	/*
+	 * All keys are collected before the first partition is scanned,
+	 * i.e. inner side of the join is run once more and its keys are
+	 * copied, in addition to its run by the HashJoin itself.
+	 */
+	key_cost = key_path->total_cost + cpu_operator_cost * key_path->rows;
+	result->cpath.path.startup_cost += key_cost;
+	result->cpath.path.total_cost += key_cost;
+
+#if PG_VERSION_NUM >= 90600
+	result->cpath.path.parallel_safe &= key_path->parallel_safe;
+#endif
+
+	return &result->cpath.path;
+}
+
+#if PG_VERSION_NUM >= 90600
+/*
+ * Build partial RuntimeAppend to be run under Gather. Its participants
+ * share partitions selected by the leader at startup, each of them
+ * scanning whole partitions (see fetch_next_tuple()).
+ */
+Path *
+create_parallel_runtimeappend_path(PlannerInfo *root,
+								   AppendPath *inner_append,
+								   double sel)
+{
+	RuntimeAppendPath  *result;
+	int					nchildren = list_length(inner_append->subpaths);
+	double				parallel_divisor,
+						leader_contribution;
+	Cost				run_cost;
+
+	/* There should be several partitions to share */
+	if (nchildren < 2 || max_parallel_workers_per_gather <= 0 ||
+		!inner_append->path.parallel_safe)
+		return NULL;
+
+	result = (RuntimeAppendPath *) create_runtimeappend_path(root, inner_append,
+															 NULL, sel);
+
+	result->cpath.path.parallel_aware = true;
+	result->cpath.path.parallel_workers = Min(nchildren,
+											  max_parallel_workers_per_gather);
+
+	/* Output of Gather is not ordered, thus there's no LIMIT either */
+	result->cpath.path.pathkeys = NIL;
+	result->tuple_bound = -1.0;
+
+	/* Leader is busy reading tuples from workers (see cost_seqscan()) */
+	parallel_divisor = result->cpath.path.parallel_workers;
+	leader_contribution = 1.0 - (0.3 * result->cpath.path.parallel_workers);
+	if (leader_contribution > 0)
+		parallel_divisor += leader_contribution;
+
+	run_cost = result->cpath.path.total_cost - result->cpath.path.startup_cost;
+	result->cpath.path.total_cost = result->cpath.path.startup_cost +
+									run_cost / parallel_divisor;
+	result->cpath.path.rows = clamp_row_est(result->cpath.path.rows /
+											parallel_divisor);
+
+	return &result->cpath.path;
+}
+#endif
+
 Plan *
 create_runtimeappend_plan(PlannerInfo *root, RelOptInfo *rel,
 						  CustomPath *best_path, List *tlist,
@@ -96,12 +221,36 @@ fetch_next_tuple(CustomScanState *node)
 	RuntimeAppendState	   *scan_state = (RuntimeAppendState *) node;
 	TupleTableSlot		   *slot = NULL;
 
+	/* Don't even start the next partition if LIMIT has been reached */
+	if (scan_state->tuple_bound >= 0 &&
+		scan_state->ntuples >= scan_state->tuple_bound)
+	{
+		scan_state->slot = NULL;
+		return;
+	}
+
+#if PG_VERSION_NUM >= 90600
+	/* Parallel participant claims its first plan */
+	if (scan_state->running_idx < 0)
+		scan_state->running_idx = (int)
+				pg_atomic_fetch_add_u32(&scan_state->pstate->next_plan, 1);
+#endif
+
 	while (scan_state->running_idx < scan_state->ncur_plans)
 	{
 		ChildScanCommon		child = scan_state->cur_plans[scan_state->running_idx];
-		PlanState		   *state = child->content.plan_state;
+		PlanState		   *state;
 		bool				quals;
 
+		/* Partitions are initialized only when we reach them */
+		if (scan_state->prepared_idx < scan_state->running_idx)
+		{
+			prepare_child_plan_state(node, child);
+			scan_state->prepared_idx = scan_state->running_idx;
+		}
+
+		state = child->content.plan_state;
+
 		for (;;)
 		{
 			slot = ExecProcNode(state);
@@ -118,11 +267,19 @@ fetch_next_tuple(CustomScanState *node)
 			if (quals)
 			{
 				scan_state->slot = slot;
+				scan_state->ntuples++;
 				return;
 			}
 		}
 
-		scan_state->running_idx++;
+#if PG_VERSION_NUM >= 90600
+		/* Claim a plan which hasn't been taken by other participants */
+		if (scan_state->pstate)
+			scan_state->running_idx = (int)
+					pg_atomic_fetch_add_u32(&scan_state->pstate->next_plan, 1);
+		else
+#endif
+			scan_state->running_idx++;
 	}
 
 	scan_state->slot = slot;
@@ -144,7 +301,7 @@ runtimeappend_end(CustomScanState *node)
 void
 runtimeappend_rescan(CustomScanState *node)
 {
-	rescan_append_common(node);
+	rescan_append_common(node, true);
 }
 
 void
@@ -154,3 +311,25 @@ runtimeappend_explain(CustomScanState *node, List *ancestors, ExplainState *es)
 
 	explain_append_common(node, scan_state->children_table, es);
 }
+
+#if PG_VERSION_NUM >= 90600
+Size
+runtimeappend_estimate_dsm(CustomScanState *node, ParallelContext *pcxt)
+{
+	return estimate_append_dsm_common(node);
+}
+
+void
+runtimeappend_initialize_dsm(CustomScanState *node, ParallelContext *pcxt,
+							 void *coordinate)
+{
+	initialize_append_dsm_common(node, coordinate);
+}
+
+void
+runtimeappend_initialize_worker(CustomScanState *node, shm_toc *toc,
+								void *coordinate)
+{
+	initialize_append_worker_common(node, coordinate);
+}
+#endif
@@ -18,6 +18,12 @@
 #include "optimizer/paths.h"
 #include "optimizer/pathnode.h"
 #include "commands/explain.h"
+#include "port/atomics.h"
+
+#if PG_VERSION_NUM >= 90600
+#include "access/parallel.h"
+#include "storage/shm_toc.h"
+#endif
 
 
 typedef struct
@@ -27,8 +33,25 @@ typedef struct
 
 	ChildScanCommon	   *children;		/* all available plans */
 	int					nchildren;
+
+	double				tuple_bound;	/* LIMIT of the query (-1 if none) */
+
+	Path			   *key_path;		/* source of join keys (or NULL) */
+	Var				   *key_var;		/* join key produced by 'key_path' */
 } RuntimeAppendPath;
 
+/*
+ * State of parallel-aware RuntimeAppend shared by all participants.
+ * Leader stores partitions selected at startup, then each participant
+ * claims a whole partition to be scanned by incrementing 'next_plan'.
+ */
+typedef struct
+{
+	pg_atomic_uint32	next_plan;		/* index of the next plan to be claimed */
+	int					nparts;			/* number of selected partitions */
+	Oid					parts[FLEXIBLE_ARRAY_MEMBER];
+} RuntimeAppendSharedState;
+
 typedef struct
 {
 	CustomScanState		css;
@@ -46,18 +69,47 @@ typedef struct
 	ChildScanCommon	   *cur_plans;
 	int					ncur_plans;
 
+	/* Partitions selected at executor startup (no PARAM_EXEC params) */
+	bool				initial_pruning;
+	Oid				   *initial_parts;
+	int					ninitial_parts;
+
+	/* Partitions hidden from AcquireExecutorLocks() (RT indices & relids) */
+	List			   *deferred_rtis;
+	List			   *deferred_oids;
+
 	/* Should we include parent table? Cached for prepared statements */
 	bool				enable_parent;
 
 	/* Index of the selected plan state */
 	int					running_idx;
 
+	/* Index of the last plan state prepared for the current scan */
+	int					prepared_idx;
+
+	/* No more than 'tuple_bound' tuples will be requested (-1 if unknown) */
+	int64				tuple_bound;
+	int64				ntuples;		/* tuples returned by the current scan */
+
+	/* Plan producing join keys, its key column and the filter built of them */
+	Plan			   *key_plan;
+	AttrNumber			key_resno;
+	Expr			   *key_filter;
+
+	/* Shared state of parallel-aware RuntimeAppend (NULL if not shared) */
+	RuntimeAppendSharedState *pstate;
+
+	/* Plan states created by parallel worker on its own */
+	List			   *worker_ps;
+
 	/* Last saved tuple (for SRF projections) */
 	TupleTableSlot	   *slot;
 } RuntimeAppendState;
 
 
 extern bool					pg_pathman_enable_runtimeappend;
+extern bool					pg_pathman_enable_deferred_locks;
+extern bool					pg_pathman_enable_join_key_filter;
 
 extern CustomPathMethods	runtimeappend_path_methods;
 extern CustomScanMethods	runtimeappend_plan_methods;
@@ -71,6 +123,18 @@ Path * create_runtimeappend_path(PlannerInfo *root,
 								 ParamPathInfo *param_info,
 								 double sel);
 
+Path * create_runtimeappend_key_filter_path(PlannerInfo *root,
+											AppendPath *inner_append,
+											Path *key_path,
+											Var *key_var,
+											double sel);
+
+#if PG_VERSION_NUM >= 90600
+Path * create_parallel_runtimeappend_path(PlannerInfo *root,
+										  AppendPath *inner_append,
+										  double sel);
+#endif
+
 Plan * create_runtimeappend_plan(PlannerInfo *root, RelOptInfo *rel,
 								 CustomPath *best_path, List *tlist,
 								 List *clauses, List *custom_plans);
@@ -91,4 +155,17 @@ void runtimeappend_explain(CustomScanState *node,
 						   List *ancestors,
 						   ExplainState *es);
 
+#if PG_VERSION_NUM >= 90600
+Size runtimeappend_estimate_dsm(CustomScanState *node,
+								ParallelContext *pcxt);
+
+void runtimeappend_initialize_dsm(CustomScanState *node,
+								  ParallelContext *pcxt,
+								  void *coordinate);
+
+void runtimeappend_initialize_worker(CustomScanState *node,
+									 shm_toc *toc,
+									 void *coordinate);
+#endif
+
 #endif
@@ -19,12 +19,19 @@
 #include "catalog/pg_extension.h"
 #include "commands/extension.h"
 #include "miscadmin.h"
+#include "optimizer/clauses.h"
 #include "optimizer/var.h"
 #include "optimizer/restrictinfo.h"
+#include "parser/parse_collate.h"
+#include "parser/parse_expr.h"
 #include "parser/parse_oper.h"
+#include "parser/parse_relation.h"
+#include "parser/parser.h"
 #include "utils/builtins.h"
 #include "utils/fmgroids.h"
+#include "utils/hsearch.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
 #include "utils/syscache.h"
 #include "utils/typcache.h"
 
@@ -33,7 +40,26 @@
 #define TABLEOID_STR_BASE_LEN ( sizeof(TABLEOID_STR("")) - 1 )
 
 
+/* Key of the comparison functions cache (see lookup_type_cmp_func()) */
+typedef struct
+{
+	Oid			type1;
+	Oid			type2;
+} cmp_func_key;
+
+typedef struct
+{
+	cmp_func_key	key;
+	bool			valid;		/* is there a comparison function? */
+	FmgrInfo		flinfo;
+} cmp_func_entry;
+
+/* Comparison functions for pairs of types */
+static HTAB	   *cmp_func_cache = NULL;
+
+
 static bool clause_contains_params_walker(Node *node, void *context);
+static bool clause_contains_exec_params_walker(Node *node, void *context);
 static void change_varnos_in_restrinct_info(RestrictInfo *rinfo,
 											change_varno_context *context);
 static bool change_varno_walker(Node *node, change_varno_context *context);
@@ -64,6 +90,30 @@ clause_contains_params_walker(Node *node, void *context)
 								  context);
 }
 
+/*
+ * Check whether clause contains PARAM_EXEC params (their
+ * values are not known until the node is actually executed)
+ */
+bool
+clause_contains_exec_params(Node *clause)
+{
+	return expression_tree_walker(clause,
+								  clause_contains_exec_params_walker,
+								  NULL);
+}
+
+static bool
+clause_contains_exec_params_walker(Node *node, void *context)
+{
+	if (node == NULL)
+		return false;
+	if (IsA(node, Param) && ((Param *) node)->paramkind == PARAM_EXEC)
+		return true;
+	return expression_tree_walker(node,
+								  clause_contains_exec_params_walker,
+								  context);
+}
+
 /*
  * Extract target entries with resnames beginning with TABLEOID_STR
  * and var->varoattno == TableOidAttributeNumber
@@ -232,23 +282,87 @@ build_index_tlist(PlannerInfo *root, IndexOptInfo *index,
 }
 
 /*
- * Get BTORDER_PROC for two types described by Oids
+ * Get BTORDER_PROC for two types described by Oids. Cross-type functions
+ * might be registered in the opfamily of either type (e.g. "int4 vs int8"
+ * or "timestamptz vs date"), so we search both of them. Binary-compatible
+ * types (e.g. varchar) are looked up by their opclass' input type.
+ *
+ * Results are cached per pair of types. Returns NULL if there's no function.
+ */
+FmgrInfo *
+lookup_type_cmp_func(Oid type1, Oid type2)
+{
+	cmp_func_key	key;
+	cmp_func_entry *entry;
+	TypeCacheEntry *tce1,
+				   *tce2;
+	Oid				cmp_proc_oid = InvalidOid;
+	FmgrInfo		flinfo;
+
+	if (!cmp_func_cache)
+	{
+		HASHCTL ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(cmp_func_key);
+		ctl.entrysize = sizeof(cmp_func_entry);
+		ctl.hcxt = TopMemoryContext; /* place data to persistent mcxt */
+
+		cmp_func_cache = hash_create("pg_pathman's comparison functions cache",
+									 32, &ctl,
+									 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+	}
+
+	memset(&key, 0, sizeof(key));
+	key.type1 = type1;
+	key.type2 = type2;
+
+	entry = hash_search(cmp_func_cache, &key, HASH_FIND, NULL);
+	if (entry)
+		return entry->valid ? &entry->flinfo : NULL;
+
+	tce1 = lookup_type_cache(type1, TYPECACHE_BTREE_OPFAMILY);
+	tce2 = lookup_type_cache(type2, TYPECACHE_BTREE_OPFAMILY);
+
+	if (OidIsValid(tce1->btree_opf))
+		cmp_proc_oid = get_opfamily_proc(tce1->btree_opf,
+										 tce1->btree_opintype,
+										 tce2->btree_opintype,
+										 BTORDER_PROC);
+
+	if (!OidIsValid(cmp_proc_oid) && OidIsValid(tce2->btree_opf))
+		cmp_proc_oid = get_opfamily_proc(tce2->btree_opf,
+										 tce1->btree_opintype,
+										 tce2->btree_opintype,
+										 BTORDER_PROC);
+
+	/* fmgr_info_cxt() might fail, so it goes before HASH_ENTER */
+	if (OidIsValid(cmp_proc_oid))
+		fmgr_info_cxt(cmp_proc_oid, &flinfo, TopMemoryContext);
+
+	/* Add entry only after all lookups have succeeded */
+	entry = hash_search(cmp_func_cache, &key, HASH_ENTER, NULL);
+	entry->valid = OidIsValid(cmp_proc_oid);
+	if (entry->valid)
+		memcpy(&entry->flinfo, &flinfo, sizeof(FmgrInfo));
+
+	return entry->valid ? &entry->flinfo : NULL;
+}
+
+/*
+ * Same as lookup_type_cmp_func(), but fills 'finfo' and
+ * complains if there's no such function.
  */
 void
 fill_type_cmp_fmgr_info(FmgrInfo *finfo, Oid type1, Oid type2)
 {
-	Oid				cmp_proc_oid;
-	TypeCacheEntry *tce;
-
-	tce = lookup_type_cache(type1, TYPECACHE_BTREE_OPFAMILY);
+	FmgrInfo   *cmp_func = lookup_type_cmp_func(type1, type2);
 
-	cmp_proc_oid = get_opfamily_proc(tce->btree_opf,
-									 type1,
-									 type2,
-									 BTORDER_PROC);
-	fmgr_info(cmp_proc_oid, finfo);
+	if (!cmp_func)
+		elog(ERROR, "Missing comparison function for types %s and %s",
+			 format_type_be(type1), format_type_be(type2));
 
-	return;
+	fmgr_info_copy(finfo, cmp_func, CurrentMemoryContext);
 }
 
 List *
@@ -561,6 +675,96 @@ get_pathman_schema(void)
 	return result;
 }
 
+/*
+ * Check if partitioning key 'key' is an expression rather than
+ * a (comma-separated) list of 'relid's columns.
+ */
+bool
+is_partitioning_expression(Oid relid, const char *key)
+{
+	List	   *columns;
+	ListCell   *lc;
+
+	if (!SplitIdentifierString(pstrdup(key), ',', &columns))
+		return true;
+
+	foreach (lc, columns)
+		if (get_attnum(relid, (const char *) lfirst(lc)) == InvalidAttrNumber)
+			return true;
+
+	return false;
+}
+
+/*
+ * Transform partitioning expression (e.g. "date_trunc('day', ts)") of 'relid'.
+ * Vars of the resulting expression have varno 1, just like in the CHECK
+ * constraints of partitions. Expression must be immutable and must reference
+ * exactly one column, its number is returned via 'key_attnum'.
+ */
+Node *
+parse_partitioning_expression(Oid relid, const char *expr_cstr,
+							  AttrNumber *key_attnum)
+{
+	char		   *query_string = psprintf("SELECT (%s)", expr_cstr);
+	List		   *parsetree_list;
+	SelectStmt	   *select_stmt = NULL;
+	ParseState	   *pstate;
+	RangeTblEntry  *rte;
+	Relation		rel;
+	Node		   *expr;
+	Bitmapset	   *varattnos = NULL;
+	int				attno;
+
+	parsetree_list = raw_parser(query_string);
+	if (list_length(parsetree_list) == 1)
+		select_stmt = (SelectStmt *) linitial(parsetree_list);
+
+	/* We expect a plain "SELECT (expression)" and nothing else */
+	if (!select_stmt || !IsA(select_stmt, SelectStmt) ||
+		select_stmt->op != SETOP_NONE ||
+		list_length(select_stmt->targetList) != 1 ||
+		select_stmt->fromClause != NIL ||
+		select_stmt->whereClause != NULL ||
+		select_stmt->groupClause != NIL ||
+		select_stmt->havingClause != NULL ||
+		select_stmt->sortClause != NIL ||
+		select_stmt->limitCount != NULL ||
+		select_stmt->limitOffset != NULL)
+		elog(ERROR, "Invalid partitioning expression \"%s\"", expr_cstr);
+
+	rel = heap_open(relid, AccessShareLock);
+
+	pstate = make_parsestate(NULL);
+	pstate->p_sourcetext = query_string;
+
+	/* Make columns of 'relid' visible to the expression */
+	rte = addRangeTableEntryForRelation(pstate, rel, NULL, false, true);
+	addRTEtoQuery(pstate, rte, false, true, true);
+
+	expr = transformExpr(pstate,
+						 ((ResTarget *) linitial(select_stmt->targetList))->val,
+						 EXPR_KIND_CHECK_CONSTRAINT);
+	assign_expr_collations(pstate, expr);
+
+	free_parsestate(pstate);
+	heap_close(rel, AccessShareLock);
+
+	/* Expression should reference a single (user) column */
+	pull_varattnos(expr, 1, &varattnos);
+	if (!bms_get_singleton_member(varattnos, &attno) ||
+		attno + FirstLowInvalidHeapAttributeNumber <= 0)
+		elog(ERROR, "Partitioning expression \"%s\" should reference "
+					"exactly one column", expr_cstr);
+
+	if (contain_mutable_functions(expr))
+		elog(ERROR, "Partitioning expression \"%s\" should be immutable",
+			 expr_cstr);
+
+	*key_attnum = (AttrNumber) (attno + FirstLowInvalidHeapAttributeNumber);
+
+	return expr;
+}
+
 /*
  * Check if this is a "date"-related type.
  */
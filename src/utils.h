@@ -47,13 +47,17 @@ void postprocess_lock_rows(List *rtable, Plan *plan);
  * Various traits.
  */
 bool clause_contains_params(Node *clause);
+bool clause_contains_exec_params(Node *clause);
 bool is_date_type_internal(Oid typid);
+bool is_partitioning_expression(Oid relid, const char *key);
 bool is_string_type_internal(Oid typid);
 
 /*
  * Misc.
  */
 Oid get_pathman_schema(void);
+Node * parse_partitioning_expression(Oid relid, const char *expr_cstr,
+									 AttrNumber *key_attnum);
 List * list_reverse(List *l);
 
 /*
@@ -61,6 +65,7 @@ List * list_reverse(List *l);
  */
 char * get_rel_name_or_relid(Oid relid);
 Oid get_binary_operator_oid(char *opname, Oid arg1, Oid arg2);
+FmgrInfo * lookup_type_cmp_func(Oid type1, Oid type2);
 void fill_type_cmp_fmgr_info(FmgrInfo *finfo,
 							 Oid type1,
 							 Oid type2);